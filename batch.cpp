@@ -0,0 +1,386 @@
+/*
+Nolan Slade
+Terrain Generator - headless batch generation
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "terrain.h"
+#include "erosion.h"
+#include "compact.h"
+#include "terrainfile.h"
+#include "meshexport.h"
+#include "threadpool.h"
+
+/* One terrain to generate and the file it is written to */
+struct Job {
+	int width;
+	int depth;
+	char algorithm;
+	int complexity;
+	unsigned int seed;
+	std::string output;
+};
+
+
+char outputFormat = 's';			// 's' streamed (version 2), 't' tiled, 'z' tiled with deflated tiles
+bool outputNormals = true;			// Tiled files can leave the normals out, they are recomputed on reading
+const char *meshFile = 0;			// Also export the terrain as a mesh, the format comes from the extension
+ExportOptions meshOptions = { 0, 't', false, -1 };
+ErosionSettings erosion = defaultErosion;	// Erosion run after generating, when -E gives it any iterations
+bool reportCompact = false;			// Report how far compact storage would be from each terrain and the memory it saves
+
+
+/* Prints command line usage */
+void printUsage (const char *program) {
+	printf("Usage: %s [options]\n", program);
+	printf("\t-s width,depth\tNumber of vertices (default 300,300)\n");
+	printf("\t-a c|f|d|n|s\tAlgorithm: circles, fault, particle deposition, gradient noise or diamond-square (default c)\n");
+	printf("\t-c complexity\tNumber of algorithm iterations (default 1000)\n");
+	printf("\t-S seed\t\tSeed for the random sequence (default 1)\n");
+	printf("\t-o file\t\tOutput file (default terrain.ter)\n");
+	printf("\t-f s|t|z\tOutput format: streamed rows (version 2), tiled for mapping (version 3), or tiled with deflated tiles\n");
+	printf("\t-N\t\tLeave the normals out of tiled files, readers recompute them\n");
+	printf("\t-q\t\tReport the height and normal error and the memory of compact storage for each terrain (output unchanged)\n");
+	printf("\t-i file\t\tRead a tiled file instead of generating, and write it to the output in the chosen format\n");
+	printf("\t-m file\t\tAlso export the mesh to a .obj, .stl or .glb file (single job or -i only)\n");
+	printf("\t-C\t\tGive the exported mesh topographic vertex colours (OBJ and glTF)\n");
+	printf("\t-Q\t\tExport the quad-strip normals instead of the triangle-strip normals\n");
+	printf("\t-e error\tSimplify the exported mesh, keeping every vertex within this height of the full mesh\n");
+	printf("\t-E iterations\tErode every generated terrain for this many iterations (default 0, no erosion)\n");
+	printf("\t-talus height\tHeight difference between neighbours thermal erosion leaves alone, 0 slips everything (default %.1f)\n", defaultErosion.talus);
+	printf("\t-rain amount\tWater falling on every vertex per erosion iteration, 0 for thermal erosion only (default %.2f)\n", defaultErosion.rain);
+	printf("\t-j jobfile\tRead jobs from a file instead, one per line: width,depth algorithm complexity seed output\n");
+	printf("\t-t threads\tNumber of jobs to run at once (default: number of cores)\n");
+	printf("\t-p threads\tThreads shared by the generation and normal passes (default: number of cores)\n");
+	printf("\t-scale max\tTime the single job on 1 to max pass threads and report the scaling, writes nothing\n");
+}
+
+
+/* Returns true if the job describes a terrain we are able to generate */
+bool validJob (const Job &job) {
+	// The terrain is stored in chunks, so only the side lengths are limited
+	if (job.width < 2 || job.depth < 2 || job.width > MAX_TERRAIN_SIDE || job.depth > MAX_TERRAIN_SIDE)
+		return false;
+	if (job.algorithm != 'c' && job.algorithm != 'f' && job.algorithm != 'd' && job.algorithm != 'n' && job.algorithm != 's')
+		return false;
+	return job.complexity >= 0 && !job.output.empty();
+}
+
+
+/* Reads one job per line from a job file, skipping blank lines and lines starting with '#' */
+bool readJobFile (const char *path, std::vector<Job> &jobs) {
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		printf("Could not open job file %s\n", path);
+		return false;
+	}
+
+	char line[1024];
+	char output[1024];
+	int lineNumber = 0;
+	bool ok = true;
+	while (fgets(line, sizeof(line), file)) {
+		lineNumber++;
+		char *start = line;
+		while (*start == ' ' || *start == '\t')
+			start++;
+		if (*start == '#' || *start == '\n' || *start == '\r' || *start == 0)
+			continue;
+
+		Job job;
+		if (sscanf(start, "%d,%d %c %d %u %1023s", &job.width, &job.depth, &job.algorithm, &job.complexity, &job.seed, output) != 6) {
+			printf("%s:%d: expected \"width,depth algorithm complexity seed output\"\n", path, lineNumber);
+			ok = false;
+			continue;
+		}
+		job.output = output;
+
+		if (!validJob(job)) {
+			printf("%s:%d: invalid job\n", path, lineNumber);
+			ok = false;
+			continue;
+		}
+		jobs.push_back(job);
+	}
+
+	fclose(file);
+	return ok;
+}
+
+
+/* Writes a terrain in the format chosen on the command line */
+bool writeOutput (const Terrain *terrain, const char *path) {
+	if (outputFormat == 's')
+		return writeTerrain(terrain, path);
+	return writeTiledTerrain(terrain, path, outputNormals, outputFormat == 'z');
+}
+
+
+/* Exports the mesh if one was asked for on the command line, returns true on success */
+bool writeMesh (const Terrain *terrain) {
+	if (!meshFile)
+		return true;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool ok = exportTerrainMesh(terrain, meshFile, meshOptions);
+	if (ok)
+		printf("Exported mesh %s (%.1f ms)\n", meshFile, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	else
+		printf("Failed to export mesh %s\n", meshFile);
+	return ok;
+}
+
+
+/* Reads a tiled file and writes it back out in the chosen format, returns true on success */
+bool convertFile (const char *input, const char *output) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Terrain terrain;
+	if (!readTiledTerrain(&terrain, input)) {
+		printf("Could not read %s as a tiled terrain file\n", input);
+		return false;
+	}
+	std::chrono::steady_clock::time_point read = std::chrono::steady_clock::now();
+	bool ok = writeOutput(&terrain, output);
+	std::chrono::steady_clock::time_point written = std::chrono::steady_clock::now();
+	if (reportCompact) {
+		CompactError error;
+		measureCompactError(&terrain, &error);
+		printCompactError(error);
+	}
+
+	printf("%dx%d %c complexity %d seed %u: read %s (%.1f ms), ", terrain.width, terrain.depth, terrain.algorithm, terrain.complexity, terrain.seed, input,
+		std::chrono::duration<double, std::milli>(read - start).count());
+	if (ok)
+		printf("wrote %s (%.1f ms)\n", output, std::chrono::duration<double, std::milli>(written - read).count());
+	else
+		printf("failed to write %s\n", output);
+	ok = writeMesh(&terrain) && ok;
+	freeTerrain(&terrain);
+	return ok;
+}
+
+
+/* Generates a single terrain with its normals and writes it to disk, returns true on success */
+/* The time of each erosion iteration, if there are any, is appended to erosionMs; compactError is filled in if given */
+bool runJob (const Job &job, std::vector<double> &erosionMs, CompactError *compactError) {
+	Terrain terrain;
+	initTerrain(&terrain, job.width, job.depth);
+	terrain.algorithm = job.algorithm;
+	terrain.complexity = job.complexity;
+	seedTerrain(&terrain, job.seed);
+
+	generateHeightValues(&terrain, true);
+	generateHeightValues(&terrain, false);
+	erodeTerrain(&terrain, erosion, &erosionMs);
+	setNormals(&terrain);
+	if (compactError)
+		measureCompactError(&terrain, compactError);
+
+	bool ok = writeOutput(&terrain, job.output.c_str());
+	ok = writeMesh(&terrain) && ok;
+	freeTerrain(&terrain);
+	return ok;
+}
+
+
+/* Times generation, erosion and normals of one job on 1 to maxThreads pass threads and prints the speedup */
+void reportScaling (const Job &job, int maxThreads) {
+	printf("%dx%d %c complexity %d seed %u, %d erosion iterations\n", job.width, job.depth, job.algorithm, job.complexity, job.seed, erosion.iterations);
+	printf("threads\tgenerate ms\terode ms\tnormals ms\ttotal ms\tspeedup\n");
+
+	Terrain terrain;
+	initTerrain(&terrain, job.width, job.depth);
+	terrain.algorithm = job.algorithm;
+	terrain.complexity = job.complexity;
+
+	double baseline = 0;
+	for (int threads = 1; threads <= maxThreads; threads++) {
+		setWorkerThreads(threads);
+		seedTerrain(&terrain, job.seed);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		generateHeightValues(&terrain, true);
+		generateHeightValues(&terrain, false);
+		std::chrono::steady_clock::time_point generated = std::chrono::steady_clock::now();
+		erodeTerrain(&terrain, erosion, 0);
+		std::chrono::steady_clock::time_point eroded = std::chrono::steady_clock::now();
+		setNormals(&terrain);
+		std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now();
+
+		double generateMs = std::chrono::duration<double, std::milli>(generated - start).count();
+		double erodeMs = std::chrono::duration<double, std::milli>(eroded - generated).count();
+		double normalsMs = std::chrono::duration<double, std::milli>(done - eroded).count();
+		double totalMs = generateMs + erodeMs + normalsMs;
+		if (threads == 1)
+			baseline = totalMs;
+		printf("%d\t%.2f\t\t%.2f\t\t%.2f\t\t%.2f\t\t%.2fx\n", threads, generateMs, erodeMs, normalsMs, totalMs, baseline / totalMs);
+	}
+	freeTerrain(&terrain);
+}
+
+
+/* Main Method */
+int main (int argc, char** argv) {
+	Job single = { 300, 300, 'c', 1000, 1, "terrain.ter" };
+	const char *jobFile = 0;
+	const char *inputFile = 0;
+	int threads = (int) std::thread::hardware_concurrency();
+	int passThreads = 0;
+	int scaleThreads = 0;
+	erosion.iterations = 0;
+
+	// Parse the command line
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "-s") == 0 && hasValue) {
+			if (sscanf(argv[++i], "%d,%d", &single.width, &single.depth) != 2) {
+				printf("Invalid size %s, expected width,depth\n", argv[i]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "-a") == 0 && hasValue) {
+			single.algorithm = argv[++i][0];
+		} else if (strcmp(argv[i], "-c") == 0 && hasValue) {
+			single.complexity = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-S") == 0 && hasValue) {
+			single.seed = (unsigned int) strtoul(argv[++i], 0, 10);
+		} else if (strcmp(argv[i], "-o") == 0 && hasValue) {
+			single.output = argv[++i];
+		} else if (strcmp(argv[i], "-f") == 0 && hasValue && argv[i + 1][0] && !argv[i + 1][1] && strchr("stz", argv[i + 1][0])) {
+			outputFormat = argv[++i][0];
+		} else if (strcmp(argv[i], "-N") == 0) {
+			outputNormals = false;
+		} else if (strcmp(argv[i], "-q") == 0) {
+			reportCompact = true;
+		} else if (strcmp(argv[i], "-i") == 0 && hasValue) {
+			inputFile = argv[++i];
+		} else if (strcmp(argv[i], "-m") == 0 && hasValue) {
+			meshFile = argv[++i];
+			meshOptions.format = exportFormatForPath(meshFile);
+			if (!meshOptions.format) {
+				printf("Unknown mesh format %s, expected .obj, .stl or .glb\n", meshFile);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "-C") == 0) {
+			meshOptions.colours = true;
+		} else if (strcmp(argv[i], "-Q") == 0) {
+			meshOptions.stripMode = 'y';
+		} else if (strcmp(argv[i], "-e") == 0 && hasValue) {
+			meshOptions.maxError = (float) atof(argv[++i]);
+			if (meshOptions.maxError < 0) {
+				printf("Invalid mesh error %s, expected 0 or more\n", argv[i]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "-E") == 0 && hasValue) {
+			erosion.iterations = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-talus") == 0 && hasValue) {
+			erosion.talus = (float) atof(argv[++i]);
+		} else if (strcmp(argv[i], "-rain") == 0 && hasValue) {
+			erosion.rain = (float) atof(argv[++i]);
+		} else if (strcmp(argv[i], "-j") == 0 && hasValue) {
+			jobFile = argv[++i];
+		} else if (strcmp(argv[i], "-t") == 0 && hasValue) {
+			threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-p") == 0 && hasValue) {
+			passThreads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-scale") == 0 && hasValue) {
+			scaleThreads = atoi(argv[++i]);
+		} else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	// Progress messages from the generator would interleave between jobs
+	terrainVerbose = false;
+
+	if (scaleThreads > 0) {
+		if (!validJob(single)) {
+			printf("Invalid job, see usage with -h\n");
+			return 1;
+		}
+		reportScaling(single, scaleThreads);
+		return 0;
+	}
+	setWorkerThreads(passThreads);
+	if (inputFile)
+		return convertFile(inputFile, single.output.c_str()) ? 0 : 1;
+
+	// Build the queue of jobs
+	std::vector<Job> jobs;
+	if (jobFile && meshFile) {
+		printf("-m exports a single terrain and cannot be used with -j\n");
+		return 1;
+	}
+	if (jobFile) {
+		if (!readJobFile(jobFile, jobs))
+			return 1;
+	} else {
+		if (!validJob(single)) {
+			printf("Invalid job, see usage with -h\n");
+			return 1;
+		}
+		jobs.push_back(single);
+	}
+
+	if (threads < 1)
+		threads = 1;
+	if (threads > (int) jobs.size())
+		threads = (int) jobs.size();
+
+	// Each worker takes the next unclaimed job until the queue is empty
+	std::atomic<int> nextJob(0);
+	std::atomic<int> failures(0);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++) {
+		workers.push_back(std::thread([&]() {
+			int j;
+			while ((j = nextJob++) < (int) jobs.size()) {
+				const Job &job = jobs[j];
+				std::chrono::steady_clock::time_point jobStart = std::chrono::steady_clock::now();
+				std::vector<double> erosionMs;
+				CompactError compactError;
+				bool ok = runJob(job, erosionMs, reportCompact ? &compactError : 0);
+				double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - jobStart).count();
+
+				// One line per job, so that lines from jobs running at once do not interleave
+				char erosionReport[128] = "";
+				if (!erosionMs.empty()) {
+					double erosionTotal = 0;
+					for (size_t e = 0; e < erosionMs.size(); e++)
+						erosionTotal += erosionMs[e];
+					snprintf(erosionReport, sizeof(erosionReport), ", eroded in %.1f ms: %.2f ms per iteration, longest %.2f ms",
+						erosionTotal, erosionTotal / erosionMs.size(), *std::max_element(erosionMs.begin(), erosionMs.end()));
+				}
+				char compactReport[160] = "";
+				if (reportCompact)
+					snprintf(compactReport, sizeof(compactReport), ", compact within %.3g height and %.2f degrees, %.1f MB instead of %.1f MB",
+						compactError.maxHeightError, std::max(compactError.maxTriangleAngle, compactError.maxQuadAngle),
+						compactError.compactBytes / 1048576.0, compactError.floatBytes / 1048576.0);
+
+				if (ok) {
+					printf("%dx%d %c complexity %d seed %u -> %s (%.1f ms%s%s)\n", job.width, job.depth, job.algorithm, job.complexity, job.seed, job.output.c_str(), ms, erosionReport, compactReport);
+				} else {
+					printf("Failed to write %s\n", job.output.c_str());
+					failures++;
+				}
+			}
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%d of %d terrains generated in %.2f s using %d job threads and %d pass threads\n", (int) jobs.size() - failures.load(), (int) jobs.size(), seconds, threads, workerThreads());
+
+	return failures.load() == 0 ? 0 : 1;
+}
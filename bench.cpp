@@ -0,0 +1,273 @@
+/*
+Nolan Slade
+Terrain Generator - benchmarks
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+#include "terrain.h"
+#include "noise.h"
+#include "erosion.h"
+#include "compact.h"
+#include "meshexport.h"
+#include "simplify.h"
+#include "threadpool.h"
+
+#define BENCH_SEED	1		// Every terrain is generated from the same seed, so runs can be compared
+#define BENCH_ERROR	2.0f		// Height error of the simplified mesh, the viewer's default
+#define BENCH_EROSION	10		// Erosion iterations per repeat, the time of one iteration is reported
+
+/* Timings of one benchmark at one size and complexity */
+struct BenchResult {
+	std::string benchmark;
+	char algorithm;				// Algorithm the heights came from
+	int width;
+	int depth;
+	int complexity;
+	std::vector<double> ms;			// One per repeat
+};
+
+
+/* Prints command line usage */
+void printUsage (const char *program) {
+	printf("Usage: %s [options]\n", program);
+	printf("\t-s sizes\tSquare terrain sides to run, comma separated (default 50,256,1024,4096)\n");
+	printf("\t-c complexities\tComplexities to generate with, comma separated (default 100,1000)\n");
+	printf("\t-r repeats\tTimes each benchmark is run, the median and the fastest are reported (default 3)\n");
+	printf("\t-p threads\tThreads shared by the passes (default: number of cores)\n");
+	printf("\t-f json|csv\tOutput format (default json)\n");
+	printf("\t-o file\t\tWrite the results to a file instead of the standard output\n");
+}
+
+
+/* Reads a comma separated list of positive integers */
+bool parseList (const char *text, std::vector<int> &values) {
+	values.clear();
+	while (*text) {
+		char *end;
+		long value = strtol(text, &end, 10);
+		if (end == text || value < 1 || (*end && *end != ','))
+			return false;
+		values.push_back((int) value);
+		text = *end ? end + 1 : end;
+	}
+	return !values.empty();
+}
+
+
+/* Milliseconds since start */
+double elapsedMs (std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+/* Times generating each algorithm on a flat terrain, the flattening itself is left out */
+/* The noise is timed a second time on the scalar kernel, as "generate-scalar" */
+void benchGeneration (Terrain *terrain, int complexity, int repeats, std::vector<BenchResult> &results) {
+	const char *algorithms = "cfdnsn";
+	for (int a = 0; a < 6; a++) {
+		noiseVectorized = a < 5;
+		BenchResult result = { std::string(a < 5 ? "generate" : "generate-scalar"), algorithms[a], terrain->width, terrain->depth, complexity, std::vector<double>() };
+		terrain->algorithm = algorithms[a];
+		terrain->complexity = complexity;
+		seedTerrain(terrain, BENCH_SEED);
+		for (int r = 0; r < repeats; r++) {
+			generateHeightValues(terrain, true);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			generateHeightValues(terrain, false);
+			result.ms.push_back(elapsedMs(start));
+		}
+		results.push_back(result);
+	}
+	noiseVectorized = true;
+}
+
+
+/* Times the passes that follow generation, on the terrain as it is */
+void benchPasses (Terrain *terrain, int repeats, std::vector<BenchResult> &results) {
+	BenchResult normals = { std::string("normals"), terrain->algorithm, terrain->width, terrain->depth, terrain->complexity, std::vector<double>() };
+	for (int r = 0; r < repeats; r++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		setNormals(terrain);
+		normals.ms.push_back(elapsedMs(start));
+	}
+	results.push_back(normals);
+
+	// Both colour streams of every vertex, as the renderer fills its colour buffers
+	BenchResult colours = { std::string("colours"), terrain->algorithm, terrain->width, terrain->depth, terrain->complexity, std::vector<double>() };
+	std::vector<float> row(terrain->width), gray(3 * (size_t) terrain->width), topographic(3 * (size_t) terrain->width);
+	for (int r = 0; r < repeats; r++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int z = 0; z < terrain->depth; z++) {
+			terrain->chunks.copyHeights(0, z, terrain->width, &row[0]);
+			heightColours(terrain, &row[0], terrain->width, &gray[0], &topographic[0]);
+		}
+		colours.ms.push_back(elapsedMs(start));
+	}
+	results.push_back(colours);
+
+	// Measuring the errors and triangulating every chunk, as the simplified draw does after a change
+	BenchResult simplify = { std::string("simplify"), terrain->algorithm, terrain->width, terrain->depth, terrain->complexity, std::vector<double>() };
+	TerrainSimplifier simplifier;
+	std::vector<unsigned int> triangles;
+	for (int r = 0; r < repeats; r++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		simplifier.build(terrain);
+		for (int i = 0; i < terrain->chunks.count(); i++) {
+			triangles.clear();
+			simplifier.triangulate(i, BENCH_ERROR, CHUNK_SIZE + 1, triangles);
+		}
+		simplify.ms.push_back(elapsedMs(start));
+	}
+	results.push_back(simplify);
+
+	// The full mesh as binary glTF, written nowhere so that only building it is timed
+	BenchResult mesh = { std::string("mesh"), terrain->algorithm, terrain->width, terrain->depth, terrain->complexity, std::vector<double>() };
+	ExportOptions options = { 'g', 't', true, -1 };
+	for (int r = 0; r < repeats; r++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		exportTerrainMesh(terrain, "/dev/null", options);
+		mesh.ms.push_back(elapsedMs(start));
+	}
+	results.push_back(mesh);
+
+	// Erosion with the viewer's settings, last as it changes the heights; each repeat carries on eroding the same terrain
+	BenchResult erosion = { std::string("erosion"), terrain->algorithm, terrain->width, terrain->depth, terrain->complexity, std::vector<double>() };
+	ErosionSettings settings = defaultErosion;
+	settings.iterations = BENCH_EROSION;
+	for (int r = 0; r < repeats; r++) {
+		std::vector<double> iterationMs;
+		erodeTerrain(terrain, settings, &iterationMs);
+		double total = 0;
+		for (size_t i = 0; i < iterationMs.size(); i++)
+			total += iterationMs[i];
+		erosion.ms.push_back(total / iterationMs.size());
+	}
+	results.push_back(erosion);
+
+	// Packing into compact storage, after erosion as the untimed unpacking between repeats leaves the rounded heights
+	BenchResult compact = { std::string("compact"), terrain->algorithm, terrain->width, terrain->depth, terrain->complexity, std::vector<double>() };
+	for (int r = 0; r < repeats; r++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		compactTerrain(terrain, 0);
+		compact.ms.push_back(elapsedMs(start));
+		expandTerrain(terrain);
+	}
+	results.push_back(compact);
+}
+
+
+/* Writes the results as a JSON array or as CSV with a header line, one record per benchmark */
+/* Per cell figures divide by width * depth whatever the benchmark's cost depends on */
+void writeResults (FILE *file, char format, const std::vector<BenchResult> &results) {
+	if (format == 'c')
+		fprintf(file, "benchmark,algorithm,width,depth,complexity,seed,threads,repeats,median_ms,min_ms,ns_per_cell,mcells_per_s\n");
+	else
+		fprintf(file, "[\n");
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult &result = results[i];
+		std::vector<double> ms = result.ms;
+		std::sort(ms.begin(), ms.end());
+		double median = ms.size() % 2 ? ms[ms.size() / 2] : (ms[ms.size() / 2 - 1] + ms[ms.size() / 2]) / 2;
+		double cells = (double) result.width * result.depth;
+		double nsPerCell = median * 1e6 / cells;
+		double throughput = median > 0 ? cells / (median * 1e3) : 0;
+
+		if (format == 'c') {
+			fprintf(file, "%s,%c,%d,%d,%d,%u,%d,%d,%.4f,%.4f,%.4f,%.3f\n", result.benchmark.c_str(), result.algorithm, result.width, result.depth,
+				result.complexity, BENCH_SEED, workerThreads(), (int) ms.size(), median, ms[0], nsPerCell, throughput);
+		} else {
+			fprintf(file, "  {\"benchmark\": \"%s\", \"algorithm\": \"%c\", \"width\": %d, \"depth\": %d, \"complexity\": %d, \"seed\": %u, "
+				"\"threads\": %d, \"repeats\": %d, \"median_ms\": %.4f, \"min_ms\": %.4f, \"ns_per_cell\": %.4f, \"mcells_per_s\": %.3f}%s\n",
+				result.benchmark.c_str(), result.algorithm, result.width, result.depth, result.complexity, BENCH_SEED, workerThreads(),
+				(int) ms.size(), median, ms[0], nsPerCell, throughput, i + 1 < results.size() ? "," : "");
+		}
+	}
+
+	if (format != 'c')
+		fprintf(file, "]\n");
+}
+
+
+/* Main Method */
+int main (int argc, char** argv) {
+	std::vector<int> sizes, complexities;
+	parseList("50,256,1024,4096", sizes);
+	parseList("100,1000", complexities);
+	int repeats = 3;
+	int passThreads = 0;
+	char format = 'j';
+	const char *outputFile = 0;
+
+	// Parse the command line
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "-s") == 0 && hasValue) {
+			if (!parseList(argv[++i], sizes)) {
+				printf("Invalid sizes %s, expected a comma separated list\n", argv[i]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "-c") == 0 && hasValue) {
+			if (!parseList(argv[++i], complexities)) {
+				printf("Invalid complexities %s, expected a comma separated list\n", argv[i]);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "-r") == 0 && hasValue) {
+			repeats = std::max(atoi(argv[++i]), 1);
+		} else if (strcmp(argv[i], "-p") == 0 && hasValue) {
+			passThreads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-f") == 0 && hasValue && (strcmp(argv[i + 1], "json") == 0 || strcmp(argv[i + 1], "csv") == 0)) {
+			format = argv[++i][0];
+		} else if (strcmp(argv[i], "-o") == 0 && hasValue) {
+			outputFile = argv[++i];
+		} else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+	for (size_t s = 0; s < sizes.size(); s++) {
+		if (sizes[s] < 2 || sizes[s] > MAX_TERRAIN_SIDE) {
+			printf("Invalid size %d\n", sizes[s]);
+			return 1;
+		}
+	}
+
+	terrainVerbose = false;
+	setWorkerThreads(passThreads);
+
+	// Generation at every size and complexity, then the other passes once per size on the last terrain generated
+	std::vector<BenchResult> results;
+	for (size_t s = 0; s < sizes.size(); s++) {
+		Terrain terrain;
+		initTerrain(&terrain, sizes[s], sizes[s]);
+		for (size_t c = 0; c < complexities.size(); c++) {
+			fprintf(stderr, "%dx%d complexity %d: generating\n", sizes[s], sizes[s], complexities[c]);
+			benchGeneration(&terrain, complexities[c], repeats, results);
+		}
+
+		// The passes run on circles terrain, whose heights vary smoothly like the viewer's default
+		fprintf(stderr, "%dx%d: normals, colours, simplify, mesh, erosion, compact\n", sizes[s], sizes[s]);
+		terrain.algorithm = 'c';
+		generateHeightValues(&terrain, true);
+		generateHeightValues(&terrain, false);
+		benchPasses(&terrain, repeats, results);
+		freeTerrain(&terrain);
+	}
+
+	FILE *file = outputFile ? fopen(outputFile, "w") : stdout;
+	if (!file) {
+		printf("Could not open %s\n", outputFile);
+		return 1;
+	}
+	writeResults(file, format, results);
+	if (outputFile)
+		fclose(file);
+	return 0;
+}
@@ -0,0 +1,92 @@
+/*
+Nolan Slade
+Terrain Generator - chunked terrain storage
+*/
+
+#include <string.h>
+#include <sys/mman.h>
+#include <algorithm>
+
+#include "chunkgrid.h"
+
+
+ChunkGrid::ChunkGrid () : gridWidth(0), gridDepth(0), columns(0), rows(0), mapping(0), mappingLength(0) {
+}
+
+
+ChunkGrid::~ChunkGrid () {
+	release();
+}
+
+
+void ChunkGrid::resize (int width, int depth) {
+	layOut(width, depth);
+	for (size_t i = 0; i < chunks.size(); i++) {
+		TerrainChunk *c = chunks[i].get();
+		c->field.resize(std::min(CHUNK_SIZE, width - c->x0), std::min(CHUNK_SIZE, depth - c->z0));
+	}
+}
+
+
+void ChunkGrid::layOut (int width, int depth) {
+	chunks.clear();
+	unmap();
+	gridWidth = width;
+	gridDepth = depth;
+	columns = (width + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+	rows = (depth + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+
+	chunks.resize(columns * rows);
+	for (int cz = 0; cz < rows; cz++) {
+		for (int cx = 0; cx < columns; cx++) {
+			TerrainChunk *c = new TerrainChunk;
+			c->x0 = cx << CHUNK_SHIFT;
+			c->z0 = cz << CHUNK_SHIFT;
+			c->minHeight = c->maxHeight = 0;
+			chunks[cz * columns + cx].reset(c);
+		}
+	}
+}
+
+
+void ChunkGrid::release () {
+	chunks.clear();
+	unmap();
+	gridWidth = gridDepth = columns = rows = 0;
+}
+
+
+void ChunkGrid::adoptMapping (void *address, size_t length) {
+	unmap();
+	mapping = address;
+	mappingLength = length;
+}
+
+
+/* Unmaps the adopted file, only once no chunk points into it */
+void ChunkGrid::unmap () {
+	if (mapping)
+		munmap(mapping, mappingLength);
+	mapping = 0;
+	mappingLength = 0;
+}
+
+
+size_t ChunkGrid::bytes () const {
+	size_t total = 0;
+	for (size_t i = 0; i < chunks.size(); i++)
+		total += chunks[i]->field.bytes() + chunks[i]->compact.bytes();
+	return total;
+}
+
+
+void ChunkGrid::copyHeights (int x, int z, int count, float *out) const {
+	while (count > 0) {
+		const TerrainChunk &c = chunkAt(x, z);
+		int run = std::min(count, c.x0 + c.field.width() - x);
+		memcpy(out, c.field.heightRow(z - c.z0) + (x - c.x0), run * sizeof(float));
+		out += run;
+		x += run;
+		count -= run;
+	}
+}
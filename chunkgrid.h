@@ -0,0 +1,89 @@
+/*
+Nolan Slade
+Terrain Generator - chunked terrain storage
+*/
+
+#ifndef CHUNKGRID_H
+#define CHUNKGRID_H
+
+#include <vector>
+#include <memory>
+
+#include "heightfield.h"
+
+#define CHUNK_SHIFT	8			// Chunks are 2^CHUNK_SHIFT vertices on a side
+#define CHUNK_SIZE	(1 << CHUNK_SHIFT)	// Vertices along each side of a full chunk, edge chunks can be smaller
+
+/* One square tile of the terrain with its own heights and normals, chunks do not share vertices */
+struct TerrainChunk {
+	Heightfield field;			// Vertices x0 to x0 + field.width() - 1 and z0 to z0 + field.depth() - 1
+	CompactHeightfield compact;		// The same vertices packed while the terrain is compact, the field is then empty
+	int x0, z0;				// First vertex of the chunk on the whole terrain
+	float minHeight, maxHeight;		// Height range of the chunk after the last generation
+};
+
+/* A terrain of any size as a grid of separately allocated chunks, no allocation grows with the whole terrain */
+/* Vertex coordinates are ints, anything counting vertices across chunks is 64-bit */
+class ChunkGrid {
+public:
+	ChunkGrid ();
+	~ChunkGrid ();
+
+	/* Sets the size in vertices, reallocating every chunk; contents are undefined afterwards */
+	void resize (int width, int depth);
+
+	/* Sets the size in vertices but leaves every chunk's field empty, to be sized or attached one by one */
+	void layOut (int width, int depth);
+
+	/* Frees every chunk */
+	void release ();
+
+	/* Keeps a memory-mapped file alive for chunks attached to it, until the grid is resized or released */
+	void adoptMapping (void *address, size_t length);
+
+	int width () const { return gridWidth; }
+	int depth () const { return gridDepth; }
+	int chunksX () const { return columns; }
+	int chunksZ () const { return rows; }
+	int count () const { return columns * rows; }
+	long long vertices () const { return (long long) gridWidth * gridDepth; }
+	size_t bytes () const;
+
+	TerrainChunk &chunk (int i) { return *chunks[i]; }
+	const TerrainChunk &chunk (int i) const { return *chunks[i]; }
+	TerrainChunk &chunk (int cx, int cz) { return *chunks[cz * columns + cx]; }
+	const TerrainChunk &chunk (int cx, int cz) const { return *chunks[cz * columns + cx]; }
+
+	/* Chunk holding vertex (x, z) */
+	TerrainChunk &chunkAt (int x, int z) { return chunk(x >> CHUNK_SHIFT, z >> CHUNK_SHIFT); }
+	const TerrainChunk &chunkAt (int x, int z) const { return chunk(x >> CHUNK_SHIFT, z >> CHUNK_SHIFT); }
+
+	/* Height of vertex (x, z), for passes that touch scattered vertices */
+	float &height (int x, int z) {
+		TerrainChunk &c = chunkAt(x, z);
+		return c.field.heightRow(z - c.z0)[x - c.x0];
+	}
+	float height (int x, int z) const {
+		const TerrainChunk &c = chunkAt(x, z);
+		return c.field.heightRow(z - c.z0)[x - c.x0];
+	}
+
+	/* Copies count heights of row z starting at x into out, crossing chunks as needed */
+	void copyHeights (int x, int z, int count, float *out) const;
+
+private:
+	void unmap ();
+
+	ChunkGrid (const ChunkGrid &) = delete;
+	ChunkGrid &operator= (const ChunkGrid &) = delete;
+
+	std::vector<std::unique_ptr<TerrainChunk> > chunks;	// Row by row, chunksX chunks per row
+	int gridWidth;
+	int gridDepth;
+	int columns;
+	int rows;
+	void *mapping;					// Mapped file the chunks may point into, or null
+	size_t mappingLength;
+};
+
+#endif
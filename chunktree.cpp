@@ -0,0 +1,189 @@
+/*
+Nolan Slade
+Terrain Generator - chunk bounding boxes and view-frustum culling
+*/
+
+#include <math.h>
+#include <algorithm>
+
+#include "chunktree.h"
+
+
+/* Extracts the clip planes from column-major GL matrices, in the coordinates the modelview is applied to */
+void frustumFromMatrices (const float *projection, const float *modelview, Frustum *frustum) {
+	float clip[16];
+	for (int column = 0; column < 4; column++)
+		for (int row = 0; row < 4; row++)
+			clip[4 * column + row] = projection[row] * modelview[4 * column] + projection[4 + row] * modelview[4 * column + 1]
+				+ projection[8 + row] * modelview[4 * column + 2] + projection[12 + row] * modelview[4 * column + 3];
+
+	// Left, right, bottom, top, near, far: the w row plus or minus the x, y and z rows
+	for (int p = 0; p < 6; p++) {
+		int row = p / 2;
+		float sign = p % 2 == 0 ? 1 : -1;
+		float length = 0;
+		for (int i = 0; i < 4; i++) {
+			frustum->planes[p][i] = clip[4 * i + 3] + sign * clip[4 * i + row];
+			if (i < 3)
+				length += frustum->planes[p][i] * frustum->planes[p][i];
+		}
+		length = sqrtf(length);
+		for (int i = 0; i < 4; i++)
+			frustum->planes[p][i] /= length;
+	}
+}
+
+
+/* Classifies a box as outside, partly inside or inside the frustum, testing the nearest and furthest corner to each plane */
+/* Boxes near a corner of the frustum can be reported partial when they are outside, which only costs a draw */
+int frustumTestBox (const Frustum &frustum, const BoundingBox &box) {
+	int result = FRUSTUM_INSIDE;
+	for (int p = 0; p < 6; p++) {
+		const float *plane = frustum.planes[p];
+		float furthest = plane[3], nearest = plane[3];
+		for (int axis = 0; axis < 3; axis++) {
+			furthest += plane[axis] * (plane[axis] > 0 ? box.high[axis] : box.low[axis]);
+			nearest += plane[axis] * (plane[axis] > 0 ? box.low[axis] : box.high[axis]);
+		}
+		if (furthest < 0)
+			return FRUSTUM_OUTSIDE;
+		if (nearest < 0)
+			result = FRUSTUM_PARTIAL;
+	}
+	return result;
+}
+
+
+void ChunkTree::resize (const ChunkGrid &grid) {
+	levels.clear();
+	if (grid.count() == 0)
+		return;
+	int nodesX = grid.chunksX(), nodesZ = grid.chunksZ();
+	while (1) {
+		Level level;
+		level.nodesX = nodesX;
+		level.nodesZ = nodesZ;
+		BoundingBox empty = { { 0, 0, 0 }, { 0, 0, 0 } };
+		level.boxes.assign(nodesX * nodesZ, empty);
+		levels.push_back(level);
+		if (nodesX == 1 && nodesZ == 1)
+			break;
+		nodesX = (nodesX + 1) / 2;
+		nodesZ = (nodesZ + 1) / 2;
+	}
+}
+
+
+void ChunkTree::refresh (const ChunkGrid &grid, float spacing, int firstCX, int firstCZ, int lastCX, int lastCZ) {
+	if (levels.empty())
+		return;
+
+	// Chunk boxes: the chunk's own height range widened by the row and column its mesh borrows from the next chunks
+	for (int cz = firstCZ; cz < lastCZ; cz++) {
+		for (int cx = firstCX; cx < lastCX; cx++) {
+			const TerrainChunk &chunk = grid.chunk(cx, cz);
+			int lastX = std::min(chunk.x0 + chunk.field.width(), grid.width() - 1);
+			int lastZ = std::min(chunk.z0 + chunk.field.depth(), grid.depth() - 1);
+			float low = chunk.minHeight, high = chunk.maxHeight;
+			if (lastX >= chunk.x0 + chunk.field.width()) {
+				for (int z = chunk.z0; z <= lastZ; z++) {
+					low = std::min(low, grid.height(lastX, z));
+					high = std::max(high, grid.height(lastX, z));
+				}
+			}
+			if (lastZ >= chunk.z0 + chunk.field.depth()) {
+				for (int x = chunk.x0; x <= lastX; x++) {
+					low = std::min(low, grid.height(x, lastZ));
+					high = std::max(high, grid.height(x, lastZ));
+				}
+			}
+
+			setChunkBox(grid, spacing, cx, cz, low, high);
+		}
+	}
+	mergeAbove(firstCX, firstCZ, lastCX, lastCZ);
+}
+
+
+void ChunkTree::refresh (const ChunkGrid &grid, float spacing, const float *meshRanges) {
+	if (levels.empty())
+		return;
+	for (int i = 0; i < grid.count(); i++)
+		setChunkBox(grid, spacing, i % grid.chunksX(), i / grid.chunksX(), meshRanges[2 * i], meshRanges[2 * i + 1]);
+	mergeAbove(0, 0, grid.chunksX(), grid.chunksZ());
+}
+
+
+/* Box of one chunk's mesh with the given height range */
+void ChunkTree::setChunkBox (const ChunkGrid &grid, float spacing, int cx, int cz, float low, float high) {
+	int x0 = cx << CHUNK_SHIFT, z0 = cz << CHUNK_SHIFT;
+	BoundingBox &box = levels[0].boxes[cz * levels[0].nodesX + cx];
+	box.low[0] = x0 * spacing;
+	box.low[1] = low;
+	box.low[2] = z0 * spacing;
+	box.high[0] = std::min(x0 + CHUNK_SIZE, grid.width() - 1) * spacing;
+	box.high[1] = high;
+	box.high[2] = std::min(z0 + CHUNK_SIZE, grid.depth() - 1) * spacing;
+}
+
+
+/* Merges the children of every node above a rectangle of chunks again */
+void ChunkTree::mergeAbove (int firstCX, int firstCZ, int lastCX, int lastCZ) {
+	for (size_t l = 1; l < levels.size(); l++) {
+		firstCX /= 2;
+		firstCZ /= 2;
+		lastCX = (lastCX + 1) / 2;
+		lastCZ = (lastCZ + 1) / 2;
+		const Level &below = levels[l - 1];
+		Level &level = levels[l];
+		for (int z = firstCZ; z < lastCZ; z++) {
+			for (int x = firstCX; x < lastCX; x++) {
+				BoundingBox &box = level.boxes[z * level.nodesX + x];
+				box = below.boxes[2 * z * below.nodesX + 2 * x];
+				for (int c = 1; c < 4; c++) {
+					int childX = 2 * x + (c & 1), childZ = 2 * z + (c >> 1);
+					if (childX >= below.nodesX || childZ >= below.nodesZ)
+						continue;
+					const BoundingBox &child = below.boxes[childZ * below.nodesX + childX];
+					for (int axis = 0; axis < 3; axis++) {
+						box.low[axis] = std::min(box.low[axis], child.low[axis]);
+						box.high[axis] = std::max(box.high[axis], child.high[axis]);
+					}
+				}
+			}
+		}
+	}
+}
+
+
+int ChunkTree::cull (const Frustum &frustum, std::vector<char> &visible) const {
+	int count = 0;
+	if (levels.empty()) {
+		visible.clear();
+		return 0;
+	}
+	visible.assign(levels[0].boxes.size(), 0);
+	cullNode(frustum, (int) levels.size() - 1, 0, 0, false, visible, &count);
+	return count;
+}
+
+
+/* Walks down from one node; once a node is entirely inside, its chunks are marked without further tests */
+void ChunkTree::cullNode (const Frustum &frustum, int level, int x, int z, bool inside, std::vector<char> &visible, int *count) const {
+	const Level &here = levels[level];
+	if (x >= here.nodesX || z >= here.nodesZ)
+		return;
+	if (!inside) {
+		int test = frustumTestBox(frustum, here.boxes[z * here.nodesX + x]);
+		if (test == FRUSTUM_OUTSIDE)
+			return;
+		inside = test == FRUSTUM_INSIDE;
+	}
+	if (level == 0) {
+		visible[z * here.nodesX + x] = 1;
+		(*count)++;
+		return;
+	}
+	for (int c = 0; c < 4; c++)
+		cullNode(frustum, level - 1, 2 * x + (c & 1), 2 * z + (c >> 1), inside, visible, count);
+}
@@ -0,0 +1,65 @@
+/*
+Nolan Slade
+Terrain Generator - chunk bounding boxes and view-frustum culling
+*/
+
+#ifndef CHUNKTREE_H
+#define CHUNKTREE_H
+
+#include <vector>
+
+#include "chunkgrid.h"
+
+/* Axis-aligned box in terrain coordinates (vertex position times VERT_SPACING, height as is) */
+struct BoundingBox {
+	float low[3];
+	float high[3];
+};
+
+/* The six clip planes of a projection and modelview, each as ax + by + cz + d >= 0 for points inside */
+struct Frustum {
+	float planes[6][4];
+};
+
+/* Result of testing a box against a frustum */
+#define FRUSTUM_OUTSIDE		0
+#define FRUSTUM_PARTIAL		1
+#define FRUSTUM_INSIDE		2
+
+void frustumFromMatrices (const float *projection, const float *modelview, Frustum *frustum);
+int frustumTestBox (const Frustum &frustum, const BoundingBox &box);
+
+/* Quadtree of chunk bounding boxes: level 0 has one box per chunk, each level above merges 2x2 boxes */
+/* of the level below, up to a single box around the whole terrain */
+class ChunkTree {
+public:
+	/* Lays out the levels for the chunks of a grid, every box is empty until refreshed */
+	void resize (const ChunkGrid &grid);
+
+	/* Rebuilds the boxes of chunks firstCX..lastCX-1 by firstCZ..lastCZ-1 and of every node above them */
+	/* A chunk box covers the chunk's mesh, which reaches one vertex into the next chunks */
+	void refresh (const ChunkGrid &grid, float spacing, int firstCX, int firstCZ, int lastCX, int lastCZ);
+
+	/* Rebuilds every box from known mesh height ranges, low and high for each chunk in order, without reading any heights */
+	void refresh (const ChunkGrid &grid, float spacing, const float *meshRanges);
+
+	/* Sets visible[i] for every chunk i whose box touches the frustum and returns how many do */
+	int cull (const Frustum &frustum, std::vector<char> &visible) const;
+
+	int levelCount () const { return (int) levels.size(); }
+	const BoundingBox &box (int level, int x, int z) const { return levels[level].boxes[z * levels[level].nodesX + x]; }
+
+private:
+	struct Level {
+		int nodesX, nodesZ;
+		std::vector<BoundingBox> boxes;		// Row by row
+	};
+
+	void setChunkBox (const ChunkGrid &grid, float spacing, int cx, int cz, float low, float high);
+	void mergeAbove (int firstCX, int firstCZ, int lastCX, int lastCZ);
+	void cullNode (const Frustum &frustum, int level, int x, int z, bool inside, std::vector<char> &visible, int *count) const;
+
+	std::vector<Level> levels;			// Chunks first, the last level has a single box
+};
+
+#endif
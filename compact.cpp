@@ -0,0 +1,221 @@
+/*
+Nolan Slade
+Terrain Generator - compact storage of heights and normals
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "compact.h"
+#include "threadpool.h"
+#include "trace.h"
+
+/* Errors of one chunk, summed in chunk order afterwards so the report does not depend on the thread count */
+struct CompactSums {
+	double heightSquares;
+	double triangleAngles;
+	double quadAngles;
+	float maxHeight;
+	float maxTriangle;
+	float maxQuad;
+	size_t floatBytes;
+};
+
+
+float compactStep (const Terrain *terrain) {
+	return (terrain->maxHeight - terrain->minHeight) / COMPACT_STEPS;
+}
+
+
+void unpackNormal (const unsigned char *uv, float *normal) {
+	// u and v are the octahedron's x + z and x - z, turned 45 degrees so the upper half fills the whole square
+	float a = uv[0] * (2.0f / 255) - 1, b = uv[1] * (2.0f / 255) - 1;
+	float x = (a + b) * 0.5f, z = (a - b) * 0.5f;
+	float y = 1 - fabsf(x) - fabsf(z);
+	float inverse = 1.0f / sqrtf(x * x + y * y + z * z);
+	normal[0] = x * inverse;
+	normal[1] = y * inverse;
+	normal[2] = z * inverse;
+}
+
+
+void packNormal (float x, float y, float z, unsigned char *uv) {
+	// Project onto the upper half of the octahedron |x| + |y| + |z| = 1, then take the closest of the four roundings
+	float sum = fabsf(x) + std::max(y, 0.0f) + fabsf(z);
+	float px = x / sum, pz = z / sum;
+	float u = (px + pz + 1) * 127.5f, v = (px - pz + 1) * 127.5f;
+	// The candidates are compared by their squared cosine with the normal (signed), which needs no square root
+	float best = -2;
+	for (int i = 0; i < 4; i++) {
+		float cu = (i & 1) ? ceilf(u) : floorf(u), cv = (i & 2) ? ceilf(v) : floorf(v);
+		cu = std::min(std::max(cu, 0.0f), 255.0f);
+		cv = std::min(std::max(cv, 0.0f), 255.0f);
+		float a = cu * (2.0f / 255) - 1, b = cv * (2.0f / 255) - 1;
+		float dx = (a + b) * 0.5f, dz = (a - b) * 0.5f;
+		float dy = 1 - fabsf(dx) - fabsf(dz);
+		float dot = dx * x + dy * y + dz * z;
+		float alignment = dot * fabsf(dot) / (dx * dx + dy * dy + dz * dz);
+		if (alignment > best) {
+			best = alignment;
+			uv[0] = (unsigned char) cu;
+			uv[1] = (unsigned char) cv;
+		}
+	}
+}
+
+
+/* Degrees between a unit normal and the one its packed bytes decode to */
+static float normalError (float x, float y, float z, const unsigned char *uv) {
+	float decoded[3];
+	unpackNormal(uv, decoded);
+	float alignment = std::min(std::max(decoded[0] * x + decoded[1] * y + decoded[2] * z, -1.0f), 1.0f);
+	return acosf(alignment) * (float) (180 / M_PI);
+}
+
+
+/* Packs one chunk's float field into compact and, if sums is given, sums up how far the packed values are from the floats */
+static void packChunk (const TerrainChunk &chunk, float base, float step, CompactHeightfield &compact, CompactSums *sums) {
+	const Heightfield &field = chunk.field;
+	size_t vertices = (size_t) field.width() * field.depth();
+	compact.width = field.width();
+	compact.depth = field.depth();
+	compact.heights.resize(vertices);
+	compact.normals.resize(COMPACT_NORMAL_BYTES * vertices);
+	if (sums) {
+		*sums = CompactSums();
+		sums->floatBytes = field.bytes();
+	}
+
+	for (int z = 0; z < field.depth(); z++) {
+		for (int x = 0; x < field.width(); x++) {
+			int index = field.index(x, z);
+			size_t packed = (size_t) z * field.width() + x;
+			float height = field.heights()[index];
+			float steps = step > 0 ? std::min(std::max(floorf((height - base) / step + 0.5f), 0.0f), (float) COMPACT_STEPS) : 0;
+			compact.heights[packed] = (unsigned short) steps;
+			unsigned char *uv = &compact.normals[COMPACT_NORMAL_BYTES * packed];
+			float tx = field.triangleNormals(0)[index], ty = field.triangleNormals(1)[index], tz = field.triangleNormals(2)[index];
+			float qx = field.quadNormals(0)[index], qy = field.quadNormals(1)[index], qz = field.quadNormals(2)[index];
+			packNormal(tx, ty, tz, uv);
+			packNormal(qx, qy, qz, uv + 2);
+			if (!sums)
+				continue;
+
+			float heightError = fabsf(base + compact.heights[packed] * step - height);
+			sums->heightSquares += (double) heightError * heightError;
+			sums->maxHeight = std::max(sums->maxHeight, heightError);
+			float triangleError = normalError(tx, ty, tz, uv), quadError = normalError(qx, qy, qz, uv + 2);
+			sums->triangleAngles += triangleError;
+			sums->quadAngles += quadError;
+			sums->maxTriangle = std::max(sums->maxTriangle, triangleError);
+			sums->maxQuad = std::max(sums->maxQuad, quadError);
+		}
+	}
+}
+
+
+/* Combines the chunk sums in order into the report */
+static void finishError (const Terrain *terrain, const std::vector<CompactSums> &sums, const std::vector<size_t> &compactBytes, CompactError *error) {
+	double heightSquares = 0, triangleAngles = 0, quadAngles = 0;
+	*error = CompactError();
+	error->heightStep = compactStep(terrain);
+	for (size_t i = 0; i < sums.size(); i++) {
+		heightSquares += sums[i].heightSquares;
+		triangleAngles += sums[i].triangleAngles;
+		quadAngles += sums[i].quadAngles;
+		error->maxHeightError = std::max(error->maxHeightError, sums[i].maxHeight);
+		error->maxTriangleAngle = std::max(error->maxTriangleAngle, sums[i].maxTriangle);
+		error->maxQuadAngle = std::max(error->maxQuadAngle, sums[i].maxQuad);
+		error->floatBytes += sums[i].floatBytes;
+		error->compactBytes += compactBytes[i];
+	}
+	double vertices = (double) terrain->chunks.vertices();
+	error->rmsHeightError = (float) sqrt(heightSquares / vertices);
+	error->meanTriangleAngle = (float) (triangleAngles / vertices);
+	error->meanQuadAngle = (float) (quadAngles / vertices);
+}
+
+
+void compactTerrain (Terrain *terrain, CompactError *error) {
+	TRACE_ZONE("compact");
+	if (terrain->compact)
+		return;
+	float base = terrain->minHeight, step = compactStep(terrain);
+	std::vector<CompactSums> sums(error ? terrain->chunks.count() : 0);
+	std::vector<size_t> compactBytes(terrain->chunks.count());
+	parallelFor(terrain->chunks.count(), 1, [terrain, base, step, error, &sums, &compactBytes](int firstChunk, int lastChunk) {
+		for (int i = firstChunk; i < lastChunk; i++) {
+			TerrainChunk &chunk = terrain->chunks.chunk(i);
+			packChunk(chunk, base, step, chunk.compact, error ? &sums[i] : 0);
+			compactBytes[i] = chunk.compact.bytes();
+			chunk.field.release();
+		}
+	});
+	if (error)
+		finishError(terrain, sums, compactBytes, error);
+
+	// The rounded heights are not what generating gives, so nothing may carry on from them
+	resetGeneration(terrain);
+	terrain->compact = true;
+}
+
+
+void expandTerrain (Terrain *terrain) {
+	TRACE_ZONE("expand");
+	if (!terrain->compact)
+		return;
+	float base = terrain->minHeight, step = compactStep(terrain);
+	parallelFor(terrain->chunks.count(), 1, [terrain, base, step](int firstChunk, int lastChunk) {
+		for (int i = firstChunk; i < lastChunk; i++) {
+			TerrainChunk &chunk = terrain->chunks.chunk(i);
+			CompactHeightfield &compact = chunk.compact;
+			Heightfield &field = chunk.field;
+			field.resize(compact.width, compact.depth);
+			for (int z = 0; z < compact.depth; z++) {
+				for (int x = 0; x < compact.width; x++) {
+					int index = field.index(x, z);
+					size_t packed = (size_t) z * compact.width + x;
+					float triangle[3], quad[3];
+					unpackNormal(&compact.normals[COMPACT_NORMAL_BYTES * packed], triangle);
+					unpackNormal(&compact.normals[COMPACT_NORMAL_BYTES * packed + 2], quad);
+					field.heights()[index] = base + compact.heights[packed] * step;
+					for (int axis = 0; axis < 3; axis++) {
+						field.triangleNormals(axis)[index] = triangle[axis];
+						field.quadNormals(axis)[index] = quad[axis];
+					}
+				}
+			}
+			CompactHeightfield empty;
+			std::swap(compact, empty);
+		}
+	});
+	terrain->compact = false;
+	measureHeights(terrain);
+}
+
+
+void measureCompactError (const Terrain *terrain, CompactError *error) {
+	TRACE_ZONE("compact error");
+	float base = terrain->minHeight, step = compactStep(terrain);
+	std::vector<CompactSums> sums(terrain->chunks.count());
+	std::vector<size_t> compactBytes(terrain->chunks.count());
+	parallelFor(terrain->chunks.count(), 1, [terrain, base, step, &sums, &compactBytes](int firstChunk, int lastChunk) {
+		CompactHeightfield compact;
+		for (int i = firstChunk; i < lastChunk; i++) {
+			packChunk(terrain->chunks.chunk(i), base, step, compact, &sums[i]);
+			compactBytes[i] = (size_t) compact.width * compact.depth * COMPACT_VERTEX_BYTES;
+		}
+	});
+	finishError(terrain, sums, compactBytes, error);
+}
+
+
+void printCompactError (const CompactError &error) {
+	printf("Compact heights: within %.3g of the floats (RMS %.3g), steps of %.3g\n", error.maxHeightError, error.rmsHeightError, error.heightStep);
+	printf("Compact normals: within %.2f degrees (mean %.2f) for triangle strips, %.2f degrees (mean %.2f) for quad strips\n",
+		error.maxTriangleAngle, error.meanTriangleAngle, error.maxQuadAngle, error.meanQuadAngle);
+	printf("Compact memory: %.1f MB instead of %.1f MB (%.1fx smaller)\n", error.compactBytes / 1048576.0, error.floatBytes / 1048576.0,
+		error.compactBytes ? (double) error.floatBytes / error.compactBytes : 0.0);
+}
@@ -0,0 +1,53 @@
+/*
+Nolan Slade
+Terrain Generator - compact storage of heights and normals
+*/
+
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include "terrain.h"
+
+#define COMPACT_STEPS		65535		// Height steps between the lowest and the highest point of the terrain
+#define COMPACT_NORMAL_BYTES	4		// Bytes of the two normals of a vertex
+#define COMPACT_VERTEX_BYTES	(sizeof(unsigned short) + COMPACT_NORMAL_BYTES)
+
+/* How far a compact terrain is from the float terrain it was packed from */
+struct CompactError {
+	float heightStep;			// Height of one 16-bit step
+	float maxHeightError;
+	float rmsHeightError;
+	float maxTriangleAngle;			// Angle between the float and the packed normals, in degrees
+	float meanTriangleAngle;
+	float maxQuadAngle;
+	float meanQuadAngle;
+	size_t floatBytes;			// Memory of the chunks as float fields and as compact fields
+	size_t compactBytes;
+};
+
+/* Height of one step for the terrain's height range; 0 for a flat terrain, whose every step is its one height */
+float compactStep (const Terrain *terrain);
+
+/* Packs a unit normal pointing up (y >= 0) into hemi-octahedral u, v bytes, picking the rounding that keeps it closest */
+void packNormal (float x, float y, float z, unsigned char *uv);
+
+/* Unit normal of packed u, v bytes, the same arithmetic as the compact vertex shader */
+void unpackNormal (const unsigned char *uv, float *normal);
+
+/* Packs every chunk into its compact field and releases the float fields: 6 bytes per vertex instead of 28, 4.7x less, short of a 5x cut */
+/* Heights are steps between the terrain's lowest and highest points, so call it after measureHeights and setNormals */
+/* The generation checkpoints are dropped and the heights no longer count as generated, as they are rounded */
+/* If error is given it is filled in with how far the packed terrain is from the float one */
+void compactTerrain (Terrain *terrain, CompactError *error);
+
+/* Unpacks every chunk back into float fields and releases the compact ones, for the passes that need floats */
+/* The heights and normals are the rounded ones the compact terrain held */
+void expandTerrain (Terrain *terrain);
+
+/* Fills in error as compactTerrain would, without changing the terrain */
+void measureCompactError (const Terrain *terrain, CompactError *error);
+
+/* Prints the error report, one line for heights, one for normals and one for memory */
+void printCompactError (const CompactError &error);
+
+#endif
@@ -0,0 +1,307 @@
+/*
+Nolan Slade
+Terrain Generator - thermal and hydraulic erosion
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "erosion.h"
+#include "threadpool.h"
+#include "trace.h"
+
+#define EROSION_ROWS	32		// Rows of a chunk eroded by one task, so that a band and its border stay in cache through a pass
+#define EROSION_FLOW	0.25f		// Share of the drop to its lower neighbours that a vertex's water moves each iteration
+#define EROSION_MIN_TILT	0.05f		// Sine of the tilt below which the ground counts as this tilted, so that flat ground still erodes a little
+
+const ErosionSettings defaultErosion = { 100, 1.5f, 0.1f, 0.01f, 10.0f, 0.1f, 0.3f, 0.05f };
+
+
+/* One float per vertex, chunk by chunk like the heights, for the water, sediment and flows of an erosion run */
+struct ErosionField {
+	std::vector<std::vector<float> > chunks;	// In the same order as the terrain's chunks, row by row without padding
+
+	void resize (const ChunkGrid &grid) {
+		chunks.resize(grid.count());
+		for (int i = 0; i < grid.count(); i++)
+			chunks[i].assign((size_t) grid.chunk(i).field.width() * grid.chunk(i).field.depth(), 0.0f);
+	}
+
+	float *row (const ChunkGrid &grid, int i, int z) { return &chunks[i][(size_t) z * grid.chunk(i).field.width()]; }
+};
+
+
+/* Buffers of one erosion run, each pass reads some of them and writes others */
+struct ErosionState {
+	ErosionField eroded;			// Heights after the thermal pass
+	ErosionField water, nextWater;
+	ErosionField sediment, nextSediment;
+	ErosionField toLeft, toRight;		// Share of its water each vertex sends towards -x and +x
+	ErosionField toBack, toFront;		// Share of its water each vertex sends towards -z and +z
+	ErosionField capacity;			// Sediment the water leaving each vertex can carry
+};
+
+
+/* Copies count values of row z starting at x from the field, or from the heights if field is null, crossing chunks */
+static void copyFieldRow (const ChunkGrid &grid, const ErosionField *field, int x, int z, int count, float *out) {
+	if (!field) {
+		grid.copyHeights(x, z, count, out);
+		return;
+	}
+	while (count > 0) {
+		int i = (z >> CHUNK_SHIFT) * grid.chunksX() + (x >> CHUNK_SHIFT);
+		const TerrainChunk &c = grid.chunk(i);
+		int run = std::min(count, c.x0 + c.field.width() - x);
+		const float *values = &field->chunks[i][(size_t) (z - c.z0) * c.field.width() + (x - c.x0)];
+		std::copy(values, values + run, out);
+		out += run;
+		x += run;
+		count -= run;
+	}
+}
+
+
+/* Rows firstRow to lastRow - 1 of one chunk read from a field, with a one vertex border from the neighbouring chunks */
+/* Past the terrain's edge the border repeats the edge when clamp is set, so that nothing flows over it, or reads 0 */
+struct ErosionTile {
+	std::vector<float> values;
+	int stride;
+
+	void load (const ChunkGrid &grid, const ErosionField *field, const TerrainChunk &chunk, int firstRow, int lastRow, bool clamp) {
+		int width = chunk.field.width();
+		stride = width + 2;
+		values.resize((size_t) stride * (lastRow - firstRow + 2));
+		int firstX = std::max(chunk.x0 - 1, 0), lastX = std::min(chunk.x0 + width + 1, grid.width());
+		for (int r = -1; r <= lastRow - firstRow; r++) {
+			float *out = &values[(size_t) (r + 1) * stride];
+			int z = chunk.z0 + firstRow + r;
+			if (z < 0 || z >= grid.depth()) {
+				if (!clamp) {
+					std::fill(out, out + stride, 0.0f);
+					continue;
+				}
+				z = std::max(0, std::min(z, grid.depth() - 1));
+			}
+			copyFieldRow(grid, field, firstX, z, lastX - firstX, out + (firstX - (chunk.x0 - 1)));
+			if (chunk.x0 == 0)
+				out[0] = clamp ? out[1] : 0.0f;
+			if (chunk.x0 + width == grid.width())
+				out[stride - 1] = clamp ? out[stride - 2] : 0.0f;
+		}
+	}
+
+	/* Row r of the band, read from -1 to the band's width */
+	const float *row (int r) const { return &values[(size_t) (r + 1) * stride + 1]; }
+};
+
+
+/* Runs pass(chunk, firstRow, lastRow) on every band of EROSION_ROWS rows of every chunk, spread over the worker threads */
+static void forEachBand (Terrain *terrain, const std::function<void (int, int, int)> &pass) {
+	int bandsPerChunk = (CHUNK_SIZE + EROSION_ROWS - 1) / EROSION_ROWS;
+	parallelFor(terrain->chunks.count() * bandsPerChunk, 1, [terrain, bandsPerChunk, &pass](int firstTask, int lastTask) {
+		for (int task = firstTask; task < lastTask; task++) {
+			int i = task / bandsPerChunk;
+			int firstRow = (task % bandsPerChunk) * EROSION_ROWS;
+			int lastRow = std::min(firstRow + EROSION_ROWS, terrain->chunks.chunk(i).field.depth());
+			if (firstRow < lastRow)
+				pass(i, firstRow, lastRow);
+		}
+	});
+}
+
+
+/* Ground a vertex gains from a neighbour this much higher, negative for a lower one, before the rate is applied */
+/* Swapping the two vertices only flips the sign, so whatever one loses the other gains */
+static inline float slip (float difference, float talus) {
+	return std::max(difference - talus, 0.0f) + std::min(difference + talus, 0.0f);
+}
+
+
+/* Thermal erosion of one band: every vertex trades ground with its four neighbours wherever they differ by more than the talus */
+static void slipBand (Terrain *terrain, ErosionState &state, const ErosionSettings &settings, int i, int firstRow, int lastRow) {
+	TRACE_ZONE("erosion thermal");
+	const ChunkGrid &grid = terrain->chunks;
+	int width = grid.chunk(i).field.width();
+	ErosionTile heights;
+	heights.load(grid, 0, grid.chunk(i), firstRow, lastRow, true);
+
+	float talus = settings.talus, rate = settings.thermalRate;
+	for (int r = 0; r < lastRow - firstRow; r++) {
+		const float *back = heights.row(r - 1), *here = heights.row(r), *front = heights.row(r + 1);
+		float *out = state.eroded.row(grid, i, firstRow + r);
+		for (int x = 0; x < width; x++) {
+			float h = here[x];
+			out[x] = h + rate * (slip(here[x - 1] - h, talus) + slip(here[x + 1] - h, talus) + slip(back[x] - h, talus) + slip(front[x] - h, talus));
+		}
+	}
+}
+
+
+/* First half of hydraulic erosion for one band: what share of its water each vertex sends to each of its lower neighbours, */
+/* and how much sediment that water can carry, more the faster it flows and the steeper the ground */
+/* Rain is added to every vertex, so it drops out of the differences between water surfaces */
+static void flowBand (Terrain *terrain, ErosionState &state, const ErosionField *ground, const ErosionSettings &settings, int i, int firstRow, int lastRow) {
+	TRACE_ZONE("erosion flow");
+	const ChunkGrid &grid = terrain->chunks;
+	int width = grid.chunk(i).field.width();
+	ErosionTile heights, water;
+	heights.load(grid, ground, grid.chunk(i), firstRow, lastRow, true);
+	water.load(grid, &state.water, grid.chunk(i), firstRow, lastRow, true);
+
+	for (int r = 0; r < lastRow - firstRow; r++) {
+		const float *heightBack = heights.row(r - 1), *heightHere = heights.row(r), *heightFront = heights.row(r + 1);
+		const float *waterBack = water.row(r - 1), *waterHere = water.row(r), *waterFront = water.row(r + 1);
+		float *left = state.toLeft.row(grid, i, firstRow + r), *right = state.toRight.row(grid, i, firstRow + r);
+		float *back = state.toBack.row(grid, i, firstRow + r), *front = state.toFront.row(grid, i, firstRow + r);
+		float *capacity = state.capacity.row(grid, i, firstRow + r);
+		for (int x = 0; x < width; x++) {
+			float surface = heightHere[x] + waterHere[x];
+			float dropLeft = std::max(surface - heightHere[x - 1] - waterHere[x - 1], 0.0f);
+			float dropRight = std::max(surface - heightHere[x + 1] - waterHere[x + 1], 0.0f);
+			float dropBack = std::max(surface - heightBack[x] - waterBack[x], 0.0f);
+			float dropFront = std::max(surface - heightFront[x] - waterFront[x], 0.0f);
+
+			// The water is shared out in proportion to the drops, and a vertex never sends more than it holds
+			float total = dropLeft + dropRight + dropBack + dropFront;
+			float held = waterHere[x] + settings.rain;
+			float moved = std::min(held, EROSION_FLOW * total);
+			float share = total > 0 ? moved / (total * held) : 0.0f;
+			left[x] = dropLeft * share;
+			right[x] = dropRight * share;
+			back[x] = dropBack * share;
+			front[x] = dropFront * share;
+
+			// The tilt comes from the heights on either side, which a ripple from one vertex to the next does not change,
+			// so the flow cannot dig such ripples deeper
+			float slopeX = (heightHere[x + 1] - heightHere[x - 1]) * (0.5f / VERT_SPACING);
+			float slopeZ = (heightFront[x] - heightBack[x]) * (0.5f / VERT_SPACING);
+			float tilt = sqrtf((slopeX * slopeX + slopeZ * slopeZ) / (1 + slopeX * slopeX + slopeZ * slopeZ));
+
+			// Never more than the ground drops to the lowest neighbour, so dissolving cannot dig a vertex below it
+			float lowest = std::min(std::min(heightHere[x - 1], heightHere[x + 1]), std::min(heightBack[x], heightFront[x]));
+			capacity[x] = std::min(settings.capacity * moved * std::max(tilt, EROSION_MIN_TILT), std::max(heightHere[x] - lowest, 0.0f));
+		}
+	}
+}
+
+
+/* Second half of hydraulic erosion for one band: moves the water and the sediment it carries, dissolves or drops */
+/* ground towards what the flow through each vertex can carry, and lets some water evaporate */
+/* Water leaving a vertex takes the same share of its sediment with it, which is what keeps the flows as shares */
+static void carryBand (Terrain *terrain, ErosionState &state, const ErosionField *ground, const ErosionSettings &settings, int i, int firstRow, int lastRow) {
+	TRACE_ZONE("erosion carry");
+	ChunkGrid &grid = terrain->chunks;
+	TerrainChunk &chunk = grid.chunk(i);
+	int width = chunk.field.width();
+	ErosionTile water, sediment, toLeft, toRight, toBack, toFront;
+	water.load(grid, &state.water, chunk, firstRow, lastRow, true);
+	sediment.load(grid, &state.sediment, chunk, firstRow, lastRow, true);
+	toLeft.load(grid, &state.toLeft, chunk, firstRow, lastRow, false);
+	toRight.load(grid, &state.toRight, chunk, firstRow, lastRow, false);
+	toBack.load(grid, &state.toBack, chunk, firstRow, lastRow, false);
+	toFront.load(grid, &state.toFront, chunk, firstRow, lastRow, false);
+
+	float rain = settings.rain, keep = 1 - settings.evaporation;
+	for (int r = 0; r < lastRow - firstRow; r++) {
+		const float *waterBack = water.row(r - 1), *waterHere = water.row(r), *waterFront = water.row(r + 1);
+		const float *sedimentBack = sediment.row(r - 1), *sedimentHere = sediment.row(r), *sedimentFront = sediment.row(r + 1);
+		const float *left = toLeft.row(r), *right = toRight.row(r), *back = toBack.row(r), *front = toFront.row(r);
+		const float *fromBack = toFront.row(r - 1), *fromFront = toBack.row(r + 1);
+		const float *groundRow = ground ? ground->chunks[i].data() + (size_t) (firstRow + r) * width : chunk.field.heightRow(firstRow + r);
+		float *heightRow = chunk.field.heightRow(firstRow + r);
+		const float *capacity = state.capacity.row(grid, i, firstRow + r);
+		float *nextWater = state.nextWater.row(grid, i, firstRow + r), *nextSediment = state.nextSediment.row(grid, i, firstRow + r);
+		for (int x = 0; x < width; x++) {
+			float kept = 1 - (left[x] + right[x] + back[x] + front[x]);
+			float arriving = (waterHere[x - 1] + rain) * right[x - 1] + (waterHere[x + 1] + rain) * left[x + 1]
+				+ (waterBack[x] + rain) * fromBack[x] + (waterFront[x] + rain) * fromFront[x];
+			float carried = sedimentHere[x] * kept + sedimentHere[x - 1] * right[x - 1] + sedimentHere[x + 1] * left[x + 1]
+				+ sedimentBack[x] * fromBack[x] + sedimentFront[x] * fromFront[x];
+
+			// Dissolve ground while the flow could carry more, drop sediment while it carries too much
+			float spare = capacity[x] - carried;
+			float dissolved = spare * (spare > 0 ? settings.solubility : settings.deposition);
+			heightRow[x] = groundRow[x] - dissolved;
+			nextSediment[x] = carried + dissolved;
+			nextWater[x] = ((waterHere[x] + rain) * kept + arriving) * keep;
+		}
+	}
+}
+
+
+/* Copies the heights left by the thermal pass back into the chunks, when there is no hydraulic pass to do it */
+static void copyBand (Terrain *terrain, ErosionState &state, int i, int firstRow, int lastRow) {
+	TerrainChunk &chunk = terrain->chunks.chunk(i);
+	for (int z = firstRow; z < lastRow; z++) {
+		const float *eroded = state.eroded.row(terrain->chunks, i, z);
+		std::copy(eroded, eroded + chunk.field.width(), chunk.field.heightRow(z));
+	}
+}
+
+
+/* Leaves the sediment the water still carries at the end of the run where it is */
+static void settleBand (Terrain *terrain, ErosionState &state, int i, int firstRow, int lastRow) {
+	TerrainChunk &chunk = terrain->chunks.chunk(i);
+	for (int z = firstRow; z < lastRow; z++) {
+		const float *sediment = state.sediment.row(terrain->chunks, i, z);
+		float *heights = chunk.field.heightRow(z);
+		for (int x = 0; x < chunk.field.width(); x++)
+			heights[x] += sediment[x];
+	}
+}
+
+
+void erodeTerrain (Terrain *terrain, const ErosionSettings &settings, std::vector<double> *iterationMs) {
+	TRACE_ZONE("erosion");
+	bool thermal = settings.thermalRate > 0;
+	bool hydraulic = settings.rain > 0;
+	if (settings.iterations < 1 || (!thermal && !hydraulic))
+		return;
+	if (terrainVerbose)
+		printf("Eroding the terrain (%d iterations)...\n", settings.iterations);
+
+	// Only the buffers the passes in use need to be held
+	ErosionState state;
+	if (thermal)
+		state.eroded.resize(terrain->chunks);
+	if (hydraulic) {
+		ErosionField *fields[] = { &state.water, &state.nextWater, &state.sediment, &state.nextSediment, &state.toLeft, &state.toRight, &state.toBack, &state.toFront, &state.capacity };
+		for (int f = 0; f < 9; f++)
+			fields[f]->resize(terrain->chunks);
+	}
+	const ErosionField *ground = thermal ? &state.eroded : 0;
+
+	double totalMs = 0, longestMs = 0;
+	for (int iteration = 0; iteration < settings.iterations; iteration++) {
+		TRACE_ZONE("erosion iteration");
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (thermal)
+			forEachBand(terrain, [&](int i, int firstRow, int lastRow) { slipBand(terrain, state, settings, i, firstRow, lastRow); });
+		if (hydraulic) {
+			forEachBand(terrain, [&](int i, int firstRow, int lastRow) { flowBand(terrain, state, ground, settings, i, firstRow, lastRow); });
+			forEachBand(terrain, [&](int i, int firstRow, int lastRow) { carryBand(terrain, state, ground, settings, i, firstRow, lastRow); });
+			std::swap(state.water, state.nextWater);
+			std::swap(state.sediment, state.nextSediment);
+		} else {
+			forEachBand(terrain, [&](int i, int firstRow, int lastRow) { copyBand(terrain, state, i, firstRow, lastRow); });
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		totalMs += ms;
+		longestMs = std::max(longestMs, ms);
+		if (iterationMs)
+			iterationMs->push_back(ms);
+	}
+	if (hydraulic)
+		forEachBand(terrain, [&](int i, int firstRow, int lastRow) { settleBand(terrain, state, i, firstRow, lastRow); });
+	if (terrainVerbose)
+		printf("Eroded in %.1f ms, %.2f ms per iteration (longest %.2f ms)\n", totalMs, totalMs / settings.iterations, longestMs);
+
+	// The heights no longer come from the generation settings
+	measureHeights(terrain);
+	terrain->generatedComplexity = -1;
+}
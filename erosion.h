@@ -0,0 +1,37 @@
+/*
+Nolan Slade
+Terrain Generator - thermal and hydraulic erosion
+*/
+
+#ifndef EROSION_H
+#define EROSION_H
+
+#include <vector>
+
+#include "terrain.h"
+
+/* How erodeTerrain wears the terrain down, heights are in the same units as the generators' */
+struct ErosionSettings {
+	int iterations;
+	float talus;				// Height difference between neighbouring vertices the ground holds without slipping
+	float thermalRate;			// Share of the difference beyond the talus that slips each iteration, 0 turns thermal erosion off
+	float rain;				// Water falling on every vertex each iteration, 0 turns hydraulic erosion off
+	float capacity;				// Sediment carried per unit of water flowing through a vertex
+	float solubility;			// Share of the spare capacity dissolved from the ground each iteration
+	float deposition;			// Share of the sediment beyond the capacity dropped each iteration
+	float evaporation;			// Share of the water that evaporates each iteration
+};
+
+extern const ErosionSettings defaultErosion;
+
+/* Runs thermal and then hydraulic erosion over the whole terrain for settings.iterations iterations */
+/* Thermal erosion moves ground from every vertex steeper than the talus to its lower neighbours. Hydraulic */
+/* erosion rains on every vertex, sends the water downhill to its four neighbours, and lets it dissolve ground */
+/* where it can carry more sediment than it does and drop it where it carries too much; what is still carried */
+/* at the end settles where it is. Ground is only moved, never lost, and water does not leave the terrain */
+/* Every pass reads one buffer and writes another, so the heights are the same on any number of threads */
+/* Chunk height ranges and boxes and the terrain's range are brought up to date, the normals are left to setNormals */
+/* If iterationMs is given, the time each iteration took is appended to it */
+void erodeTerrain (Terrain *terrain, const ErosionSettings &settings, std::vector<double> *iterationMs);
+
+#endif
@@ -0,0 +1,52 @@
+/*
+Nolan Slade
+Terrain Generator - frame timing
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+
+#include "frametimer.h"
+
+
+double frameClock () {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void resetFrameTimer (FrameTimer *timer) {
+	timer->samples.clear();
+	timer->next = 0;
+	timer->total = 0;
+}
+
+
+void recordFrame (FrameTimer *timer, double ms) {
+	// Fill the buffer first, then overwrite the oldest sample
+	if ((int) timer->samples.size() < FRAME_HISTORY) {
+		timer->samples.push_back(ms);
+	} else {
+		timer->samples[timer->next] = ms;
+		timer->next = (timer->next + 1) % FRAME_HISTORY;
+	}
+	timer->total++;
+}
+
+
+/* Nearest-rank percentile over a sorted copy of the samples */
+double framePercentile (const FrameTimer *timer, double percentile) {
+	if (timer->samples.empty())
+		return 0;
+	std::vector<double> sorted(timer->samples);
+	std::sort(sorted.begin(), sorted.end());
+	int rank = (int) ceil(percentile / 100 * sorted.size());
+	return sorted[std::min(std::max(rank, 1), (int) sorted.size()) - 1];
+}
+
+
+void printFrameTimer (const FrameTimer *timer, const char *label) {
+	printf("%s: %lld frames, last %d: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms\n", label, timer->total, (int) timer->samples.size(),
+		framePercentile(timer, 50), framePercentile(timer, 95), framePercentile(timer, 99), framePercentile(timer, 100));
+}
@@ -0,0 +1,32 @@
+/*
+Nolan Slade
+Terrain Generator - frame timing
+*/
+
+#ifndef FRAMETIMER_H
+#define FRAMETIMER_H
+
+#include <vector>
+
+#define FRAME_HISTORY	512		// Number of recent frames the percentiles are taken over
+
+/* Rolling record of how long recent frames took, in milliseconds of CPU (submission) time */
+struct FrameTimer {
+	std::vector<double> samples;		// Ring buffer of at most FRAME_HISTORY samples
+	int next;				// Slot the next sample goes into once the buffer is full
+	long long total;			// Samples recorded since the last reset
+};
+
+/* Returns the current time in milliseconds, for timing a section of a frame */
+double frameClock ();
+
+void resetFrameTimer (FrameTimer *timer);
+void recordFrame (FrameTimer *timer, double ms);
+
+/* Returns the given percentile (0 to 100) of the recorded samples, 0 when there are none */
+double framePercentile (const FrameTimer *timer, double percentile);
+
+/* Prints the frame count, p50, p95, p99 and max on one line after the given label */
+void printFrameTimer (const FrameTimer *timer, const char *label);
+
+#endif
@@ -0,0 +1,107 @@
+/*
+Nolan Slade
+Terrain Generator
+*/
+
+#include <string.h>
+#include <vector>
+
+#include "heightfield.h"
+
+#define ALIGN_FLOATS	(HEIGHTFIELD_ALIGN / sizeof(float))
+
+
+/* Rounds a number of floats up to a whole number of alignment blocks */
+static size_t alignFloats (size_t floats) {
+	return (floats + ALIGN_FLOATS - 1) / ALIGN_FLOATS * ALIGN_FLOATS;
+}
+
+
+Heightfield::Heightfield () : allocation(0), data(0), capacity(0), planeSize(0), fieldWidth(0), fieldDepth(0),
+	rowStride(0), tilesX(0), currentLayout(LAYOUT_ROWS) {
+}
+
+
+Heightfield::~Heightfield () {
+	release();
+}
+
+
+/* Floats needed for one plane of the current size in the given layout */
+size_t Heightfield::planeFloats (HeightfieldLayout layout) const {
+	if (layout == LAYOUT_ROWS)
+		return alignFloats((size_t) rowStride * fieldDepth);
+	size_t tilesZ = (fieldDepth + HEIGHTFIELD_TILE - 1) / HEIGHTFIELD_TILE;
+	return alignFloats((size_t) tilesX * tilesZ * HEIGHTFIELD_TILE * HEIGHTFIELD_TILE);
+}
+
+
+void Heightfield::resize (int width, int depth) {
+	fieldWidth = width;
+	fieldDepth = depth;
+	rowStride = (int) alignFloats(width);
+	tilesX = (width + HEIGHTFIELD_TILE - 1) / HEIGHTFIELD_TILE;
+	planeSize = planeFloats(currentLayout);
+
+	// Only grow the allocation, so shrinking and regrowing does not churn memory
+	size_t needed = HEIGHTFIELD_PLANES * planeSize;
+	if (needed > capacity) {
+		delete [] allocation;
+		allocation = new char [needed * sizeof(float) + HEIGHTFIELD_ALIGN];
+		size_t misalignment = (size_t) allocation % HEIGHTFIELD_ALIGN;
+		data = (float *) (allocation + (misalignment ? HEIGHTFIELD_ALIGN - misalignment : 0));
+		capacity = needed;
+	}
+}
+
+
+void Heightfield::release () {
+	delete [] allocation;
+	allocation = 0;
+	data = 0;
+	capacity = planeSize = 0;
+	fieldWidth = fieldDepth = rowStride = tilesX = 0;
+}
+
+
+void Heightfield::attach (float *memory, int width, int depth) {
+	release();
+	currentLayout = LAYOUT_ROWS;
+	fieldWidth = width;
+	fieldDepth = depth;
+	rowStride = (int) alignFloats(width);
+	tilesX = (width + HEIGHTFIELD_TILE - 1) / HEIGHTFIELD_TILE;
+	planeSize = planeFloats(LAYOUT_ROWS);
+	data = memory;
+	capacity = HEIGHTFIELD_PLANES * planeSize;
+}
+
+
+size_t Heightfield::blockBytes (int width, int depth) {
+	return HEIGHTFIELD_PLANES * alignFloats(alignFloats(width) * (size_t) depth) * sizeof(float);
+}
+
+
+void Heightfield::setLayout (HeightfieldLayout layout) {
+	if (layout == currentLayout)
+		return;
+	if (!data) {
+		currentLayout = layout;
+		return;
+	}
+
+	// Copy everything out in vertex order, then write it back in the new order
+	size_t vertices = (size_t) fieldWidth * fieldDepth;
+	std::vector<float> copy(HEIGHTFIELD_PLANES * vertices);
+	for (int p = 0; p < HEIGHTFIELD_PLANES; p++)
+		for (int z = 0; z < fieldDepth; z++)
+			for (int x = 0; x < fieldWidth; x++)
+				copy[p * vertices + (size_t) z * fieldWidth + x] = plane(p)[index(x, z)];
+
+	currentLayout = layout;
+	resize(fieldWidth, fieldDepth);
+	for (int p = 0; p < HEIGHTFIELD_PLANES; p++)
+		for (int z = 0; z < fieldDepth; z++)
+			for (int x = 0; x < fieldWidth; x++)
+				plane(p)[index(x, z)] = copy[p * vertices + (size_t) z * fieldWidth + x];
+}
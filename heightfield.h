@@ -0,0 +1,105 @@
+/*
+Nolan Slade
+Terrain Generator
+*/
+
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <stddef.h>
+#include <assert.h>
+#include <vector>
+
+#define HEIGHTFIELD_ALIGN	64		// Byte alignment of every plane and (in row layout) every row
+#define HEIGHTFIELD_TILE	8		// Side of the square tiles used by the tiled layout
+#define HEIGHTFIELD_PLANES	7		// Heights, triangle normals x/y/z, quad normals x/y/z
+
+/* Order of the vertices within each plane */
+enum HeightfieldLayout {
+	LAYOUT_ROWS,				// Row by row: x is contiguous, each row starts on a HEIGHTFIELD_ALIGN boundary
+	LAYOUT_TILED				// HEIGHTFIELD_TILE x HEIGHTFIELD_TILE tiles, for kernels that read a neighbourhood
+};
+
+/* Heights and vertex normals of a grid of vertices, owned as structure-of-arrays planes */
+/* All seven planes (heights, then x/y/z of the triangle-strip and quad-strip normals) share one aligned allocation */
+class Heightfield {
+public:
+	Heightfield ();
+	~Heightfield ();
+
+	/* Sets the number of vertices, reusing the allocation when it is big enough; contents are undefined afterwards */
+	void resize (int width, int depth);
+
+	/* Frees the allocation, leaving an empty 0 x 0 field */
+	void release ();
+
+	/* Reorders every plane into the given layout, keeping the contents */
+	void setLayout (HeightfieldLayout layout);
+
+	/* Uses memory the field does not own as its planes, in the row layout, e.g. a tile of a mapped file */
+	/* The memory must be blockBytes(width, depth) long, HEIGHTFIELD_ALIGN aligned and outlive the field */
+	void attach (float *memory, int width, int depth);
+
+	/* All seven planes as one block, the form tiles are stored in on disk (row layout only) */
+	float *block () { assert(currentLayout == LAYOUT_ROWS); return data; }
+	const float *block () const { assert(currentLayout == LAYOUT_ROWS); return data; }
+	size_t blockBytes () const { return HEIGHTFIELD_PLANES * planeSize * sizeof(float); }
+	static size_t blockBytes (int width, int depth);
+
+	HeightfieldLayout layout () const { return currentLayout; }
+	int width () const { return fieldWidth; }
+	int depth () const { return fieldDepth; }
+	int stride () const { assert(currentLayout == LAYOUT_ROWS); return rowStride; }	// Distance between rows in the row layout
+	size_t bytes () const { return capacity * sizeof(float); }
+
+	/* Position of vertex (x, z) within each plane */
+	int index (int x, int z) const {
+		if (currentLayout == LAYOUT_ROWS)
+			return z * rowStride + x;
+		return ((z / HEIGHTFIELD_TILE) * tilesX + x / HEIGHTFIELD_TILE) * HEIGHTFIELD_TILE * HEIGHTFIELD_TILE
+			+ (z % HEIGHTFIELD_TILE) * HEIGHTFIELD_TILE + x % HEIGHTFIELD_TILE;
+	}
+
+	float *heights () { return plane(0); }
+	const float *heights () const { return plane(0); }
+	float *triangleNormals (int axis) { return plane(1 + axis); }		// axis 0, 1, 2 for x, y, z
+	const float *triangleNormals (int axis) const { return plane(1 + axis); }
+	float *quadNormals (int axis) { return plane(4 + axis); }
+	const float *quadNormals (int axis) const { return plane(4 + axis); }
+
+	/* Start of row z of the heights, only valid in the row layout (asserted, as every pass reads whole rows) */
+	float *heightRow (int z) { assert(currentLayout == LAYOUT_ROWS); return plane(0) + (size_t) z * rowStride; }
+	const float *heightRow (int z) const { assert(currentLayout == LAYOUT_ROWS); return plane(0) + (size_t) z * rowStride; }
+
+private:
+	Heightfield (const Heightfield &) = delete;
+	Heightfield &operator= (const Heightfield &) = delete;
+
+	float *plane (int p) const { return data + p * planeSize; }
+	size_t planeFloats (HeightfieldLayout layout) const;
+
+	char *allocation;			// What new [] returned, null when empty or attached
+	float *data;				// First HEIGHTFIELD_ALIGN boundary within the allocation
+	size_t capacity;			// Floats available from data onwards
+	size_t planeSize;			// Floats per plane, a multiple of the alignment
+	int fieldWidth;
+	int fieldDepth;
+	int rowStride;				// Width rounded up to the alignment
+	int tilesX;				// Tiles across the width in the tiled layout
+	HeightfieldLayout currentLayout;
+};
+
+/* Heights and both sets of vertex normals of a grid of vertices packed into 6 bytes per vertex, row by row with no padding */
+/* Heights are 16-bit steps over a range kept by the owner, normals are hemi-octahedral with 8 bits per axis (see compact.h) */
+/* The same bytes are what the renderer uploads for a compact terrain */
+struct CompactHeightfield {
+	std::vector<unsigned short> heights;
+	std::vector<unsigned char> normals;	// Triangle-strip u, v then quad-strip u, v of each vertex
+	int width;
+	int depth;
+
+	CompactHeightfield () : width(0), depth(0) {}
+	size_t bytes () const { return heights.capacity() * sizeof(unsigned short) + normals.capacity(); }
+};
+
+#endif
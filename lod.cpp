@@ -0,0 +1,499 @@
+/*
+Nolan Slade
+Terrain Generator - continuous level of detail
+*/
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef __APPLE__
+#  include <OpenGL/gl.h>
+#else
+#  include <GL/gl.h>
+#endif
+
+#include "lod.h"
+#include "threadpool.h"
+
+
+/* Position along one axis of mesh vertex i of a node starting at origin, the last vertex is clamped to the terrain */
+static inline int meshCoordinate (int size, int origin, int step, int i) {
+	return std::min(origin + i * step, size - 1);
+}
+
+
+/* Number of mesh cells along one axis of a node starting at origin */
+static inline int meshCells (int size, int origin, int step) {
+	return std::min(LOD_GRID, (size - 1 - origin + step - 1) / step);
+}
+
+
+/* Bilinear height of the terrain between vertices */
+static float sampleHeight (const Terrain *terrain, float x, float z) {
+	int x0 = (int) x, z0 = (int) z;
+	int x1 = std::min(x0 + 1, terrain->width - 1), z1 = std::min(z0 + 1, terrain->depth - 1);
+	float tx = x - x0, tz = z - z0;
+	const ChunkGrid &grid = terrain->chunks;
+	float near = grid.height(x0, z0) + (grid.height(x1, z0) - grid.height(x0, z0)) * tx;
+	float far = grid.height(x0, z1) + (grid.height(x1, z1) - grid.height(x0, z1)) * tx;
+	return near + (far - near) * tz;
+}
+
+
+/* Bilinear vertex normal of the terrain between vertices, renormalized */
+static void sampleNormal (const Terrain *terrain, bool triangles, float x, float z, float *normal) {
+	int x0 = (int) x, z0 = (int) z;
+	int xs[] = { x0, std::min(x0 + 1, terrain->width - 1) };
+	int zs[] = { z0, std::min(z0 + 1, terrain->depth - 1) };
+	float tx = x - x0, tz = z - z0;
+	float weights[] = { (1 - tx) * (1 - tz), tx * (1 - tz), (1 - tx) * tz, tx * tz };
+
+	normal[0] = normal[1] = normal[2] = 0;
+	for (int corner = 0; corner < 4; corner++) {
+		if (weights[corner] == 0)
+			continue;
+		const TerrainChunk &chunk = terrain->chunks.chunkAt(xs[corner & 1], zs[corner >> 1]);
+		const Heightfield &field = chunk.field;
+		int index = field.index(xs[corner & 1] - chunk.x0, zs[corner >> 1] - chunk.z0);
+		for (int axis = 0; axis < 3; axis++)
+			normal[axis] += weights[corner] * (triangles ? field.triangleNormals(axis) : field.quadNormals(axis))[index];
+	}
+	float inverse = 1.0f / sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+	normal[0] *= inverse; normal[1] *= inverse; normal[2] *= inverse;
+}
+
+
+/* Height range of finest node n, which draws every vertex and so has no error */
+static void measureFinestNode (LodLevel &level, const Terrain *terrain, int n) {
+	int x0 = (n % level.nodesX) * LOD_GRID, z0 = (n / level.nodesX) * LOD_GRID;
+	int x1 = std::min(x0 + LOD_GRID, terrain->width - 1), z1 = std::min(z0 + LOD_GRID, terrain->depth - 1);
+	LodNode &node = level.nodes[n];
+	node.minHeight = node.maxHeight = terrain->chunks.height(x0, z0);
+	for (int z = z0; z <= z1; z++) {
+		for (int x = x0; x <= x1; x++) {
+			float height = terrain->chunks.height(x, z);
+			node.minHeight = std::min(node.minHeight, height);
+			node.maxHeight = std::max(node.maxHeight, height);
+		}
+	}
+	node.error = 0;
+}
+
+
+/* Height range and error of node n of a coarser level from the level below it */
+/* The error is the larger of the children's error and how far the children's mesh vertices are from this level's mesh, */
+/* so only the vertices of the level below are visited rather than every vertex of the terrain */
+static void measureCoarserNode (LodLevel &level, const LodLevel &finer, const Terrain *terrain, int n) {
+	int nx = n % level.nodesX, nz = n / level.nodesX;
+	LodNode &node = level.nodes[n];
+	node.minHeight = FLT_MAX;
+	node.maxHeight = -FLT_MAX;
+	float childError = 0;
+	for (int c = 0; c < 4; c++) {
+		int cx = 2 * nx + (c & 1), cz = 2 * nz + (c >> 1);
+		if (cx >= finer.nodesX || cz >= finer.nodesZ)
+			continue;
+		const LodNode &child = finer.nodes[cz * finer.nodesX + cx];
+		node.minHeight = std::min(node.minHeight, child.minHeight);
+		node.maxHeight = std::max(node.maxHeight, child.maxHeight);
+		childError = std::max(childError, child.error);
+	}
+
+	// Compare every vertex of the finer mesh with the bilinear surface of this mesh
+	int x0 = nx * LOD_GRID * level.step, z0 = nz * LOD_GRID * level.step;
+	int columns = meshCells(terrain->width, x0, level.step), rows = meshCells(terrain->depth, z0, level.step);
+	int half = finer.step;
+	float deviation = 0;
+	for (int b = 0; b <= 2 * rows; b++) {
+		int z = meshCoordinate(terrain->depth, z0, half, b);
+		int za = meshCoordinate(terrain->depth, z0, level.step, b / 2), zb = meshCoordinate(terrain->depth, z0, level.step, std::min(b / 2 + 1, rows));
+		float tz = zb > za ? (float) (z - za) / (zb - za) : 0;
+		for (int a = 0; a <= 2 * columns; a++) {
+			if (a % 2 == 0 && b % 2 == 0)
+				continue;
+			int x = meshCoordinate(terrain->width, x0, half, a);
+			int xa = meshCoordinate(terrain->width, x0, level.step, a / 2), xb = meshCoordinate(terrain->width, x0, level.step, std::min(a / 2 + 1, columns));
+			float tx = xb > xa ? (float) (x - xa) / (xb - xa) : 0;
+
+			const ChunkGrid &grid = terrain->chunks;
+			float near = grid.height(xa, za) + (grid.height(xb, za) - grid.height(xa, za)) * tx;
+			float far = grid.height(xa, zb) + (grid.height(xb, zb) - grid.height(xa, zb)) * tx;
+			deviation = std::max(deviation, fabsf(grid.height(x, z) - (near + (far - near) * tz)));
+		}
+	}
+	node.error = std::max(childError, deviation);
+}
+
+
+/* Height range and error of the finest nodes */
+static void buildFinestLevel (LodLevel &level, const Terrain *terrain) {
+	parallelFor(level.nodesX * level.nodesZ, 1, [&level, terrain](int first, int last) {
+		for (int n = first; n < last; n++)
+			measureFinestNode(level, terrain, n);
+	});
+}
+
+
+/* Height range and error of a coarser level from the level below it */
+static void buildCoarserLevel (LodLevel &level, const LodLevel &finer, const Terrain *terrain) {
+	parallelFor(level.nodesX * level.nodesZ, 1, [&level, &finer, terrain](int first, int last) {
+		for (int n = first; n < last; n++)
+			measureCoarserNode(level, finer, terrain, n);
+	});
+}
+
+
+/* Largest error of any node of a level */
+static void setMaxError (LodLevel &level) {
+	level.maxError = 0;
+	for (size_t n = 0; n < level.nodes.size(); n++)
+		level.maxError = std::max(level.maxError, level.nodes[n].error);
+}
+
+
+/* Rebuilds the quadtree after the heights change */
+static void buildTree (TerrainLod *lod, const Terrain *terrain) {
+	lod->levels.clear();
+	for (int step = 1; ; step *= 2) {
+		LodLevel level;
+		int span = LOD_GRID * step;
+		level.step = step;
+		level.nodesX = std::max(1, (terrain->width - 1 + span - 1) / span);
+		level.nodesZ = std::max(1, (terrain->depth - 1 + span - 1) / span);
+		level.nodes.resize(level.nodesX * level.nodesZ);
+		lod->levels.push_back(level);
+
+		LodLevel &added = lod->levels.back();
+		if (step == 1)
+			buildFinestLevel(added, terrain);
+		else
+			buildCoarserLevel(added, lod->levels[lod->levels.size() - 2], terrain);
+
+		setMaxError(added);
+		if (added.nodesX == 1 && added.nodesZ == 1)
+			break;
+	}
+	lod->heightsChanged = false;
+	lod->meshValid = false;
+}
+
+
+/* Sets the distance band of every level from the screen-space error of the level above it */
+/* pixelsPerUnit converts a height error at distance 1 into pixels; each band is at least twice the one */
+/* below it and two node diagonals wide, so neighbouring patches never differ by more than one level */
+static void setRanges (TerrainLod *lod, float pixelsPerUnit) {
+	int top = (int) lod->levels.size() - 1;
+	float previous = 0;
+	for (int l = 0; l <= top; l++) {
+		LodLevel &level = lod->levels[l];
+		if (l == top) {
+			level.range = FLT_MAX;
+			level.morphStart = FLT_MAX;
+			break;
+		}
+		float diagonal = LOD_GRID * level.step * VERT_SPACING * 1.4143f;
+		float wanted = lod->levels[l + 1].maxError * pixelsPerUnit / lod->pixelError;
+		level.range = std::max(wanted, std::max(2 * previous, 2 * diagonal));
+		level.morphStart = previous + (level.range - previous) * LOD_MORPH_START;
+		previous = level.range;
+	}
+}
+
+
+/* Box around the mesh of a node */
+static BoundingBox nodeBox (const Terrain *terrain, const LodLevel &level, int nx, int nz) {
+	int x0 = nx * LOD_GRID * level.step, z0 = nz * LOD_GRID * level.step;
+	const LodNode &node = level.nodes[nz * level.nodesX + nx];
+	BoundingBox box = { { (float) (x0 * VERT_SPACING), node.minHeight, (float) (z0 * VERT_SPACING) },
+		{ (float) (meshCoordinate(terrain->width, x0, level.step, LOD_GRID) * VERT_SPACING), node.maxHeight,
+		(float) (meshCoordinate(terrain->depth, z0, level.step, LOD_GRID) * VERT_SPACING) } };
+	return box;
+}
+
+
+/* True if a sphere overlaps the box of a node */
+static bool sphereTouchesNode (const float *centre, float radius, const Terrain *terrain, const LodLevel &level, int nx, int nz) {
+	BoundingBox box = nodeBox(terrain, level, nx, nz);
+	float distanceSquared = 0;
+	for (int axis = 0; axis < 3; axis++) {
+		float d = std::max(box.low[axis] - centre[axis], std::max(0.0f, centre[axis] - box.high[axis]));
+		distanceSquared += d * d;
+	}
+	return radius == FLT_MAX || distanceSquared <= radius * radius;
+}
+
+
+/* Selects the patches to draw under one node; returns false if the node is beyond its level's band */
+/* and should be drawn by its parent instead. Nodes outside the view frustum select nothing */
+static bool selectNode (TerrainLod *lod, const Terrain *terrain, const float *camera, const Frustum &frustum, int l, int nx, int nz) {
+	const LodLevel &level = lod->levels[l];
+	if (!sphereTouchesNode(camera, level.range, terrain, level, nx, nz))
+		return false;
+	if (frustumTestBox(frustum, nodeBox(terrain, level, nx, nz)) == FRUSTUM_OUTSIDE)
+		return true;
+
+	int x0 = nx * LOD_GRID * level.step, z0 = nz * LOD_GRID * level.step;
+	int columns = meshCells(terrain->width, x0, level.step), rows = meshCells(terrain->depth, z0, level.step);
+	LodPatch patch = { l, nx, nz, 0, columns, 0, rows };
+
+	// Nodes that are entirely too far for the finer level are drawn whole
+	bool refine = false;
+	if (l > 0) {
+		const LodLevel &finer = lod->levels[l - 1];
+		for (int q = 0; q < 4; q++) {
+			int cx = 2 * nx + (q & 1), cz = 2 * nz + (q >> 1);
+			if (cx < finer.nodesX && cz < finer.nodesZ && sphereTouchesNode(camera, finer.range, terrain, finer, cx, cz))
+				refine = true;
+		}
+	}
+	if (!refine) {
+		lod->patches.push_back(patch);
+		return true;
+	}
+
+	// Otherwise each quadrant is either refined or drawn at this level
+	int half = LOD_GRID / 2;
+	for (int q = 0; q < 4; q++) {
+		int firstI = (q & 1) * half, firstJ = (q >> 1) * half;
+		if (firstI >= columns || firstJ >= rows)
+			continue;
+		if (!selectNode(lod, terrain, camera, frustum, l - 1, 2 * nx + (q & 1), 2 * nz + (q >> 1))) {
+			LodPatch quadrant = { l, nx, nz, firstI, std::min(firstI + half, columns), firstJ, std::min(firstJ + half, rows) };
+			lod->patches.push_back(quadrant);
+		}
+	}
+	return true;
+}
+
+
+/* Builds the vertices, colours and indices of the selected patches, morphing each vertex by its distance */
+static void buildMesh (TerrainLod *lod, const Terrain *terrain, const TerrainStyle &style, const float *camera) {
+	int patchCount = (int) lod->patches.size();
+	std::vector<size_t> firstVertex(patchCount + 1), firstIndex(patchCount + 1), firstSkirt(patchCount + 1);
+	int indicesPerCell = style.stripMode == 't' ? 6 : 4;
+	for (int p = 0; p < patchCount; p++) {
+		const LodPatch &patch = lod->patches[p];
+		int columns = patch.lastI - patch.firstI, rows = patch.lastJ - patch.firstJ;
+		int edge = 2 * (columns + rows);
+		firstVertex[p + 1] = firstVertex[p] + (size_t) (columns + 1) * (rows + 1) + edge + 1;
+		firstIndex[p + 1] = firstIndex[p] + (size_t) columns * rows * indicesPerCell;
+		firstSkirt[p + 1] = firstSkirt[p] + (size_t) edge * 6;
+	}
+	lod->positions.resize(3 * firstVertex[patchCount]);
+	lod->normals.resize(3 * firstVertex[patchCount]);
+	lod->colours.resize(3 * firstVertex[patchCount]);
+	lod->indices.resize(firstIndex[patchCount]);
+	lod->skirtIndices.resize(firstSkirt[patchCount]);
+	lod->vertexCount = (int) firstVertex[patchCount];
+
+	parallelFor(patchCount, 16, [&](int first, int last) {
+		std::vector<float> heights;
+		for (int p = first; p < last; p++) {
+			const LodPatch &patch = lod->patches[p];
+			const LodLevel &level = lod->levels[patch.level];
+			bool top = patch.level == (int) lod->levels.size() - 1;
+			int x0 = patch.nodeX * LOD_GRID * level.step, z0 = patch.nodeZ * LOD_GRID * level.step;
+			int columns = patch.lastI - patch.firstI, rows = patch.lastJ - patch.firstJ;
+			size_t base = firstVertex[p];
+			float *position = &lod->positions[3 * base];
+			float *normal = &lod->normals[3 * base];
+
+			for (int j = patch.firstJ; j <= patch.lastJ; j++) {
+				int z = meshCoordinate(terrain->depth, z0, level.step, j);
+				for (int i = patch.firstI; i <= patch.lastI; i++) {
+					int x = meshCoordinate(terrain->width, x0, level.step, i);
+					float height = terrain->chunks.height(x, z);
+
+					// Odd vertices slide onto their even neighbour as the distance nears the end of the band,
+					// where they coincide with the coarser level's mesh
+					float dx = x * VERT_SPACING - camera[0], dy = height - camera[1], dz = z * VERT_SPACING - camera[2];
+					float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+					float morph = top ? 0 : std::min(std::max((distance - level.morphStart) / (level.range - level.morphStart), 0.0f), 1.0f);
+					float fx = x, fz = z;
+					if (i % 2 == 1)
+						fx += (meshCoordinate(terrain->width, x0, level.step, i - 1) - x) * morph;
+					if (j % 2 == 1)
+						fz += (meshCoordinate(terrain->depth, z0, level.step, j - 1) - z) * morph;
+
+					position[0] = fx * VERT_SPACING;
+					position[1] = morph > 0 ? sampleHeight(terrain, fx, fz) : height;
+					position[2] = fz * VERT_SPACING;
+					sampleNormal(terrain, style.stripMode == 't', fx, fz, normal);
+					position += 3;
+					normal += 3;
+				}
+			}
+
+			// Cells, in the same triangulation and winding as the strips
+			unsigned int *index = &lod->indices[firstIndex[p]];
+			for (int j = 0; j < rows; j++) {
+				for (int i = 0; i < columns; i++) {
+					unsigned int v00 = base + j * (columns + 1) + i, v10 = v00 + 1;
+					unsigned int v01 = v00 + columns + 1, v11 = v01 + 1;
+					if (style.stripMode == 't') {
+						index[0] = v00; index[1] = v01; index[2] = v10;
+						index[3] = v10; index[4] = v01; index[5] = v11;
+						index += 6;
+					} else {
+						index[0] = v00; index[1] = v01; index[2] = v11; index[3] = v10;
+						index += 4;
+					}
+				}
+			}
+
+			// Skirts: walk the patch border once, hanging a copy of each border vertex below it
+			std::vector<unsigned int> border;
+			for (int i = 0; i <= columns; i++) border.push_back(base + i);
+			for (int j = 1; j <= rows; j++) border.push_back(base + j * (columns + 1) + columns);
+			for (int i = columns - 1; i >= 0; i--) border.push_back(base + rows * (columns + 1) + i);
+			for (int j = rows - 1; j >= 0; j--) border.push_back(base + j * (columns + 1));
+
+			float drop = lod->levels[std::min(patch.level + 1, (int) lod->levels.size() - 1)].maxError + VERT_SPACING;
+			size_t hanging = base + (size_t) (columns + 1) * (rows + 1);
+			unsigned int *skirt = &lod->skirtIndices[firstSkirt[p]];
+			for (size_t b = 0; b < border.size(); b++) {
+				for (int axis = 0; axis < 3; axis++) {
+					lod->positions[3 * (hanging + b) + axis] = lod->positions[3 * border[b] + axis];
+					lod->normals[3 * (hanging + b) + axis] = lod->normals[3 * border[b] + axis];
+				}
+				lod->positions[3 * (hanging + b) + 1] -= drop;
+				if (b + 1 < border.size()) {
+					unsigned int top0 = border[b], top1 = border[b + 1], bottom0 = hanging + b, bottom1 = hanging + b + 1;
+					skirt[0] = top0; skirt[1] = bottom0; skirt[2] = top1;
+					skirt[3] = top1; skirt[4] = bottom0; skirt[5] = bottom1;
+					skirt += 6;
+				}
+			}
+			// Colours follow the morphed heights
+			size_t count = firstVertex[p + 1] - base;
+			heights.resize(count);
+			for (size_t v = 0; v < count; v++)
+				heights[v] = lod->positions[3 * (base + v) + 1];
+			if (style.topographic)
+				heightColours(terrain, &heights[0], (int) count, 0, &lod->colours[3 * base]);
+			else
+				heightColours(terrain, &heights[0], (int) count, &lod->colours[3 * base], 0);
+		}
+	});
+}
+
+
+/* Starts an empty quadtree, built on the first draw */
+void initTerrainLod (TerrainLod *lod) {
+	lod->heightsChanged = true;
+	lod->pixelError = LOD_PIXEL_ERROR;
+	lod->meshValid = false;
+	lod->vertexCount = 0;
+}
+
+
+/* Call after the heights or normals of the terrain change */
+void markTerrainLodDirty (TerrainLod *lod) {
+	lod->heightsChanged = true;
+}
+
+
+/* Call after the heights and normals inside a rectangle change, e.g. by sculptTerrain */
+/* Only the nodes over the rectangle and those above them are measured again, and the mesh is selected again on the next draw */
+/* An empty rectangle just has the mesh selected again, e.g. for new colours */
+void markTerrainLodRect (TerrainLod *lod, const Terrain *terrain, const TerrainRect &rect) {
+	lod->meshValid = false;
+	if (lod->heightsChanged || rect.firstX >= rect.lastX || rect.firstZ >= rect.lastZ)
+		return;
+
+	// A node's mesh also takes the first row and column of the next nodes, so the nodes before the rectangle are measured too
+	for (size_t l = 0; l < lod->levels.size(); l++) {
+		LodLevel &level = lod->levels[l];
+		int span = LOD_GRID * level.step;
+		int firstNX = std::max(rect.firstX - 1, 0) / span, lastNX = std::min((rect.lastX - 1) / span + 1, level.nodesX);
+		int firstNZ = std::max(rect.firstZ - 1, 0) / span, lastNZ = std::min((rect.lastZ - 1) / span + 1, level.nodesZ);
+		for (int nz = firstNZ; nz < lastNZ; nz++) {
+			for (int nx = firstNX; nx < lastNX; nx++) {
+				if (l == 0)
+					measureFinestNode(level, terrain, nz * level.nodesX + nx);
+				else
+					measureCoarserNode(level, lod->levels[l - 1], terrain, nz * level.nodesX + nx);
+			}
+		}
+		setMaxError(level);
+	}
+}
+
+
+/* Draws the terrain at the detail the current camera needs, under the current modelview and projection */
+/* wireMode is 'w' for the wireframe pass and anything else for the filled pass */
+void drawTerrainLod (TerrainLod *lod, const Terrain *terrain, const TerrainStyle &style, char wireMode) {
+	if (terrain->width < 2 || terrain->depth < 2)
+		return;
+	if (lod->heightsChanged)
+		buildTree(lod, terrain);
+
+	// The camera in terrain coordinates, from the inverse of the (rigid) modelview matrix
+	float modelview[16], projection[16];
+	int viewport[4];
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	float camera[3];
+	for (int axis = 0; axis < 3; axis++)
+		camera[axis] = -(modelview[4 * axis] * modelview[12] + modelview[4 * axis + 1] * modelview[13] + modelview[4 * axis + 2] * modelview[14]);
+	float pixelsPerUnit = viewport[3] / 2.0f * projection[5];
+
+	// Reselect only when something the selection or the vertices depend on has changed
+	if (!lod->meshValid || memcmp(modelview, lod->builtModelview, sizeof(modelview)) != 0
+		|| pixelsPerUnit / lod->pixelError != lod->builtScale || style.stripMode != lod->builtStrip || style.topographic != lod->builtTopographic) {
+		Frustum frustum;
+		frustumFromMatrices(projection, modelview, &frustum);
+		setRanges(lod, pixelsPerUnit);
+		lod->patches.clear();
+		selectNode(lod, terrain, camera, frustum, (int) lod->levels.size() - 1, 0, 0);
+		buildMesh(lod, terrain, style, camera);
+		memcpy(lod->builtModelview, modelview, sizeof(modelview));
+		lod->builtScale = pixelsPerUnit / lod->pixelError;
+		lod->builtStrip = style.stripMode;
+		lod->builtTopographic = style.topographic;
+		lod->meshValid = true;
+	}
+	if (lod->indices.empty())
+		return;
+
+	// Determine the polygon mode based on our global wiremode setting
+	if (wireMode == 'w')
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);	// Wire frame
+	else
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);	// Normal (filled)
+
+	// The wireframe drawn over the filled terrain is a single colour, everything else is coloured per vertex
+	bool overlay = style.wireFrameMode == 'b' && wireMode == 'w';
+	if (overlay) {
+		if (style.topographic)
+			glColor3f(0,0,0);
+		else
+			glColor3f(1,0,0);
+	} else {
+		glEnableClientState(GL_COLOR_ARRAY);
+		glColorPointer(3, GL_FLOAT, 0, &lod->colours[0]);
+	}
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, &lod->positions[0]);
+	glNormalPointer(GL_FLOAT, 0, &lod->normals[0]);
+
+	glDrawElements(style.stripMode == 't' ? GL_TRIANGLES : GL_QUADS, (int) lod->indices.size(), GL_UNSIGNED_INT, &lod->indices[0]);
+
+	// Skirts face every way, so they are drawn without culling and left out of the wireframe
+	if (wireMode != 'w') {
+		bool culling = glIsEnabled(GL_CULL_FACE);
+		glDisable(GL_CULL_FACE);
+		glDrawElements(GL_TRIANGLES, (int) lod->skirtIndices.size(), GL_UNSIGNED_INT, &lod->skirtIndices[0]);
+		if (culling)
+			glEnable(GL_CULL_FACE);
+	}
+
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
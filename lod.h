@@ -0,0 +1,69 @@
+/*
+Nolan Slade
+Terrain Generator - continuous level of detail
+*/
+
+#ifndef LOD_H
+#define LOD_H
+
+#include <vector>
+
+#include "terrain.h"
+#include "renderer.h"
+
+#define LOD_GRID		32		// Cells along each side of a node's mesh at every level, must be even
+#define LOD_MORPH_START		0.7f		// Fraction of a level's distance band after which vertices morph towards the next level
+#define LOD_PIXEL_ERROR		8.0f		// Default screen-space error allowed, in pixels; measured against the largest error of each level,
+						// so most nodes are well under it
+
+/* One node of the quadtree, covering LOD_GRID x LOD_GRID cells of its level's step */
+struct LodNode {
+	float minHeight, maxHeight;		// Height range of every vertex under the node
+	float error;				// Estimated largest height difference between the node's mesh and the full terrain
+};
+
+/* All nodes of one level, in rows; level L draws every 2^L-th vertex */
+struct LodLevel {
+	int step;				// Vertices between mesh vertices, 2^L
+	int nodesX, nodesZ;
+	float maxError;				// Largest error of any node of the level
+	float range;				// Furthest distance from the camera at which this level is drawn
+	float morphStart;			// Distance at which vertices begin to morph towards the next level
+	std::vector<LodNode> nodes;
+};
+
+/* Part of a node selected for drawing: a quadrant, or the whole node */
+struct LodPatch {
+	int level;
+	int nodeX, nodeZ;
+	int firstI, lastI;			// Mesh columns and rows of the node covered by the patch
+	int firstJ, lastJ;
+};
+
+/* Quadtree over the terrain and the mesh selected for the last camera position */
+/* Follows CDLOD: the distance band of each level comes from the screen-space error of the next coarser level, */
+/* and vertices morph to the coarser grid near the end of their band so that changing level never pops */
+struct TerrainLod {
+	std::vector<LodLevel> levels;		// Finest first, the last level has a single row and column of nodes
+	bool heightsChanged;			// Rebuild the tree on the next draw
+	float pixelError;			// Screen-space error allowed, in pixels
+
+	// The selected mesh, rebuilt only when the camera, the style or the terrain changes
+	std::vector<LodPatch> patches;
+	std::vector<float> positions, normals, colours;
+	std::vector<unsigned int> indices;	// Triangles or quads of the patches
+	std::vector<unsigned int> skirtIndices;	// Walls hanging from the patch edges that hide cracks between levels
+	float builtModelview[16];		// The frustum and camera the mesh was selected for
+	float builtScale;			// Pixels per unit of error at distance 1, over pixelError
+	char builtStrip;
+	bool builtTopographic;
+	bool meshValid;
+	int vertexCount;			// Vertices drawn by the last frame, skirts included
+};
+
+void initTerrainLod (TerrainLod *lod);
+void markTerrainLodDirty (TerrainLod *lod);
+void markTerrainLodRect (TerrainLod *lod, const Terrain *terrain, const TerrainRect &rect);
+void drawTerrainLod (TerrainLod *lod, const Terrain *terrain, const TerrainStyle &style, char wireMode);
+
+#endif
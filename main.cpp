@@ -5,8 +5,10 @@ Terrain Generator
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <cmath>
 #include <math.h>
+#include <algorithm>
 
 #ifdef __APPLE__
 #  include <OpenGL/gl.h>
@@ -18,31 +20,45 @@ Terrain Generator
 #  include <GL/freeglut.h>
 #endif
 
-#define CIRCLE_MIN	5 		// Minimum size of our circle for our circles algorithm
-#define CIRCLE_RANGE	10 		// Range for our circle size, thus the circle will be 25 + (0 to range-1)
-#define MAX_DISP 	5 		// Maximum displacement used by the terrain generation algorithms
-#define VERT_SPACING	3		// Distance between vertices
+#include "terrain.h"
+#include "erosion.h"
+#include "compact.h"
+#include "renderer.h"
+#include "lod.h"
+#include "terrainfile.h"
+#include "meshexport.h"
+#include "frametimer.h"
+#include "trace.h"
 
 /* Terrain Globals */
-float *heightMap;				// Array for the height values of our terrain
-float *triangleNormals;				// Array for normals used for lighting the terrain (triangle strip)
-float *quadNormals;				// Array for normals used for lighting the terrain (quad strip)
-float *triangleVertexNormals;			// Vertex normals (triangle-strip)
-float *quadVertexNormals;			// Vertex normals (quad-strip)
-int terrainWidth;				// Width of the terrain (number of vertices in x direction)
-int terrainDepth;				// Depth of the terrain (number of vertices in z direction)
-int terrainComplexity = 1000;			// Essentially how many times the circles algorithm will be run, user-selectable to generate different terrain styles
+Terrain terrain;				// Height map, normals and generation settings of the terrain being viewed
 char wireFrameMode = 's';			// Toggle for rendering mode. 's' for solid, 'w' for wireframe, 'b' for both
 char shadeMode = 'f';				// Initially flat, 'f', 'g' for gourard shading
-char algorithmMode = 'c';			// Initially set to 'c' for circles algorithm, 'f' for fault algorithm, 'd' for particle deposition
 bool lightsOff = false;				// Toggle for lighting, initially there is no lighting, toggle with L
 char stripMode = 't';				// Toggle for strip mode; ie whether the program renders on triangle strip or quad strip mode
-float maxHeight;				// Used for non-lighting grayscale colouring and for topographic colouring
-float minHeight;				// Used for non-lighting grayscale colouring and for topographic colouring
 float terrainRotationX = 0;			// Used to rotate the terrain
 float terrainRotationY = 0;
 bool topographicEnabled = false;		// Used for bonus feature: advanced topographic colouring
-float baseGreen[] = {0.168, 0.388, 0.196};	// Topographic green (lowest point)
+TerrainMesh terrainMesh;			// Buffer objects the terrain is drawn from, refreshed after each regeneration
+ChunkVisibility chunkVisibility;		// Chunks inside the view frustum this frame, with drawn and culled counts
+TerrainLod terrainLod;				// Level of detail quadtree and the mesh selected for the camera
+bool lodEnabled = false;			// Draw with level of detail rather than every vertex, toggle with D
+bool simplifyEnabled = false;			// Draw the simplified triangles rather than every cell, toggle with M
+float simplifyError = 2.0f;			// Largest height difference between the simplified and the full mesh
+SculptBrush sculptBrush = { 0, 10, 1 };		// Mode 0 while the brush is off, cycle through the modes with B
+bool sculpting = false;				// The left button is down with the brush on, a stroke is under way
+bool erosionEnabled = false;			// Erode every terrain after generating it, toggle with e
+bool compactStorage = false;			// Keep every terrain in compact storage (16-bit heights, packed normals), toggle with K
+double pickModelview[16];			// Matrices the terrain was last drawn with, to turn the mouse into a ray
+double pickProjection[16];
+int pickViewport[4];
+
+/* Frame Globals */
+bool continuousRedraw = false;			// Redraw at ~30 FPS even when nothing changes, toggle with F
+bool frameTimerPending = false;			// An FPS timer is queued, so toggling F quickly does not start a second one
+FrameTimer displayTimes;			// CPU time of each call to display
+FrameTimer terrainTimes;			// CPU time spent in drawTerrain during each frame
+double terrainFrameMs = 0;			// drawTerrain time of the frame being drawn, summed over its passes
 
 /* Camera Globals */
 float camPos[ ] 	= { -10.0f, 10.0f, -10.0f };
@@ -84,596 +100,83 @@ float redplastic_shininess 	= 0.25 * 128;
 */
 
 
-/* Returns an index mapped to the 1D array of height values */
-int getIndex (int x, int z) {
-	return (x * terrainDepth + z);
-}
-
-/* Returns the index of the X component of a normal vector in its array */
-int getNormalIndex (int x, int z, char type, bool first) {
-	// Index depends on whether we are using triangles or quads, 't' for triangle
-	// If we are using triangles, the result further depends on whether or not we want
-	// the first triangle associated with the vertex, or the second
-	if (type == 't' && first)
-		return 6 * getIndex(x,z);
-	else if (type == 't')
-		return 6 * getIndex(x,z) + 3;
-	else 
-		return 3 * getIndex(x,z);
-}
-
-
-/* Once the surface normals are calculated, we calculate vertex normals */
-void setVertexNormals () {
-	printf("Calculating vertex normals...\n");
-	float vertexNormal[] 	= {0, 0, 0};		// Our final result for each vertex
-	float one[] 		= {0, 0, 0};		// First vector used to calculate vertex normal
-	int index1 		= 0;
-	float two[] 		= {0, 0, 0};		// Second vector used to calculate vertex normal
-	int index2 		= 0;
-	float three[] 		= {0, 0, 0};		// Third vector used to calculate vertex normal
-	int index3 		= 0;
-	float four[] 		= {0, 0, 0};		// Fourth vector used to calculate vertex normal
-	int index4 		= 0;
-	float five[] 		= {0, 0, 0};		// Fifth vector used to calculate vertex normal
-	int index5 		= 0;
-	float six[] 		= {0, 0, 0};		// Sixth vector used to calculate vertex normal
-	int index6 		= 0;
-	float magnitude;
-
-	// Iterate through the terrain
-	// Cases are needed for all corners, all edges, and inside vertices
-	int indexCounter = 0;
-	for (int z = 0; z < terrainDepth; z++) {
-		for (int x = 0; x < terrainWidth; x++) {
-			// Corners
-			if (x == 0 && z == 0) {
-				// Triangles
-				index1 = getNormalIndex(x,z,'t',true);
-				index2 = getNormalIndex(x,z,'t',false);
-				one[0] = triangleNormals[index1];		one[1] = triangleNormals[index1+1]; 		one[2] = triangleNormals[index1+2];
-				two[0] = triangleNormals[index2];		two[1] = triangleNormals[index2+1];		two[2] = triangleNormals[index2+2];
-
-				// Sum the vectors
-				triangleVertexNormals[indexCounter] 	= one[0] + two[0];
-				triangleVertexNormals[indexCounter+1] 	= one[1] + two[1];
-				triangleVertexNormals[indexCounter+2] 	= one[2] + two[2];
-
-				// Quads
-				index1 = getNormalIndex(x,z,'y',true);
-				one[0] = quadNormals[index1];			one[1] = quadNormals[index1+1]; 		one[2] = quadNormals[index1+2];
-
-				// Sum the vectors
-				quadVertexNormals[indexCounter] 	= one[0];
-				quadVertexNormals[indexCounter+1] 	= one[1];
-				quadVertexNormals[indexCounter+2] 	= one[2];
-			} 
-			else if (x == 0 & z == terrainDepth - 1) {
-				// Triangles
-				index1 = getNormalIndex(x,z-1,'t',true);
-				one[0] = triangleNormals[index1];		one[1] = triangleNormals[index1+1]; 		one[2] = triangleNormals[index1+2];
-
-				// Sum the vectors
-				triangleVertexNormals[indexCounter] 	= one[0];
-				triangleVertexNormals[indexCounter+1] 	= one[1];
-				triangleVertexNormals[indexCounter+2] 	= one[2];
-
-				// Quads
-				index1 = getNormalIndex(x,z-1,'y',true);
-				one[0] = quadNormals[index1];			one[1] = quadNormals[index1+1]; 		one[2] = quadNormals[index1+2];
-
-				// Sum the vectors
-				quadVertexNormals[indexCounter] 	= one[0];
-				quadVertexNormals[indexCounter+1] 	= one[1];
-				quadVertexNormals[indexCounter+2] 	= one[2];
-			}
-			else if (x == terrainWidth - 1 && z == 0) {
-				// Triangles
-				index1 = getNormalIndex(x-1,z,'t',false);
-				one[0] = triangleNormals[index1];		one[1] = triangleNormals[index1+1]; 		one[2] = triangleNormals[index1+2];
-
-				// Sum the vectors
-				triangleVertexNormals[indexCounter] 	= one[0];
-				triangleVertexNormals[indexCounter+1] 	= one[1];
-				triangleVertexNormals[indexCounter+2] 	= one[2];
-
-				// Quads
-				index1 = getNormalIndex(x-1,z,'y',true);
-				one[0] = quadNormals[index1];			one[1] = quadNormals[index1+1]; 		one[2] = quadNormals[index1+2];
-
-				// Sum the vectors
-				quadVertexNormals[indexCounter] 	= one[0];
-				quadVertexNormals[indexCounter+1] 	= one[1];
-				quadVertexNormals[indexCounter+2] 	= one[2];
-			}
-			else if (x == terrainWidth - 1 && z == terrainDepth - 1) {
-				// Triangles
-				index1 = getNormalIndex(x-1,z-1,'t',true);
-				index2 = getNormalIndex(x-1,z-1,'t',false);
-				one[0] = triangleNormals[index1];		one[1] = triangleNormals[index1+1]; 		one[2] = triangleNormals[index1+2];
-				two[0] = triangleNormals[index2];		two[1] = triangleNormals[index2+1];		two[2] = triangleNormals[index2+2];
-
-				// Sum the vectors
-				triangleVertexNormals[indexCounter] 	= one[0] + two[0];
-				triangleVertexNormals[indexCounter+1] 	= one[1] + two[1];
-				triangleVertexNormals[indexCounter+2] 	= one[2] + two[2];
-
-				// Quads
-				index1 = getNormalIndex(x-1,z-1,'y',true);
-				one[0] = quadNormals[index1];			one[1] = quadNormals[index1+1]; 		one[2] = quadNormals[index1+2];
-
-				// Sum the vectors
-				quadVertexNormals[indexCounter] 	= one[0];
-				quadVertexNormals[indexCounter+1] 	= one[1];
-				quadVertexNormals[indexCounter+2] 	= one[2];
-			}
-
-			// Edges
-			else if (x == 0) {
-				// Triangles
-				index1 = getNormalIndex(x,z-1,'t',true);
-				index2 = getNormalIndex(x,z,'t',false);
-				index3 = getNormalIndex(x,z,'t',true);
-				one[0] = triangleNormals[index1]; 		one[1] = triangleNormals[index1+1]; 		one[2] = triangleNormals[index1+2];
-				two[0] = triangleNormals[index2]; 		two[1] = triangleNormals[index2+1]; 		two[2] = triangleNormals[index2+2];
-				three[0] = triangleNormals[index3]; 		three[1] = triangleNormals[index3+1]; 		three[2] = triangleNormals[index3+2];
-
-				// Sum the vectors
-				triangleVertexNormals[indexCounter] 	= one[0] + two[0] + three[0];
-				triangleVertexNormals[indexCounter+1] 	= one[1] + two[1] + three[1];
-				triangleVertexNormals[indexCounter+2] 	= one[2] + two[2] + three[2];
-
-				// Quads
-				index1 = getNormalIndex(x,z-1,'y',true);
-				index2 = getNormalIndex(x,z,'y',true);
-				one[0] = quadNormals[index1]; 			one[1] = quadNormals[index1+1]; 		one[2] = quadNormals[index1+2];
-				two[0] = quadNormals[index2]; 			two[1] = quadNormals[index2+1];			two[2] = quadNormals[index2+2];
-
-				// Sum the vectors, and normalize the result
-				quadVertexNormals[indexCounter] 	= one[0] + two[0];
-				quadVertexNormals[indexCounter+1] 	= one[1] + two[1];
-				quadVertexNormals[indexCounter+2] 	= one[2] + two[2];
-			} 
-			else if (z == 0) {
-				// Triangles
-				index1 = getNormalIndex(x-1,z,'t',false);
-				index2 = getNormalIndex(x,z,'t',true);
-				index3 = getNormalIndex(x,z,'t',false);
-				one[0] = triangleNormals[index1]; 		one[1] = triangleNormals[index1+1]; 		one[2] = triangleNormals[index1+2];
-				two[0] = triangleNormals[index2]; 		two[1] = triangleNormals[index2+1]; 		two[2] = triangleNormals[index2+2];
-				three[0] = triangleNormals[index3]; 		three[1] = triangleNormals[index3+1]; 		three[2] = triangleNormals[index3+2];
-
-				// Sum the vectors
-				triangleVertexNormals[indexCounter] 	= one[0] + two[0] + three[0];
-				triangleVertexNormals[indexCounter+1] 	= one[1] + two[1] + three[1];
-				triangleVertexNormals[indexCounter+2] 	= one[2] + two[2] + three[2];
-
-				// Quads
-				index1 = getNormalIndex(x-1,z,'y',true);
-				index2 = getNormalIndex(x,z,'y',true);
-				one[0] = quadNormals[index1]; 			one[1] = quadNormals[index1+1]; 		one[2] = quadNormals[index1+2];
-				two[0] = quadNormals[index2]; 			two[1] = quadNormals[index2+1]; 		two[2] = quadNormals[index2+2];
-
-				// Sum the vectors, and normalize the result
-				quadVertexNormals[indexCounter] 	= one[0] + two[0];
-				quadVertexNormals[indexCounter+1] 	= one[1] + two[1];
-				quadVertexNormals[indexCounter+2] 	= one[2] + two[2];
-			} 
-			else if (x == terrainWidth - 1) {
-				// Triangles
-				index1 = getNormalIndex(x-1,z-1,'t',false);
-				index2 = getNormalIndex(x-1,z-1,'t',true);
-				index3 = getNormalIndex(x-1,z,'t',false);
-				one[0] = triangleNormals[index1]; 		one[1] = triangleNormals[index1+1]; 		one[2] = triangleNormals[index1+2];
-				two[0] = triangleNormals[index2]; 		two[1] = triangleNormals[index2+1]; 		two[2] = triangleNormals[index2+2];
-				three[0] = triangleNormals[index3]; 		three[1] = triangleNormals[index3+1]; 		three[2] = triangleNormals[index3+2];
-
-				// Sum the vectors
-				triangleVertexNormals[indexCounter] 	= one[0] + two[0] + three[0];
-				triangleVertexNormals[indexCounter+1] 	= one[1] + two[1] + three[1];
-				triangleVertexNormals[indexCounter+2] 	= one[2] + two[2] + three[2];
-
-				// Quads
-				index1 = getNormalIndex(x-1,z-1,'y',true);
-				index2 = getNormalIndex(x-1,z,'y',true);
-				one[0] = quadNormals[index1]; 			one[1] = quadNormals[index1 + 1]; 		one[2] = quadNormals[index1+2];
-				two[0] = quadNormals[index2]; 			two[1] = quadNormals[index2 + 1];		two[2] = quadNormals[index2+2];
-
-				// Sum the vectors, and normalize the result
-				quadVertexNormals[indexCounter] 	= one[0] + two[0];
-				quadVertexNormals[indexCounter+1] 	= one[1] + two[1];
-				quadVertexNormals[indexCounter+2] 	= one[2] + two[2];
-			} 
-			else if (z == terrainDepth - 1) {
-				// Triangles
-				index1 = getNormalIndex(x-1,z-1,'t',true);
-				index2 = getNormalIndex(x-1,z-1,'t',false);
-				index3 = getNormalIndex(x,z-1,'t',true);
-				one[0] = triangleNormals[index1]; 		one[1] = triangleNormals[index1+1]; 		one[2] = triangleNormals[index1+2];
-				two[0] = triangleNormals[index2]; 		two[1] = triangleNormals[index2+1]; 		two[2] = triangleNormals[index2+2];
-				three[0] = triangleNormals[index3]; 		three[1] = triangleNormals[index3+1]; 		three[2] = triangleNormals[index3+2];
-
-				// Sum the vectors
-				triangleVertexNormals[indexCounter] 	= one[0] + two[0] + three[0];
-				triangleVertexNormals[indexCounter+1] 	= one[1] + two[1] + three[1];
-				triangleVertexNormals[indexCounter+2] 	= one[2] + two[2] + three[2];
-
-				// Quads
-				index1 = getNormalIndex(x-1,z-1,'y',true);
-				index2 = getNormalIndex(x,z-1,'y',true);
-				one[0] = quadNormals[index1]; 			one[1] = quadNormals[index1 + 1]; 		one[2] = quadNormals[index1 + 2];
-				two[0] = quadNormals[index2]; 			two[1] = quadNormals[index2 + 1];		two[2] = quadNormals[index2 + 2];
-
-				// Sum the vectors, and normalize the result
-				quadVertexNormals[indexCounter] 	= one[0] + two[0];
-				quadVertexNormals[indexCounter+1] 	= one[1] + two[1];
-				quadVertexNormals[indexCounter+2] 	= one[2] + two[2];
-			}
-
-			// General case for interior vertices
-			else {
-				// For triangles, we take the 6 surrounding face normals, and calculate the corresponding vertex normal
-				index1 = getNormalIndex(x-1,z,'t',false);
-				index2 = getNormalIndex(x,z,'t',true);
-				index3 = getNormalIndex(x,z,'t',false);
-				index4 = getNormalIndex(x-1,z-1,'t',true);
-				index5 = getNormalIndex(x-1,z-1,'t',false);
-				index6 = getNormalIndex(x,z-1,'t',true);
-				one[0] = triangleNormals[index1]; 		one[1] = triangleNormals[index1 + 1]; 		one[2] = triangleNormals[index1 + 2];
-				two[0] = triangleNormals[index2]; 		two[1] = triangleNormals[index2 + 1]; 		two[2] = triangleNormals[index2 + 2];
-				three[0] = triangleNormals[index3]; 		three[1] = triangleNormals[index3 + 1]; 	three[2] = triangleNormals[index3 + 2];
-				four[0] = triangleNormals[index4]; 		four[1] = triangleNormals[index4 + 1]; 		four[2] = triangleNormals[index4 + 2];
-				five[0] = triangleNormals[index5]; 		five[1] = triangleNormals[index5 + 1]; 		five[2] = triangleNormals[index5 + 2];
-				six[0] = triangleNormals[index6]; 		six[1] = triangleNormals[index6 + 1]; 		six[2] = triangleNormals[index6 + 2];
-
-				// Sum the vectors, and normalize the result using the vector's magnitude
-				triangleVertexNormals[indexCounter] 	= one[0] + two[0] + three[0] + four[0] + five[0] + six[0];
-				triangleVertexNormals[indexCounter+1] 	= one[1] + two[1] + three[1] + four[1] + five[1] + six[1];
-				triangleVertexNormals[indexCounter+2] 	= one[2] + two[2] + three[2] + four[2] + five[2] + six[2];
-
-				// For quads, we take the normals of the 4 surrounding faces, and calculate the vertex normal
-				index1 = getNormalIndex(x-1,z-1,'y',true);
-				index2 = getNormalIndex(x,z-1,'y',true);
-				index3 = getNormalIndex(x-1,z,'y',true);
-				index4 = getNormalIndex(x,z,'y',true);
-				one[0] = quadNormals[index1]; 			one[1] = quadNormals[index1+1]; 		one[2] = quadNormals[index1+2];
-				two[0] = quadNormals[index2]; 			two[1] = quadNormals[index2+1];			two[2] = quadNormals[index2+2];
-				three[0] = quadNormals[index3]; 		three[1] = quadNormals[index3+1]; 		three[2] = quadNormals[index3+2];
-				four[0] = quadNormals[index4]; 			four[1] = quadNormals[index4+1]; 		four[2] = quadNormals[index4+2];
-
-				// Sum the vectors, and normalize the result
-				quadVertexNormals[indexCounter] 	= one[0] + two[0] + three[0] + four[0];
-				quadVertexNormals[indexCounter+1] 	= one[1] + two[1] + three[1] + four[1];
-				quadVertexNormals[indexCounter+2] 	= one[2] + two[2] + three[2] + four[2];
-			}
-
-			// For the newest vertex, we find the magnitudes and normalize
-			magnitude = (sqrt(pow(triangleVertexNormals[indexCounter],2) + pow(triangleVertexNormals[indexCounter+1],2) + pow(triangleVertexNormals[indexCounter+2],2)));
-				
-			// The vector is now normalized, and ready to use
-			triangleVertexNormals[indexCounter] /= magnitude;
-			triangleVertexNormals[indexCounter+1] /= magnitude;
-			triangleVertexNormals[indexCounter+2] /= magnitude;
-
-			magnitude = (sqrt(pow(quadVertexNormals[indexCounter],2) + pow(quadVertexNormals[indexCounter+1],2) + pow(quadVertexNormals[indexCounter+2],2)));
-				
-			// The vector is now normalized, and ready to use
-			quadVertexNormals[indexCounter] /= magnitude;
-			quadVertexNormals[indexCounter+1] /= magnitude;
-			quadVertexNormals[indexCounter+2] /= magnitude;
-
-			// Increment the index counter for the next vertex (+3 for next [x,y,z])
-			indexCounter += 3;
-		}
-	}
-}
-
-
-/* Calculates face normals for use with flat or gourard shading */
-void setNormals () {
-	printf("Calculating face normals...\n");
-
-	// Vectors we need to cross to get the normal of the two nearby triangular faces and the nearby quad face
-	float vecA[] = {0, 0, 0};
-	float vecB[] = {0, 0, 0};
-	float vecC[] = {0, 0, 0};
-
-	// Magnitudes are used to normalize the vectors
-	float magnitudeOne = 0;
-	float magnitudeTwo = 0;
-	float magnitudeQuad = 0;
-
-	// Normal vectors for the two triangles we are calculating and the quad we are calculating
-	float triangleOneNorm[] = {0, 0, 0};
-	float triangleTwoNorm[] = {0, 0, 0};
-	float quadNorm[] = {0, 0, 0};
-
-	// Run through all faces to calculate their face normals
-	int triangleNormIndex = 0;
-	int quadNormIndex = 0;
-	for (int i = 0; i < terrainDepth - 1; i++) {
-		for (int j = 0; j < terrainWidth - 1; j++) {
-			// Set the x,y,z values of the vectors
-			vecA[0] = 0; vecA[1] = heightMap[getIndex(j,i+1)] - heightMap[getIndex(j,i)]; vecA[2] = VERT_SPACING * (i+1) - VERT_SPACING * i;
-			vecB[0] = VERT_SPACING * (j+1) - VERT_SPACING * j; vecB[1] = heightMap[getIndex(j+1,i+1)] - heightMap[getIndex(j,i)]; vecB[2] = VERT_SPACING * (i+1) - VERT_SPACING * i;
-			vecC[0] = VERT_SPACING * (j+1) - VERT_SPACING * j; vecC[1] = heightMap[getIndex(j+1, i)] - heightMap[getIndex(j,i)]; vecC[2] = 0;
-
-			// Cross the vectors to get the normals
-			// Triangle one is A X B
-			triangleOneNorm[0] = (vecA[1] * vecB[2] - vecA[2] * vecB[1]);
-			triangleOneNorm[1] = (vecA[2] * vecB[0] - vecA[0] * vecB[2]);
-			triangleOneNorm[2] = (vecA[0] * vecB[1] - vecA[1] * vecB[0]);
-
-			// Triangle one is B X C
-			triangleTwoNorm[0] = (vecB[1] * vecC[2] - vecB[2] * vecC[1]);
-			triangleTwoNorm[1] = (vecB[2] * vecC[0] - vecB[0] * vecC[2]);
-			triangleTwoNorm[2] = (vecB[0] * vecC[1] - vecB[1] * vecC[0]);
-
-			// Quad is A X C
-			quadNorm[0] = (vecA[1] * vecC[2] - vecA[2] * vecC[1]);
-			quadNorm[1] = (vecA[2] * vecC[0] - vecA[0] * vecC[2]);
-			quadNorm[2] = (vecA[0] * vecC[1] - vecA[1] * vecC[0]);
-
-			// Calculate the magnitudes of the two normal vectors and then normalize them
-			magnitudeOne = sqrt(pow(triangleOneNorm[0],2) + pow(triangleOneNorm[1],2) + pow(triangleOneNorm[2],2));
-			magnitudeTwo = sqrt(pow(triangleTwoNorm[0],2) + pow(triangleTwoNorm[1],2) + pow(triangleTwoNorm[2],2));
-			magnitudeQuad = sqrt(pow(quadNorm[0],2) + pow(quadNorm[1],2) + pow(quadNorm[2],2));
-			triangleOneNorm[0] /= magnitudeOne; triangleOneNorm[1] /= magnitudeOne; triangleOneNorm[2] /= magnitudeOne;
-			triangleTwoNorm[0] /= magnitudeTwo; triangleTwoNorm[1] /= magnitudeTwo; triangleTwoNorm[2] /= magnitudeTwo;
-			quadNorm[0] /= magnitudeQuad; quadNorm[1] /= magnitudeQuad; quadNorm[2] /= magnitudeQuad;
-
-			// Store the results into the array of normalized normal vectors and increment the index accordingly
-			triangleNormals[triangleNormIndex++] = triangleOneNorm[0]; triangleNormals[triangleNormIndex++] = triangleOneNorm[1]; triangleNormals[triangleNormIndex++] = triangleOneNorm[2];
-			triangleNormals[triangleNormIndex++] = triangleTwoNorm[0]; triangleNormals[triangleNormIndex++] = triangleTwoNorm[1]; triangleNormals[triangleNormIndex++] = triangleTwoNorm[2];
-			quadNormals[quadNormIndex++] = quadNorm[0]; quadNormals[quadNormIndex++] = quadNorm[1]; quadNormals[quadNormIndex++] = quadNorm[2];
-		}
-	}
-	// Set the vertex normals for each point on the terrain
-	setVertexNormals ();
-}
-
-
 /* Draws the terrain based on the strip mode and the wire mode */
 void drawTerrain (char wireMode) {
-	// Determine the polygon mode based on our global wiremode setting
-	if (wireMode == 'w')
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);	// Wire frame
+	TRACE_ZONE("drawTerrain");
+	double start = frameClock();
+	TerrainStyle style = { stripMode, wireFrameMode, topographicEnabled };
+	if (lodEnabled && !terrain.compact)
+		drawTerrainLod(&terrainLod, &terrain, style, wireMode);
 	else
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);	// Normal (filled)
-
-	// Render the terrain using the newly set polygon mode
-	// Draw by going through the triangle-strip pattern across the grid for each z.
-	for (int z = 0; z < terrainDepth; z++) {
-		int i = z;				// Models the depth (z)
-		int j = 0;				// Models the current width position (x)
-		int counter = 0;			// Counter for index modification
-		int vertexNormalIndex = 0;
-
-		// Render a new strip for each z layer
-		if (stripMode == 't')
-			glBegin(GL_TRIANGLE_STRIP);
-		else if (stripMode == 'y')
-			glBegin(GL_QUAD_STRIP);
-				while (1) {
-					// If we're at the end of this Z layer, we break the loop to move to the next layer
-					if (counter == 2 * terrainWidth) {
-						break;
-					} else {
-						// Construct a vector for our vertex and place the vertex
-						float currentV[] = {j * VERT_SPACING, heightMap[getIndex(j,i)], i * VERT_SPACING};
-							
-						// Determine vertex colouring
-						if (topographicEnabled && wireFrameMode == 'b' && wireMode == 'w')
-							glColor3f(0,0,0);
-
-						else if (topographicEnabled)
-							glColor3f(baseGreen[0] + heightMap[getIndex(j,i)]/maxHeight, baseGreen[1] + heightMap[getIndex(j,i)]/maxHeight/8, baseGreen[2]+ heightMap[getIndex(j,i)]/maxHeight/4);
-						
-						else if (wireFrameMode == 'b' && wireMode == 'w') 
-							glColor3f(1,0,0);
-							
-						else {
-							if (algorithmMode == 'f') {
-								// Account for possible negative height values
-								float difference = 0;
-							
-								// Add a number to avoid floating point inaccuracies
-								if (minHeight < 0) 
-									difference = -1 * minHeight + 10;
-		
-								glColor3f((heightMap[getIndex(j,i)]+difference)/(maxHeight+difference),(heightMap[getIndex(j,i)]+difference)/(maxHeight+difference),(heightMap[getIndex(j,i)]+difference)/(maxHeight+difference));
-							} else {
-								if (maxHeight == 0 && minHeight == 0)
-									glColor3f(1.0,1.0,1.0);
-								else
-									glColor3f(heightMap[getIndex(j,i)]/maxHeight,heightMap[getIndex(j,i)]/maxHeight,heightMap[getIndex(j,i)]/maxHeight);
-							}
-						}
-
-						// Determine which normal we are using (quad or triangle-based vertex normal)
-						vertexNormalIndex = 3 * getIndex(j,i);
-						if (stripMode == 't')
-							glNormal3f(triangleVertexNormals[vertexNormalIndex],triangleVertexNormals[vertexNormalIndex+1],triangleVertexNormals[vertexNormalIndex+2]);
-						else
-							glNormal3f(quadVertexNormals[vertexNormalIndex],quadVertexNormals[vertexNormalIndex+1],quadVertexNormals[vertexNormalIndex+2]);
-
-						// Add the vertex with the assigned normal and colouring
-						glVertex3fv(currentV);
-
-						// Modulo operator used to increment the appropriate variables
-						if (counter % 2 == 0) {
-							i++;
-						} else {
-							j++;
-							i--;
-						}
-
-						// Number of vertices has increased
-						counter++;
-					}
-				}
-			glEnd();
-	}
+		drawTerrainMesh(&terrainMesh, &terrain, style, wireMode, &chunkVisibility);
+	terrainFrameMs += frameClock() - start;
 }
 
 
-/* Calculates the distance between two points in 3D space */
-float pointDistance (float pointOne[3], float pointTwo[3]) {
-	// Using the 3D distance formula
-	return (sqrt( pow((pointTwo[0]-pointOne[0]), 2) + pow((pointTwo[1]-pointOne[1]), 2) + pow((pointTwo[2]-pointOne[2]),2) ));
+/* Moves the camera and lights to suit the heights of the terrain */
+void fitViewToTerrain () {
+	// Cam position modified to account for new heights
+	camPos[1] = terrain.maxHeight;
+	camTarget[1] = terrain.maxHeight + terrain.minHeight / 2;
+
+	// Light positions will be modified to reflect the new heights
+	light_pos0[0] = 0; light_pos0[1] = terrain.maxHeight + 50; light_pos0[2] = 0;
+	light_pos1[0] = terrain.width * VERT_SPACING; light_pos1[1] = terrain.maxHeight + 50; light_pos1[2] = terrain.depth * VERT_SPACING;
 }
 
 
-/* Generate Values for the height map */
-void generateHeightValues (bool flatten) {
-	//  If argument is true, we flatten the terrain (initializing, reinitializing)
-	if (flatten) {
-		for (int i = 0; i < terrainWidth; i++) {
-			for (int j = 0; j < terrainDepth; j++) {
-				// We use this structure to define a synthetic 2D array represented as a 1D array
-				// and initialize all initial height values to 0
-				int index = getIndex(i,j);
-				heightMap[index] = 0.0f;
-			}
-		}
+/* Packs the terrain into compact storage if it is on, printing how far the packed terrain is from the floats */
+void applyCompactStorage () {
+	if (!compactStorage || terrain.compact)
+		return;
+	CompactError error;
+	compactTerrain(&terrain, &error);
+	printCompactError(error);
+}
 
-	// Cirlces Algorithm
-	} else if (algorithmMode == 'c') {
-		printf("Generating terrain with the circles algorithm...\n");
-		// We use the circles algorithm to randomly generate our terrain
-		// We run the algorithm using a random point a number of times equal to the terrain complexity
-		// That is currently set (default 100 - user selectable)
-		for (int i = 0; i < terrainComplexity; i++) {
-			// Generate a random point on our terrain
-			int randomX = rand() % terrainWidth;		// 0 to (width - 1)
-			int randomZ = rand() % terrainDepth;		// 0 to (depth - 1)
-			int index = getIndex(randomX, randomZ);		// Index of our random point in the height map
-			int randomY = heightMap[index];			// Height corresponding to our random point
-
-			// Get a random circle size, set the centrepoint
-			int randomCircleSize = rand() % CIRCLE_RANGE + CIRCLE_MIN;
-			float circleCenter[] = {(float) randomX, (float) randomY, (float) randomZ};
-
-			// Circles algorithm
-			for (int i = 0; i < terrainWidth; i++) {
-				for (int j = 0; j < terrainDepth; j++) {
-					int currentPointIndex = getIndex(i,j);
-					float currentPoint[] = { (float) i, heightMap[currentPointIndex], (float) j };
-
-					// Calculate point distance and use it to see whether or not we displace the point
-					float pd = pointDistance(currentPoint, circleCenter) * 2 / randomCircleSize;
-
-					if (fabs(pd) <= 1.0) {
-						int randomDisp = rand() % MAX_DISP + 1;	// Displacement is 1 to MAX_DISP + 1
-						heightMap[currentPointIndex] += (randomDisp / 2 + cos(pd * 3.14) * randomDisp / 2);
-					}
-				}
-			}
-		}
 
-	// Fault Algorithm
-	} else if (algorithmMode == 'f') {
-		printf("Generating terrain with the fault algorithm...\n");
-		// We use the fault algorithm to randomly generate our terrain
-		// We run the algorithm a number of times determined by the terrain complexity currently set
-		int counter = 0;
-		while (counter < terrainComplexity) {
-			// Pick two random points (x,z) and use a line between them to create a fault
-			int randomX1 = rand() % terrainWidth;			// 0 to (width - 1)
-			int randomZ1 = rand() % terrainDepth;			// 0 to (depth - 1)
-			int randomX2 = rand() % terrainWidth;			// 0 to (width - 1)
-			int randomZ2 = rand() % terrainDepth;			// 0 to (depth - 1)
-
-			// Handle displacement of points
-			for (int i = 0; i < terrainWidth; i++) {
-				for (int j = 0; j < terrainDepth; j++) {
-					// Random displacement
-					float displacement = 0.3;
-
-					// Depending on the side of the fault, displacement is either negative or positive
-					if (((randomX2 - randomX1) * (j - randomZ1) - (randomZ2 - randomZ1) * (i - randomX1)) > 0)
-						heightMap[getIndex(i,j)] += displacement;
-					else
-						heightMap[getIndex(i,j)] -= displacement;
-				}
-			}
-			counter++;
-		}
+/* Turns compact storage off and unpacks the terrain, for the features that need the float heights */
+void needFloatHeights (const char *feature) {
+	if (!compactStorage)
+		return;
+	compactStorage = false;
+	expandTerrain(&terrain);
+	markTerrainMeshDirty(&terrainMesh);
+	markTerrainLodDirty(&terrainLod);
+	printf("Compact storage off for %s\n", feature);
+}
 
-	// Particle Deposition Algorithm
-	} else if (algorithmMode == 'd') {
-		printf("Generating terrain with the particle deposition algorithm...\n");
-		// We use the my particle deposition algorithm to randomly generate our terrain
-		// Pick a random start point a total of terrainComplexity times, then build small islands around the point
-		int randNum, x, z, count;
-		float displacement;
-
-		// Pick random points, and then create islands around them randomly
-		int iterations = terrainComplexity;
-		if (iterations > 200) {
-			iterations = 5 * terrainComplexity;
-		}
 
-		for (int i = 0; i < iterations; i ++) {
-			// Generate a random point on our terrain
-			int randomX = rand() % terrainWidth;	// 0 to (width - 1)
-			int randomZ = rand() % terrainDepth;	// 0 to (depth - 1)
-
-			count = 0;
-			while (count < 100) {
-				// Use a switch statement to randomly move around to nearby points
-				randNum = rand() % 4;	// 0 to 3
-				
-				// Switch statement handles movement between nearby, existing vertices
-				switch (randNum) {
-					case 0:
-						if (randomX + 1 < terrainWidth) 
-							randomX++;
-						break;
-					case 1:
-						if (randomX - 1 >= 0) 
-							randomX--;
-						break;
-					case 2:
-						if (randomZ + 1 < terrainDepth) 
-							randomZ++;
-						break;
-					case 3:
-						if (randomZ - 1 >= 0) 
-							randomZ--;
-						break;
-				}
-
-				// Modify height at the current point randomly
-				displacement = 0.3;
-				int index = getIndex(randomX, randomZ);
-				heightMap[index] += displacement;
-				count++;
-			}
-		}
-	}
-
-	// Set our max and min for non-lighting colouring
-	maxHeight = heightMap[0];
-	minHeight = heightMap[0];
-
-	// Only necessary to reassign the max/min if we are not flattening the terrain
-	if (!flatten) {
-		for (int i = 0; i < terrainDepth * terrainWidth; i++) {
-			if (heightMap[i] > maxHeight)
-				maxHeight = heightMap[i];
-			if (heightMap[i] < minHeight)
-				minHeight = heightMap[i];
-		}
+/* Regenerates the terrain (flat if randomize is false) and moves the camera and lights to suit the new heights */
+/* Only the iterations the heights are missing are run, see updateHeightValues; a compact terrain is generated from scratch */
+void regenerateTerrain (bool randomize) {
+	expandTerrain (&terrain);
+	if (randomize) {
+		updateHeightValues (&terrain);
+		if (erosionEnabled)
+			erodeTerrain (&terrain, defaultErosion, 0);
+	} else {
+		generateHeightValues (&terrain, true);
 	}
+	setNormals (&terrain);
+	applyCompactStorage ();
+	markTerrainMeshDirty (&terrainMesh);
+	markTerrainLodDirty (&terrainLod);
+	fitViewToTerrain ();
+}
 
-	// Cam position modified to account for new heights
-	camPos[1] = maxHeight;
-	camTarget[1] = maxHeight + minHeight / 2;
 
-	// Light positions will be modified to reflect the new heights
-	light_pos0[0] = 0; light_pos0[1] = maxHeight + 50; light_pos0[2] = 0;
-	light_pos1[0] = terrainWidth * VERT_SPACING; light_pos1[1] = maxHeight + 50; light_pos1[2] = terrainDepth * VERT_SPACING;
+/* Loads a tiled terrain file in place of the current terrain, only the parts drawn are read from disk */
+bool loadTerrain (const char *path) {
+	double start = frameClock();
+	if (!readTiledTerrain (&terrain, path))
+		return false;
+	applyCompactStorage ();
+	markTerrainMeshDirty (&terrainMesh);
+	markTerrainLodDirty (&terrainLod);
+	fitViewToTerrain ();
+	printf("Loaded %dx%d terrain from %s in %.1f ms\n", terrain.width, terrain.depth, path, frameClock() - start);
+	return true;
 }
 
 
@@ -683,9 +186,9 @@ void setTerrainComplexity () {
 	// Only accept complexities less than 2000
 	while (1) {
 		printf("\nEnter your new (integer <= 2000) terrain complexity: \n");
-		scanf("%d",&terrainComplexity);
+		scanf("%d",&terrain.complexity);
 		
-		if (terrainComplexity <= 2000)
+		if (terrain.complexity <= 2000)
 			break;
 
 		printf("Invalid input, make sure your complexity is less than or equal to 2000.\n");
@@ -694,10 +197,7 @@ void setTerrainComplexity () {
 	printf("\nRegeneration underway, please wait...\n");
 
 	// Generate new height values to reflect the new complexity
-	// Reset the height to all 0s first
-	generateHeightValues (true);
-	generateHeightValues (false);
-	setNormals ();
+	regenerateTerrain (true);
 }
 
 
@@ -720,7 +220,16 @@ void printInstructions () {
 	printf("\nAdditional Feature Instructions (please note the upper/lower case of the commands):\n");
 	printf("\t- Change the terrain complexity (number algorithm iterations) with the 'C' key.\n");
 	printf("\t- When lighting is off, toggle topgraphic-style colouring with 'T' key.\n");
-	printf("\t- Toggle terrain algorithms using 'G'; toggles between circles, fault, and particle deposition.\n");
+	printf("\t- Toggle terrain algorithms using 'G'; toggles between circles, fault, particle deposition, gradient noise and diamond-square.\n");
+	printf("\t- Toggle thermal and hydraulic erosion of the terrain with 'e', the time per iteration is printed.\n");
+	printf("\t- Frames are only drawn when something changes; toggle continuous (~30 FPS) redrawing with 'F'.\n");
+	printf("\t- Print the p50/p95/p99 frame times recorded since the last press with 'P'.\n");
+	printf("\t- Save the terrain to terrain.ter with 'S'; start the program with a saved file as its argument to open it.\n");
+	printf("\t- Export the mesh as drawn (strip mode normals, topographic colours if on, simplified if on) to terrain.glb with 'E'.\n");
+	printf("\t- Toggle the simplified mesh (fewer triangles where the ground is flat) with 'M'; with level of detail off, '+' and '-' double or halve its height error.\n");
+	printf("\t- Toggle level of detail (distant terrain drawn with fewer vertices) with 'D'; '+' and '-' change the allowed error.\n");
+	printf("\t- Cycle the sculpt brush (off, raise, lower, smooth) with 'B' and drag with the left mouse button to sculpt; '[' and ']' change its size.\n");
+	printf("\t- Toggle compact storage (16-bit heights and packed normals, about a fifth of the memory) with 'K'.\n");
 }
 
 
@@ -733,6 +242,9 @@ void printInstructions () {
 
 /* Display Function */
 void display () {
+	TRACE_ZONE("display");
+	double start = frameClock();
+	terrainFrameMs = 0;
 
 	// Necessary GL operations
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -751,7 +263,15 @@ void display () {
 	glPushMatrix();
 		glRotatef(terrainRotationX, 1, 0, 0);
 		glRotatef(terrainRotationY, 0, 1, 0);
-		glTranslatef(-1*(terrainWidth*VERT_SPACING)/2,0,-1*(terrainDepth*VERT_SPACING)/2);
+		glTranslatef(-1*(terrain.width*VERT_SPACING)/2,0,-1*(terrain.depth*VERT_SPACING)/2);
+
+		// Keep the terrain's matrices for picking with the mouse
+		glGetDoublev(GL_MODELVIEW_MATRIX, pickModelview);
+		glGetDoublev(GL_PROJECTION_MATRIX, pickProjection);
+		glGetIntegerv(GL_VIEWPORT, pickViewport);
+
+		// Find the chunks in view once for every pass of this frame
+		cullTerrainChunks(&terrain, &chunkVisibility);
 
 		glLightfv(GL_LIGHT0, GL_POSITION, light_pos0);
 		glLightfv(GL_LIGHT1, GL_POSITION, light_pos1);
@@ -779,10 +299,96 @@ void display () {
 
 	glPopMatrix();
 
+	// Swapping can wait for the display, so it is left out of the frame time
+	recordFrame(&displayTimes, frameClock() - start);
+	recordFrame(&terrainTimes, terrainFrameMs);
 	glutSwapBuffers();
 }
 
 
+/* Finds the point of the terrain under window position (x, y), in vertices, by marching along the mouse ray */
+/* Returns false if the ray misses the terrain */
+bool pickTerrain (int x, int y, float *hitX, float *hitZ) {
+	double nearPoint[3], farPoint[3];
+	double windowY = pickViewport[3] - y - 1;
+	if (!gluUnProject(x, windowY, 0, pickModelview, pickProjection, pickViewport, &nearPoint[0], &nearPoint[1], &nearPoint[2])
+		|| !gluUnProject(x, windowY, 1, pickModelview, pickProjection, pickViewport, &farPoint[0], &farPoint[1], &farPoint[2]))
+		return false;
+
+	// Half a cell at a time, taking the first sample that is below the nearest vertex
+	double length = sqrt((farPoint[0] - nearPoint[0]) * (farPoint[0] - nearPoint[0]) + (farPoint[1] - nearPoint[1]) * (farPoint[1] - nearPoint[1])
+		+ (farPoint[2] - nearPoint[2]) * (farPoint[2] - nearPoint[2]));
+	int steps = (int) (length / (VERT_SPACING * 0.5)) + 1;
+	for (int i = 0; i <= steps; i++) {
+		double t = (double) i / steps;
+		double point[3];
+		for (int axis = 0; axis < 3; axis++)
+			point[axis] = nearPoint[axis] + (farPoint[axis] - nearPoint[axis]) * t;
+		int vx = (int) floor(point[0] / VERT_SPACING + 0.5), vz = (int) floor(point[2] / VERT_SPACING + 0.5);
+		if (vx < 0 || vz < 0 || vx >= terrain.width || vz >= terrain.depth)
+			continue;
+		if (point[1] <= terrain.chunks.height(vx, vz)) {
+			*hitX = (float) (point[0] / VERT_SPACING);
+			*hitZ = (float) (point[2] / VERT_SPACING);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/* Applies one dab of the brush under the mouse and refreshes only the part of the meshes it changed */
+void sculptAt (int x, int y) {
+	float hitX, hitZ;
+	if (!pickTerrain(x, y, &hitX, &hitZ))
+		return;
+	TerrainRect changed = sculptTerrain(&terrain, sculptBrush, hitX, hitZ);
+	markTerrainMeshRect(&terrainMesh, changed);
+	markTerrainLodRect(&terrainLod, &terrain, changed);
+	glutPostRedisplay();
+}
+
+
+/* Mouse Function, the left button starts and ends sculpt strokes */
+void mouse (int button, int state, int x, int y) {
+	if (button != GLUT_LEFT_BUTTON)
+		return;
+	if (state == GLUT_DOWN && sculptBrush.mode) {
+		sculpting = true;
+		sculptAt(x, y);
+	} else if (state == GLUT_UP && sculpting) {
+		// The colour range and the simplified triangles follow the whole stroke at once
+		sculpting = false;
+		bool rangeChanged = finishSculpting(&terrain);
+		markTerrainMeshSculpted(&terrainMesh, rangeChanged);
+		if (rangeChanged) {
+			TerrainRect none = { 0, 0, 0, 0 };
+			markTerrainLodRect(&terrainLod, &terrain, none);
+		}
+		glutPostRedisplay();
+	}
+}
+
+
+/* Motion Function, dragging with the left button sculpts */
+void motion (int x, int y) {
+	if (sculpting)
+		sculptAt(x, y);
+}
+
+
+/* Frame Rate Function, only keeps running while continuous redraw is on */
+void FPS (int val) {
+	// ~ 30 FPS
+	frameTimerPending = false;
+	if (continuousRedraw) {
+		glutPostRedisplay();
+		glutTimerFunc(34, FPS, 0);
+		frameTimerPending = true;
+	}
+}
+
+
 /* Keyboard Function */
 void keyboard (unsigned char key, int xIn, int yIn) {
 
@@ -809,15 +415,14 @@ void keyboard (unsigned char key, int xIn, int yIn) {
 
 		// 'R' key used to flatten the terrain (reset)
 		case 'R':
-			generateHeightValues(true);	
-			setNormals();
+			regenerateTerrain(false);
 			break;
 
 		// 'r' key used to generate a new random terrain
 		case 'r':
-			generateHeightValues(true);	
-			generateHeightValues(false);
-			setNormals();
+			seedTerrain(&terrain, terrain.seed + 1);
+			printf("Generating terrain with seed %u\n", terrain.seed);
+			regenerateTerrain(true);
 			break;
 
 		// 's' key used to toggle between shading modes, flat and gourard
@@ -900,18 +505,39 @@ void keyboard (unsigned char key, int xIn, int yIn) {
 			camPos[1] -= camSpeed;
 			break;
 
-		// Toggle between algorithm modes (circle 'c', fault 'f', displacement 'd')
+		// Toggle between algorithm modes (circle 'c', fault 'f', displacement 'd', noise 'n', diamond-square 's')
 		case 'G':
 			// Set the new algorithm mode
-			if (algorithmMode == 'c')
-				algorithmMode = 'f';
-			else if (algorithmMode == 'f')
-				algorithmMode = 'd';
-			else if (algorithmMode == 'd')
-				algorithmMode = 'c';
-
-			generateHeightValues(true);
-			generateHeightValues(false);
+			if (terrain.algorithm == 'c')
+				terrain.algorithm = 'f';
+			else if (terrain.algorithm == 'f')
+				terrain.algorithm = 'd';
+			else if (terrain.algorithm == 'd')
+				terrain.algorithm = 'n';
+			else if (terrain.algorithm == 'n')
+				terrain.algorithm = 's';
+			else if (terrain.algorithm == 's')
+				terrain.algorithm = 'c';
+
+			regenerateTerrain(true);
+			break;
+
+		// 'e' toggles erosion: the terrain as it is gets eroded, and so does every terrain generated while it is on
+		// Turning it off generates the terrain again without it
+		case 'e':
+			erosionEnabled = !erosionEnabled;
+			printf("Erosion %s\n", erosionEnabled ? "on" : "off");
+			if (!erosionEnabled) {
+				regenerateTerrain(true);
+				break;
+			}
+			expandTerrain(&terrain);
+			erodeTerrain(&terrain, defaultErosion, 0);
+			setNormals(&terrain);
+			applyCompactStorage();
+			markTerrainMeshDirty(&terrainMesh);
+			markTerrainLodDirty(&terrainLod);
+			fitViewToTerrain();
 			break;
 
 		// Allow the user to change terrain complexity with the 'C' key
@@ -919,6 +545,129 @@ void keyboard (unsigned char key, int xIn, int yIn) {
 			setTerrainComplexity();
 			break;
 
+		// 'F' toggles continuous redrawing, otherwise frames are only drawn when something changes
+		case 'F':
+			continuousRedraw = !continuousRedraw;
+			printf("Continuous redraw %s\n", continuousRedraw ? "on" : "off");
+			if (continuousRedraw && !frameTimerPending) {
+				glutTimerFunc(34, FPS, 0);
+				frameTimerPending = true;
+			}
+			break;
+
+		// 'P' prints the frame times since the last 'P' and starts a new recording
+		case 'P':
+			printFrameTimer(&displayTimes, "display");
+			printFrameTimer(&terrainTimes, "drawTerrain");
+			printf("Chunks in the last frame: %d drawn, %d culled\n", chunkVisibility.drawn, chunkVisibility.culled);
+			if (lodEnabled)
+				printf("Level of detail: %d vertices in %d patches, %.1f pixel error\n", terrainLod.vertexCount, (int) terrainLod.patches.size(), terrainLod.pixelError);
+			else
+				printf("Triangles in the last frame: %lld%s\n", terrainMesh.trianglesDrawn, simplifyEnabled ? " (simplified)" : "");
+			resetFrameTimer(&displayTimes);
+			resetFrameTimer(&terrainTimes);
+			return;
+
+		// 'S' saves the terrain as a tiled file that can be opened again with ./nolanTerrainGen.x terrain.ter
+		case 'S':
+			needFloatHeights("saving");
+			if (writeTiledTerrain(&terrain, "terrain.ter", true, false))
+				printf("Saved the terrain to terrain.ter\n");
+			else
+				printf("Could not save the terrain to terrain.ter\n");
+			return;
+
+		// 'E' exports the mesh as drawn to terrain.glb, with topographic colours if they are on
+		case 'E': {
+			ExportOptions options = { 'g', stripMode, topographicEnabled, simplifyEnabled ? simplifyError : -1 };
+			needFloatHeights("exporting");
+			if (exportTerrainMesh(&terrain, "terrain.glb", options))
+				printf("Exported the mesh to terrain.glb\n");
+			else
+				printf("Could not export the mesh to terrain.glb\n");
+			return;
+		}
+
+		// 'K' packs the terrain into compact storage, or unpacks it; level of detail, simplifying and sculpting need the floats
+		case 'K':
+			compactStorage = !compactStorage;
+			printf("Compact storage %s\n", compactStorage ? "on" : "off");
+			if (compactStorage) {
+				lodEnabled = simplifyEnabled = false;
+				terrainMesh.simplifyError = -1;
+				sculptBrush.mode = 0;
+				applyCompactStorage();
+			} else {
+				expandTerrain(&terrain);
+				markTerrainLodDirty(&terrainLod);
+			}
+			markTerrainMeshDirty(&terrainMesh);
+			break;
+
+		// 'D' switches between level of detail and drawing every vertex
+		case 'D':
+			lodEnabled = !lodEnabled;
+			if (lodEnabled)
+				needFloatHeights("level of detail");
+			printf("Level of detail %s\n", lodEnabled ? "on" : "off");
+			break;
+
+		// 'B' cycles the sculpt brush through off, raise, lower and smooth
+		case 'B': {
+			const char *modes = "rls";
+			const char *next = sculptBrush.mode ? strchr(modes, sculptBrush.mode) + 1 : modes;
+			sculptBrush.mode = *next;
+			if (sculptBrush.mode)
+				needFloatHeights("sculpting");
+			printf("Sculpt brush: %s\n", !*next ? "off" : *next == 'r' ? "raise" : *next == 'l' ? "lower" : "smooth");
+			break;
+		}
+
+		// '[' and ']' shrink and grow the sculpt brush
+		case '[':
+			sculptBrush.radius = std::max(sculptBrush.radius - 2, 2.0f);
+			printf("Sculpt brush radius: %.0f vertices\n", sculptBrush.radius);
+			break;
+
+		case ']':
+			sculptBrush.radius = std::min(sculptBrush.radius + 2, 200.0f);
+			printf("Sculpt brush radius: %.0f vertices\n", sculptBrush.radius);
+			break;
+
+		// 'M' switches between the simplified triangles and every cell
+		case 'M':
+			simplifyEnabled = !simplifyEnabled;
+			if (simplifyEnabled)
+				needFloatHeights("the simplified mesh");
+			terrainMesh.simplifyError = simplifyEnabled ? simplifyError : -1;
+			printf("Simplified mesh %s (%.3g height error)\n", simplifyEnabled ? "on" : "off", simplifyError);
+			break;
+
+		// '+' and '-' double or halve the screen-space error the level of detail allows, or the simplified mesh's height error
+		case '+':
+			if (!lodEnabled && simplifyEnabled) {
+				simplifyError *= 2;
+				terrainMesh.simplifyError = simplifyError;
+				printf("Simplified mesh error: %.3g\n", simplifyError);
+				break;
+			}
+			terrainLod.pixelError *= 2;
+			printf("Level of detail error: %.1f pixels\n", terrainLod.pixelError);
+			break;
+
+		case '-':
+			if (!lodEnabled && simplifyEnabled) {
+				if (simplifyError > 1.0f / 64)
+					simplifyError /= 2;
+				terrainMesh.simplifyError = simplifyError;
+				printf("Simplified mesh error: %.3g\n", simplifyError);
+				break;
+			}
+			if (terrainLod.pixelError > 0.25f)
+				terrainLod.pixelError /= 2;
+			printf("Level of detail error: %.1f pixels\n", terrainLod.pixelError);
+			break;
+
 		case 'f':
 			// If alt is active, move the light
 			if (glutGetModifiers() == GLUT_ACTIVE_ALT)
@@ -996,14 +745,6 @@ void special (int key, int x, int y)
 }
 
 
-/* Frame Rate Function */
-void FPS (int val) {
-	// ~ 30 FPS
-	glutPostRedisplay();
-	glutTimerFunc(34, FPS, 0);
-}
-
-
 /*
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -1012,9 +753,11 @@ void FPS (int val) {
 
 
 /* Initialize Callback Functions */
+/* Frames are drawn on demand: input posts a redisplay, GLUT posts one when the window is exposed */
 void callBackInit () {
-	glutTimerFunc(0, FPS, 0);
 	glutKeyboardFunc(keyboard);
+	glutMouseFunc(mouse);
+	glutMotionFunc(motion);
 	glutSpecialFunc(special);
 	glutDisplayFunc(display);
 }
@@ -1060,35 +803,48 @@ int main (int argc, char** argv) {
 	// Print the instructions
 	printInstructions();
 
+	initTerrainMesh(&terrainMesh);
+	initTerrainLod(&terrainLod);
+
+	// A tiled terrain file named on the command line is opened instead of generating one
+	bool loaded = false;
+	if (argc > 1) {
+		loaded = loadTerrain(argv[1]);
+		if (!loaded)
+			printf("Could not open %s as a tiled terrain file\n", argv[1]);
+	}
+
 	// Prompt the user until we get a valid input
-	while (1) {
-		printf("\nEnter number of vertices for the terrain (min 50,50, max 300,300), in form width,depth:\n");
-		scanf("%d,%d",&terrainWidth,&terrainDepth);
+	int width = 0, depth = 0;
+	while (!loaded) {
+		printf("\nEnter number of vertices for the terrain (min 50,50, max %d,%d), in form width,depth:\n", MAX_TERRAIN_SIDE, MAX_TERRAIN_SIDE);
+		scanf("%d,%d",&width,&depth);
 
 		// Only accept two in range integers
-		if (terrainWidth >= 50 && terrainWidth <= 300 && terrainDepth >= 50 && terrainDepth <= 300) {
+		// The terrain is stored and drawn in chunks, so memory is the only practical limit on the size
+		if (width >= 50 && width <= MAX_TERRAIN_SIDE && depth >= 50 && depth <= MAX_TERRAIN_SIDE) {
 			break;
 		}
 
 		printf("Invalid entry. Try again.\n");
 	}
 
-	printf("Generation underway, please wait...\n");
-
 	// Declare the initial height map and normal arrays and generate the initial terrain
-	heightMap 		= new float [terrainWidth * terrainDepth];
-	triangleNormals 	= new float [3 * 2 * terrainWidth * terrainDepth];
-	quadNormals 		= new float [3 * terrainWidth * terrainDepth];
-	quadVertexNormals 	= new float [3 * terrainWidth * terrainDepth];
-	triangleVertexNormals 	= new float [3 * terrainWidth * terrainDepth];
+	if (!loaded) {
+		printf("Generation underway, please wait...\n");
+		initTerrain(&terrain, width, depth);
+		terrain.complexity = 1000;		// User-selectable with 'C' to generate different terrain styles
+		terrain.algorithm = 'c';		// Initially set to 'c' for circles algorithm
+		seedTerrain(&terrain, 1);
+		regenerateTerrain(true);
+	}
 
-	generateHeightValues(true);
-	generateHeightValues(false);
-	setNormals();
+	// Small terrains draw faster at full detail, level of detail starts on once a frame would have over a million vertices
+	lodEnabled = terrain.chunks.vertices() > (1 << 20);
 
 	// Modify camera target to the centre of the terrain
-	camTarget[0] = (float) terrainWidth / 2;
-	camTarget[2] = (float) terrainDepth / 2;
+	camTarget[0] = (float) terrain.width / 2;
+	camTarget[2] = (float) terrain.depth / 2;
 
 	// Initialize callback functions and depth test
 	callBackInit();
@@ -0,0 +1,447 @@
+/*
+Nolan Slade
+Terrain Generator - mesh export
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "meshexport.h"
+#include "simplify.h"
+
+// Every format writes the grid as indexed triangles in the order and winding of the triangle strips:
+// the cell at (x, z) is (x,z) (x,z+1) (x+1,z) then (x+1,z) (x,z+1) (x+1,z+1). Only two rows of vertices
+// are held at a time, so memory does not grow with the terrain. A simplified mesh is written a chunk at a
+// time instead, each chunk with its own copy of the vertices it shares with its neighbours
+
+#define NO_SLOT		0xFFFFFFFFu		// Vertex not yet used by the simplified triangles of a chunk
+
+
+/* Vertices gathered from the chunks: one row of the grid, or those one chunk of the simplified mesh uses */
+struct ExportVertices {
+	std::vector<float> heights;
+	std::vector<float> positions;		// 3 floats per vertex
+	std::vector<float> normals;		// 3 floats per vertex
+	std::vector<float> colours;		// Topographic RGB clamped to 0..1, empty if not wanted
+	std::vector<unsigned int> triangles;	// Simplified chunks only: three vertex numbers per triangle
+	std::vector<unsigned int> slots;	// Simplified chunks only: number of each vertex of the chunk's mesh, or NO_SLOT
+};
+
+
+/* Fills the colours of gathered vertices from their heights, if they are wanted */
+static void setColours (const Terrain *terrain, const ExportOptions &options, ExportVertices &vertices) {
+	if (!options.colours || vertices.heights.empty()) {
+		vertices.colours.clear();
+		return;
+	}
+	int count = (int) vertices.heights.size();
+	vertices.colours.resize(3 * count);
+	heightColours(terrain, &vertices.heights[0], count, 0, &vertices.colours[0]);
+	for (int i = 0; i < 3 * count; i++)
+		vertices.colours[i] = std::min(std::max(vertices.colours[i], 0.0f), 1.0f);
+}
+
+
+/* Fills one row of positions, normals and (optionally) colours */
+static void gatherRow (const Terrain *terrain, int z, const ExportOptions &options, ExportVertices &row) {
+	int width = terrain->width;
+	row.heights.resize(width);
+	row.positions.resize(3 * width);
+	row.normals.resize(3 * width);
+	terrain->chunks.copyHeights(0, z, width, &row.heights[0]);
+
+	for (int x = 0; x < width; x++) {
+		row.positions[3 * x] = (float) (x * VERT_SPACING);
+		row.positions[3 * x + 1] = row.heights[x];
+		row.positions[3 * x + 2] = (float) (z * VERT_SPACING);
+	}
+	for (int cx = 0; cx < terrain->chunks.chunksX(); cx++) {
+		const TerrainChunk &chunk = terrain->chunks.chunk(cx, z >> CHUNK_SHIFT);
+		const Heightfield &field = chunk.field;
+		for (int x = 0; x < field.width(); x++) {
+			int index = field.index(x, z - chunk.z0);
+			for (int axis = 0; axis < 3; axis++)
+				row.normals[3 * (chunk.x0 + x) + axis] = (options.stripMode == 't' ? field.triangleNormals(axis) : field.quadNormals(axis))[index];
+		}
+	}
+	setColours(terrain, options, row);
+}
+
+
+/* Fills the simplified triangles of chunk i and the vertices they use, numbered in the order first used */
+static void gatherChunk (const Terrain *terrain, const TerrainSimplifier &simplifier, int i, const ExportOptions &options, ExportVertices &piece) {
+	const int stride = CHUNK_SIZE + 1;
+	const TerrainChunk &chunk = terrain->chunks.chunk(i);
+	piece.triangles.clear();
+	simplifier.triangulate(i, options.maxError, stride, piece.triangles);
+	piece.slots.assign(stride * stride, NO_SLOT);
+	piece.heights.clear();
+	piece.positions.clear();
+	piece.normals.clear();
+
+	for (size_t k = 0; k < piece.triangles.size(); k++) {
+		unsigned int local = piece.triangles[k];
+		if (piece.slots[local] == NO_SLOT) {
+			piece.slots[local] = (unsigned int) piece.heights.size();
+			int x = chunk.x0 + local % stride, z = chunk.z0 + local / stride;
+			const TerrainChunk &owner = terrain->chunks.chunkAt(x, z);
+			const Heightfield &field = owner.field;
+			int index = field.index(x - owner.x0, z - owner.z0);
+			piece.heights.push_back(field.heights()[index]);
+			piece.positions.push_back((float) (x * VERT_SPACING));
+			piece.positions.push_back(field.heights()[index]);
+			piece.positions.push_back((float) (z * VERT_SPACING));
+			for (int axis = 0; axis < 3; axis++)
+				piece.normals.push_back((options.stripMode == 't' ? field.triangleNormals(axis) : field.quadNormals(axis))[index]);
+		}
+		piece.triangles[k] = piece.slots[local];
+	}
+	setColours(terrain, options, piece);
+}
+
+
+/* Appends "v" lines for every gathered vertex, then "vn" lines, colours use the common "v x y z r g b" extension */
+static void appendObjVertices (const ExportVertices &vertices, std::string &text) {
+	char line[160];
+	size_t count = vertices.heights.size();
+	for (size_t i = 0; i < count; i++) {
+		const float *p = &vertices.positions[3 * i];
+		if (!vertices.colours.empty())
+			snprintf(line, sizeof(line), "v %g %g %g %.4f %.4f %.4f\n", p[0], p[1], p[2], vertices.colours[3 * i], vertices.colours[3 * i + 1], vertices.colours[3 * i + 2]);
+		else
+			snprintf(line, sizeof(line), "v %g %g %g\n", p[0], p[1], p[2]);
+		text += line;
+	}
+	for (size_t i = 0; i < count; i++) {
+		snprintf(line, sizeof(line), "vn %g %g %g\n", vertices.normals[3 * i], vertices.normals[3 * i + 1], vertices.normals[3 * i + 2]);
+		text += line;
+	}
+}
+
+
+/* Wavefront OBJ, rows of "v" and "vn" lines followed by the faces that close the row */
+static bool exportObj (const Terrain *terrain, FILE *file, const ExportOptions &options) {
+	bool ok = fprintf(file, "# %dx%d terrain, algorithm %c, complexity %d, seed %u\n", terrain->width, terrain->depth,
+		terrain->algorithm, terrain->complexity, terrain->seed) > 0;
+	ExportVertices row;
+	std::string text;
+	char line[320];
+	for (int z = 0; ok && z < terrain->depth; z++) {
+		gatherRow(terrain, z, options, row);
+		text.clear();
+		appendObjVertices(row, text);
+
+		// Faces between the previous row and this one, indices start at 1
+		if (z > 0) {
+			long long above = (long long) (z - 1) * terrain->width + 1, below = above + terrain->width;
+			for (int x = 0; x + 1 < terrain->width; x++) {
+				long long v00 = above + x, v01 = below + x, v10 = v00 + 1, v11 = v01 + 1;
+				snprintf(line, sizeof(line), "f %lld//%lld %lld//%lld %lld//%lld\nf %lld//%lld %lld//%lld %lld//%lld\n",
+					v00, v00, v01, v01, v10, v10, v10, v10, v01, v01, v11, v11);
+				text += line;
+			}
+		}
+		ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+	}
+	return ok;
+}
+
+
+/* Wavefront OBJ of the simplified mesh, each chunk's vertices followed by its faces */
+static bool exportSimplifiedObj (const Terrain *terrain, const TerrainSimplifier &simplifier, FILE *file, const ExportOptions &options) {
+	bool ok = fprintf(file, "# %dx%d terrain, algorithm %c, complexity %d, seed %u, simplified to %g height error\n", terrain->width, terrain->depth,
+		terrain->algorithm, terrain->complexity, terrain->seed, options.maxError) > 0;
+	ExportVertices piece;
+	std::string text;
+	char line[320];
+	long long first = 1;
+	for (int i = 0; ok && i < terrain->chunks.count(); i++) {
+		gatherChunk(terrain, simplifier, i, options, piece);
+		text.clear();
+		appendObjVertices(piece, text);
+		for (size_t k = 0; k < piece.triangles.size(); k += 3) {
+			long long a = first + piece.triangles[k], b = first + piece.triangles[k + 1], c = first + piece.triangles[k + 2];
+			snprintf(line, sizeof(line), "f %lld//%lld %lld//%lld %lld//%lld\n", a, a, b, b, c, c);
+			text += line;
+		}
+		first += (long long) piece.heights.size();
+		ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+	}
+	return ok;
+}
+
+
+/* Writes the 80-byte header and triangle count of a binary STL file */
+static bool writeStlHeader (const Terrain *terrain, FILE *file, long long triangles) {
+	if (triangles > UINT32_MAX) {
+		printf("Too many triangles for STL\n");
+		return false;
+	}
+	char header[80];
+	memset(header, 0, sizeof(header));
+	snprintf(header, sizeof(header), "nolanTerrainGen %dx%d terrain, algorithm %c, seed %u", terrain->width, terrain->depth, terrain->algorithm, terrain->seed);
+	uint32_t count = (uint32_t) triangles;
+	return fwrite(header, 1, 80, file) == 80 && fwrite(&count, 4, 1, file) == 1;
+}
+
+
+/* Fills one 50-byte STL record: the face normal, the three corners and an unused attribute */
+static void stlRecord (unsigned char *record, const float *a, const float *b, const float *c) {
+	float u[] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, v[] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	float normal[] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+	float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+	for (int axis = 0; axis < 3; axis++)
+		normal[axis] /= length;
+	memcpy(record, normal, 12);
+	memcpy(record + 12, a, 12);
+	memcpy(record + 24, b, 12);
+	memcpy(record + 36, c, 12);
+	record[48] = record[49] = 0;
+}
+
+
+/* Binary STL: triangles with their face normals, the format has no indices, vertex normals or colours */
+static bool exportStl (const Terrain *terrain, FILE *file) {
+	bool ok = writeStlHeader(terrain, file, 2LL * (terrain->width - 1) * (terrain->depth - 1));
+
+	ExportOptions options = { 's', 't', false, -1 };
+	ExportVertices rows[2];
+	std::vector<unsigned char> records(50 * 2 * (size_t) (terrain->width - 1));
+	gatherRow(terrain, 0, options, rows[0]);
+	for (int z = 1; ok && z < terrain->depth; z++) {
+		const ExportVertices &above = rows[(z - 1) & 1];
+		ExportVertices &below = rows[z & 1];
+		gatherRow(terrain, z, options, below);
+
+		unsigned char *record = &records[0];
+		for (int x = 0; x + 1 < terrain->width; x++) {
+			stlRecord(record, &above.positions[3 * x], &below.positions[3 * x], &above.positions[3 * x + 3]);
+			stlRecord(record + 50, &above.positions[3 * x + 3], &below.positions[3 * x], &below.positions[3 * x + 3]);
+			record += 100;
+		}
+		ok = fwrite(&records[0], 1, records.size(), file) == records.size();
+	}
+	return ok;
+}
+
+
+/* Binary STL of the simplified mesh, a chunk at a time after a pass counting the triangles */
+static bool exportSimplifiedStl (const Terrain *terrain, const TerrainSimplifier &simplifier, FILE *file, const ExportOptions &options) {
+	long long triangles = 0;
+	std::vector<unsigned int> counted;
+	for (int i = 0; i < terrain->chunks.count(); i++) {
+		counted.clear();
+		simplifier.triangulate(i, options.maxError, CHUNK_SIZE + 1, counted);
+		triangles += (long long) counted.size() / 3;
+	}
+	bool ok = writeStlHeader(terrain, file, triangles);
+
+	ExportVertices piece;
+	std::vector<unsigned char> records;
+	for (int i = 0; ok && i < terrain->chunks.count(); i++) {
+		gatherChunk(terrain, simplifier, i, options, piece);
+		records.resize(50 * (piece.triangles.size() / 3));
+		for (size_t k = 0; k < piece.triangles.size(); k += 3)
+			stlRecord(&records[50 * (k / 3)], &piece.positions[3 * piece.triangles[k]], &piece.positions[3 * piece.triangles[k + 1]],
+				&piece.positions[3 * piece.triangles[k + 2]]);
+		ok = records.empty() || fwrite(&records[0], 1, records.size(), file) == records.size();
+	}
+	return ok;
+}
+
+
+/* Writes the header and JSON chunk of a binary glTF 2.0 file describing one indexed triangle mesh, and the header */
+/* of its binary chunk, which then holds positions, normals, colours (RGBA bytes) and 32-bit indices one after another */
+static bool writeGlbHeader (const Terrain *terrain, FILE *file, const ExportOptions &options, uint64_t vertices, uint64_t indices,
+	float lowHeight, float highHeight) {
+	uint64_t positionBytes = 12 * vertices, normalBytes = 12 * vertices, colourBytes = options.colours ? 4 * vertices : 0;
+	uint64_t indexBytes = 4 * indices;
+	uint64_t binaryBytes = positionBytes + normalBytes + colourBytes + indexBytes;
+
+	char json[2048];
+	int jsonLength = snprintf(json, sizeof(json),
+		"{\"asset\":{\"version\":\"2.0\",\"generator\":\"nolanTerrainGen\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+		"\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1%s},\"indices\":2,\"mode\":4}]}],"
+		"\"buffers\":[{\"byteLength\":%llu}],"
+		"\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%llu,\"target\":34962},"
+		"{\"buffer\":0,\"byteOffset\":%llu,\"byteLength\":%llu,\"target\":34962},"
+		"{\"buffer\":0,\"byteOffset\":%llu,\"byteLength\":%llu,\"target\":34963}%s],"
+		"\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\",\"min\":[0,%.9g,0],\"max\":[%d,%.9g,%d]},"
+		"{\"bufferView\":1,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\"},"
+		"{\"bufferView\":2,\"componentType\":5125,\"count\":%llu,\"type\":\"SCALAR\"}%s]}",
+		options.colours ? ",\"COLOR_0\":3" : "",
+		(unsigned long long) binaryBytes, (unsigned long long) positionBytes,
+		(unsigned long long) positionBytes, (unsigned long long) normalBytes,
+		(unsigned long long) (positionBytes + normalBytes + colourBytes), (unsigned long long) indexBytes,
+		options.colours ? ",{\"buffer\":0,\"byteOffset\":-,\"byteLength\":-,\"target\":34962}" : "",
+		(unsigned long long) vertices, lowHeight, (terrain->width - 1) * VERT_SPACING, highHeight, (terrain->depth - 1) * VERT_SPACING,
+		(unsigned long long) vertices, (unsigned long long) indices,
+		options.colours ? ",{\"bufferView\":3,\"componentType\":5121,\"normalized\":true,\"count\":-,\"type\":\"VEC4\"}" : "");
+	std::string text(json, jsonLength);
+	if (options.colours) {
+		// The colour view and accessor numbers are filled in here, snprintf has run out of easy arguments
+		char number[32];
+		snprintf(number, sizeof(number), "%llu", (unsigned long long) (positionBytes + normalBytes));
+		text.replace(text.find("\"byteOffset\":-"), 14, std::string("\"byteOffset\":") + number);
+		snprintf(number, sizeof(number), "%llu", (unsigned long long) colourBytes);
+		text.replace(text.find("\"byteLength\":-"), 14, std::string("\"byteLength\":") + number);
+		snprintf(number, sizeof(number), "%llu", (unsigned long long) vertices);
+		text.replace(text.find("\"count\":-"), 9, std::string("\"count\":") + number);
+	}
+	while (text.size() % 4 != 0)
+		text += ' ';
+
+	// GLB lengths are 32-bit and indices are 32-bit
+	uint64_t totalBytes = 12 + 8 + text.size() + 8 + binaryBytes;
+	if (totalBytes > UINT32_MAX || vertices > UINT32_MAX) {
+		printf("Terrain too large for a .glb file (%.1f GB), export OBJ or STL instead\n", totalBytes / 1e9);
+		return false;
+	}
+	uint32_t header[] = { 0x46546C67, 2, (uint32_t) totalBytes, (uint32_t) text.size(), 0x4E4F534A };	// "glTF", version, length, JSON chunk
+	uint32_t binaryHeader[] = { (uint32_t) binaryBytes, 0x004E4942 };					// BIN chunk
+	return fwrite(header, 4, 5, file) == 5 && fwrite(text.data(), 1, text.size(), file) == text.size()
+		&& fwrite(binaryHeader, 4, 2, file) == 2;
+}
+
+
+/* Writes one of the vertex streams of a .glb file for gathered vertices: 0 positions, 1 normals, 2 colours */
+static bool writeGlbStream (const ExportVertices &vertices, int stream, FILE *file, std::vector<unsigned char> &bytes) {
+	size_t count = vertices.heights.size();
+	if (count == 0)
+		return true;
+	if (stream == 0)
+		return fwrite(&vertices.positions[0], sizeof(float), 3 * count, file) == 3 * count;
+	if (stream == 1)
+		return fwrite(&vertices.normals[0], sizeof(float), 3 * count, file) == 3 * count;
+
+	bytes.resize(4 * count);
+	for (size_t i = 0; i < count; i++) {
+		for (int channel = 0; channel < 3; channel++)
+			bytes[4 * i + channel] = (unsigned char) (vertices.colours[3 * i + channel] * 255 + 0.5f);
+		bytes[4 * i + 3] = 255;
+	}
+	return fwrite(&bytes[0], 1, bytes.size(), file) == bytes.size();
+}
+
+
+/* Binary glTF 2.0 of the grid, each stream written row by row */
+static bool exportGlb (const Terrain *terrain, FILE *file, const ExportOptions &options) {
+	bool ok = writeGlbHeader(terrain, file, options, (uint64_t) terrain->width * terrain->depth, 6ULL * (terrain->width - 1) * (terrain->depth - 1),
+		terrain->minHeight, terrain->maxHeight);
+
+	// Positions, normals and colours, each a pass over the rows
+	ExportVertices row;
+	std::vector<unsigned char> bytes;
+	for (int stream = 0; ok && stream < (options.colours ? 3 : 2); stream++) {
+		for (int z = 0; ok && z < terrain->depth; z++) {
+			gatherRow(terrain, z, options, row);
+			ok = writeGlbStream(row, stream, file, bytes);
+		}
+	}
+
+	// Indices, one row of cells at a time
+	std::vector<uint32_t> cells(6 * (size_t) (terrain->width - 1));
+	for (int z = 0; ok && z + 1 < terrain->depth; z++) {
+		uint32_t above = (uint32_t) z * terrain->width, below = above + terrain->width;
+		for (int x = 0; x + 1 < terrain->width; x++) {
+			uint32_t *cell = &cells[6 * x];
+			cell[0] = above + x; cell[1] = below + x; cell[2] = above + x + 1;
+			cell[3] = above + x + 1; cell[4] = below + x; cell[5] = below + x + 1;
+		}
+		ok = fwrite(&cells[0], sizeof(uint32_t), cells.size(), file) == cells.size();
+	}
+	return ok;
+}
+
+
+/* Binary glTF 2.0 of the simplified mesh, each stream written a chunk at a time after a pass counting */
+/* the vertices and triangles and finding the height range of the vertices kept */
+static bool exportSimplifiedGlb (const Terrain *terrain, const TerrainSimplifier &simplifier, FILE *file, const ExportOptions &options) {
+	ExportOptions counting = options;
+	counting.colours = false;
+	ExportVertices piece;
+	uint64_t vertices = 0, indices = 0;
+	float lowHeight = terrain->maxHeight, highHeight = terrain->minHeight;
+	for (int i = 0; i < terrain->chunks.count(); i++) {
+		gatherChunk(terrain, simplifier, i, counting, piece);
+		vertices += piece.heights.size();
+		indices += piece.triangles.size();
+		for (size_t k = 0; k < piece.heights.size(); k++) {
+			lowHeight = std::min(lowHeight, piece.heights[k]);
+			highHeight = std::max(highHeight, piece.heights[k]);
+		}
+	}
+	bool ok = writeGlbHeader(terrain, file, options, vertices, indices, lowHeight, highHeight);
+
+	std::vector<unsigned char> bytes;
+	for (int stream = 0; ok && stream < (options.colours ? 3 : 2); stream++) {
+		for (int i = 0; ok && i < terrain->chunks.count(); i++) {
+			gatherChunk(terrain, simplifier, i, stream == 2 ? options : counting, piece);
+			ok = writeGlbStream(piece, stream, file, bytes);
+		}
+	}
+
+	// Indices, numbered on from the vertices of the chunks before
+	uint32_t first = 0;
+	for (int i = 0; ok && i < terrain->chunks.count(); i++) {
+		gatherChunk(terrain, simplifier, i, counting, piece);
+		for (size_t k = 0; k < piece.triangles.size(); k++)
+			piece.triangles[k] += first;
+		first += (uint32_t) piece.heights.size();
+		ok = piece.triangles.empty() || fwrite(&piece.triangles[0], sizeof(uint32_t), piece.triangles.size(), file) == piece.triangles.size();
+	}
+	return ok;
+}
+
+
+/* Picks the format from a file name: .obj, .stl or .glb, 0 for anything else */
+char exportFormatForPath (const char *path) {
+	const char *dot = strrchr(path, '.');
+	if (!dot)
+		return 0;
+	if (strcmp(dot, ".obj") == 0)
+		return 'o';
+	if (strcmp(dot, ".stl") == 0)
+		return 's';
+	if (strcmp(dot, ".glb") == 0)
+		return 'g';
+	return 0;
+}
+
+
+/* Writes the terrain as a mesh straight from the chunks, holding at most two rows of vertices at a time */
+/* A simplified mesh also needs the simplifier's error for every vertex, 4 bytes each */
+bool exportTerrainMesh (const Terrain *terrain, const char *path, const ExportOptions &options) {
+	if (terrain->width < 2 || terrain->depth < 2)
+		return false;
+	FILE *file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	bool ok = false;
+	if (options.maxError >= 0) {
+		TerrainSimplifier simplifier;
+		simplifier.build(terrain);
+		if (options.format == 'o')
+			ok = exportSimplifiedObj(terrain, simplifier, file, options);
+		else if (options.format == 's')
+			ok = exportSimplifiedStl(terrain, simplifier, file, options);
+		else if (options.format == 'g')
+			ok = exportSimplifiedGlb(terrain, simplifier, file, options);
+	} else if (options.format == 'o') {
+		ok = exportObj(terrain, file, options);
+	} else if (options.format == 's') {
+		ok = exportStl(terrain, file);
+	} else if (options.format == 'g') {
+		ok = exportGlb(terrain, file, options);
+	}
+
+	if (fclose(file) != 0)
+		ok = false;
+	return ok;
+}
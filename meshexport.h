@@ -0,0 +1,22 @@
+/*
+Nolan Slade
+Terrain Generator - mesh export
+*/
+
+#ifndef MESHEXPORT_H
+#define MESHEXPORT_H
+
+#include "terrain.h"
+
+/* What to write and how, see exportTerrainMesh */
+struct ExportOptions {
+	char format;				// 'o' Wavefront OBJ, 's' binary STL, 'g' binary glTF (.glb)
+	char stripMode;				// Normals of the triangle-strip ('t') or quad-strip ('y') renderer
+	bool colours;				// Topographic vertex colours (OBJ and glTF only)
+	float maxError;				// Negative writes every cell, otherwise the simplified mesh within this height error
+};
+
+char exportFormatForPath (const char *path);
+bool exportTerrainMesh (const Terrain *terrain, const char *path, const ExportOptions &options);
+
+#endif
@@ -0,0 +1,356 @@
+/*
+Nolan Slade
+Terrain Generator - gradient noise and diamond-square generators
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+// The AVX2 kernel is compiled for that instruction set alone and only run once the processor is known to have it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define NOISE_AVX2
+#  include <immintrin.h>
+#endif
+
+#include "noise.h"
+#include "threadpool.h"
+#include "trace.h"
+
+#define NOISE_ROWS	16		// Rows of noise handed to a worker thread at a time
+#define NOISE_AMPLITUDE	0.4f		// Height of an octave per vertex of its feature size
+#define NOISE_OCTAVES	24		// Most octaves summed, far more than the largest terrain needs to reach 2 vertices
+#define DS_AMPLITUDE	0.4f		// Largest diamond-square displacement per vertex of the square's side
+
+bool noiseVectorized = true;
+
+// Gradients of the lattice points, eight directions 45 degrees apart
+static const float gradientX[8] = { 1, 0.70710678f, 0, -0.70710678f, -1, -0.70710678f, 0, 0.70710678f };
+static const float gradientZ[8] = { 0, 0.70710678f, 1, 0.70710678f, 0, -0.70710678f, -1, -0.70710678f };
+
+#define LATTICE_X	0x9E3779B1u	// Multipliers folding a lattice point's coordinates into its hash
+#define LATTICE_Z	0x85EBCA77u
+
+
+/* Scrambles all 32 bits of its input (lowbias32), cheap enough to run on every lattice corner */
+static inline unsigned int hashBits (unsigned int h) {
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	h *= 0x846CA68Bu;
+	h ^= h >> 16;
+	return h;
+}
+
+
+/* Random bits of point (x, z) for a seed, a pure function like the counters of random.h */
+static inline unsigned int hashLattice (unsigned int seed, int x, int z) {
+	return hashBits((unsigned int) x * LATTICE_X + (unsigned int) z * LATTICE_Z + seed);
+}
+
+
+/* Size in vertices of the largest features, so that there are about complexity of them over the terrain as with the circles */
+static float featureSize (const Terrain *terrain) {
+	return (float) sqrt((double) terrain->width * terrain->depth / terrain->complexity);
+}
+
+
+/* Smooth step from 0 to 1 with no change of slope or curvature at either end */
+static inline float fade (float t) {
+	return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+
+/* One octave of the noise */
+struct NoiseOctave {
+	unsigned int seed;
+	float frequency;			// Lattice cells per vertex
+	float amplitude;
+	float offsetX, offsetZ;			// Where vertex (0, 0) falls in the lattice, so that the octaves' lattices do not line up
+};
+
+
+/* What the cells of one row of an octave share */
+struct NoiseRow {
+	unsigned int seedBack, seedFront;	// Seed with the lattice rows behind and in front of the row folded in
+	float tz, tzFront;			// Offset of the row from those lattice rows
+	float v;				// Fade across the lattice cell
+};
+
+
+static NoiseRow octaveRow (const NoiseOctave &octave, int z) {
+	NoiseRow row;
+	float fz = (float) z * octave.frequency + octave.offsetZ;
+	float floorZ = floorf(fz);
+	int iz = (int) floorZ;
+	row.seedBack = (unsigned int) iz * LATTICE_Z + octave.seed;
+	row.seedFront = row.seedBack + LATTICE_Z;
+	row.tz = fz - floorZ;
+	row.tzFront = row.tz - 1;
+	row.v = fade(row.tz);
+	return row;
+}
+
+
+/* Adds count cells of one octave to out, from vertex x of the row */
+/* Each cell blends the gradients of the four lattice corners around it, weighted by how close it is to each */
+static void addOctaveScalar (const NoiseOctave &octave, const NoiseRow &row, int x, int count, float *out) {
+	for (int k = 0; k < count; k++) {
+		float fx = (float) (x + k) * octave.frequency + octave.offsetX;
+		float floorX = floorf(fx);
+		unsigned int ix = (unsigned int) (int) floorX * LATTICE_X;
+		float tx = fx - floorX, txRight = tx - 1;
+		float u = fade(tx);
+
+		unsigned int h00 = hashBits(ix + row.seedBack) & 7, h10 = hashBits(ix + LATTICE_X + row.seedBack) & 7;
+		unsigned int h01 = hashBits(ix + row.seedFront) & 7, h11 = hashBits(ix + LATTICE_X + row.seedFront) & 7;
+		float n00 = gradientX[h00] * tx + gradientZ[h00] * row.tz;
+		float n10 = gradientX[h10] * txRight + gradientZ[h10] * row.tz;
+		float n01 = gradientX[h01] * tx + gradientZ[h01] * row.tzFront;
+		float n11 = gradientX[h11] * txRight + gradientZ[h11] * row.tzFront;
+
+		float back = n00 + u * (n10 - n00);
+		float front = n01 + u * (n11 - n01);
+		out[k] += octave.amplitude * (back + row.v * (front - back));
+	}
+}
+
+
+#ifdef NOISE_AVX2
+
+/* hashBits on 8 lanes */
+__attribute__((target("avx2")))
+static inline __m256i hashBitsAvx2 (__m256i h) {
+	h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+	h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int) 0x7FEB352Du));
+	h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+	h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int) 0x846CA68Bu));
+	return _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+}
+
+
+/* fade on 8 lanes */
+__attribute__((target("avx2")))
+static inline __m256 fadeAvx2 (__m256 t) {
+	__m256 inner = _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6)), _mm256_set1_ps(15))), _mm256_set1_ps(10));
+	return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+}
+
+
+/* Gradient of lattice corners h dotted with the offset (tx, tz) from them, on 8 lanes */
+__attribute__((target("avx2")))
+static inline __m256 cornerAvx2 (__m256i h, __m256 tx, __m256 tz) {
+	__m256i index = _mm256_and_si256(h, _mm256_set1_epi32(7));
+	__m256 gx = _mm256_permutevar8x32_ps(_mm256_loadu_ps(gradientX), index);
+	__m256 gz = _mm256_permutevar8x32_ps(_mm256_loadu_ps(gradientZ), index);
+	return _mm256_add_ps(_mm256_mul_ps(gx, tx), _mm256_mul_ps(gz, tz));
+}
+
+
+/* addOctaveScalar on 8 cells at a time, with the same operations in the same order so that the sums match it bit for bit */
+/* count must be a multiple of 8 */
+__attribute__((target("avx2")))
+static void addOctaveAvx2 (const NoiseOctave &octave, const NoiseRow &row, int x, int count, float *out) {
+	const __m256 frequency = _mm256_set1_ps(octave.frequency), offsetX = _mm256_set1_ps(octave.offsetX);
+	const __m256 amplitude = _mm256_set1_ps(octave.amplitude), one = _mm256_set1_ps(1);
+	const __m256 tz = _mm256_set1_ps(row.tz), tzFront = _mm256_set1_ps(row.tzFront), v = _mm256_set1_ps(row.v);
+	const __m256i seedBack = _mm256_set1_epi32((int) row.seedBack), seedFront = _mm256_set1_epi32((int) row.seedFront);
+	const __m256i latticeX = _mm256_set1_epi32((int) LATTICE_X), lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	for (int k = 0; k < count; k += 8) {
+		__m256 fx = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x + k), lanes)), frequency), offsetX);
+		__m256 floorX = _mm256_floor_ps(fx);
+		__m256i ix = _mm256_mullo_epi32(_mm256_cvttps_epi32(floorX), latticeX);
+		__m256i ixRight = _mm256_add_epi32(ix, latticeX);
+		__m256 tx = _mm256_sub_ps(fx, floorX), txRight = _mm256_sub_ps(tx, one);
+		__m256 u = fadeAvx2(tx);
+
+		__m256 n00 = cornerAvx2(hashBitsAvx2(_mm256_add_epi32(ix, seedBack)), tx, tz);
+		__m256 n10 = cornerAvx2(hashBitsAvx2(_mm256_add_epi32(ixRight, seedBack)), txRight, tz);
+		__m256 n01 = cornerAvx2(hashBitsAvx2(_mm256_add_epi32(ix, seedFront)), tx, tzFront);
+		__m256 n11 = cornerAvx2(hashBitsAvx2(_mm256_add_epi32(ixRight, seedFront)), txRight, tzFront);
+
+		__m256 back = _mm256_add_ps(n00, _mm256_mul_ps(u, _mm256_sub_ps(n10, n00)));
+		__m256 front = _mm256_add_ps(n01, _mm256_mul_ps(u, _mm256_sub_ps(n11, n01)));
+		__m256 noise = _mm256_mul_ps(amplitude, _mm256_add_ps(back, _mm256_mul_ps(v, _mm256_sub_ps(front, back))));
+		_mm256_storeu_ps(out + k, _mm256_add_ps(_mm256_loadu_ps(out + k), noise));
+	}
+}
+
+
+/* True if the processor runs AVX2, checked once */
+static bool hasAvx2 () {
+	static const bool supported = __builtin_cpu_supports("avx2");
+	return supported;
+}
+
+#else
+
+static bool hasAvx2 () {
+	return false;
+}
+
+#endif
+
+
+const char *noiseKernel () {
+	return noiseVectorized && hasAvx2() ? "AVX2" : "scalar";
+}
+
+
+void raiseNoise (Terrain *terrain) {
+	TRACE_ZONE("noise");
+	if (terrain->complexity <= 0)
+		return;
+
+	// Octaves from the feature size down to 2 vertices, each with its own lattice
+	std::vector<NoiseOctave> octaves;
+	float size = featureSize(terrain);
+	for (int o = 0; o < NOISE_OCTAVES && size >= 2; o++, size /= 2) {
+		NoiseOctave octave;
+		octave.seed = hashLattice(terrain->seed, o, 0);
+		octave.frequency = 1 / size;
+		octave.amplitude = NOISE_AMPLITUDE * size;
+		unsigned int offset = hashBits(octave.seed);
+		octave.offsetX = (offset & 0xFFFF) / 65536.0f;
+		octave.offsetZ = (offset >> 16) / 65536.0f;
+		octaves.push_back(octave);
+	}
+
+	// Rows are independent, and each chunk's run of a row takes every octave while it is in cache
+	bool vectorized = noiseVectorized && hasAvx2();
+	parallelFor(terrain->depth, NOISE_ROWS, [terrain, &octaves, vectorized](int firstRow, int lastRow) {
+		TRACE_ZONE("noise rows");
+		std::vector<NoiseRow> rows(octaves.size());
+		for (int z = firstRow; z < lastRow; z++) {
+			for (size_t o = 0; o < octaves.size(); o++)
+				rows[o] = octaveRow(octaves[o], z);
+			for (int cx = 0; cx < terrain->chunks.chunksX(); cx++) {
+				TerrainChunk &chunk = terrain->chunks.chunk(cx, z >> CHUNK_SHIFT);
+				float *heights = chunk.field.heightRow(z - chunk.z0);
+				int width = chunk.field.width();
+				int vectorWidth = vectorized ? width & ~7 : 0;
+				for (size_t o = 0; o < octaves.size(); o++) {
+#ifdef NOISE_AVX2
+					if (vectorWidth)
+						addOctaveAvx2(octaves[o], rows[o], chunk.x0, vectorWidth, heights);
+#endif
+					addOctaveScalar(octaves[o], rows[o], chunk.x0 + vectorWidth, width - vectorWidth, heights + vectorWidth);
+				}
+			}
+		}
+	});
+}
+
+
+/* Displacement of diamond-square point (x, z), from -1 to 1 */
+static inline float displacement (unsigned int seed, int x, int z) {
+	return (float) (hashLattice(seed, x, z) >> 8) * (2.0f / 16777216) - 1;
+}
+
+
+/* Largest displacement of a point made in a square of the given side, none for squares bigger than the features */
+/* so that, as with the noise octaves, nothing larger than the features varies */
+static inline float squareAmplitude (float featureSize, int side) {
+	return side <= featureSize ? DS_AMPLITUDE * side : 0;
+}
+
+
+/* Fills the (CHUNK_SIZE + 1) squared points of a chunk's square, whose corners are already set, by diamond-square */
+/* (x0, z0) is the chunk's first vertex; points on the square's edges only use the two ends of their side */
+static void fillChunkSquare (unsigned int seed, float featureSize, int x0, int z0, float *square) {
+	const int n = CHUNK_SIZE, stride = CHUNK_SIZE + 1;
+	for (int half = n / 2; half >= 1; half /= 2) {
+		float amplitude = squareAmplitude(featureSize, 2 * half);
+
+		// Diamond step: the centre of every square takes the average of its corners
+		for (int z = half; z < n; z += 2 * half) {
+			float *row = square + z * stride;
+			for (int x = half; x < n; x += 2 * half) {
+				float average = (row[x - half - half * stride] + row[x + half - half * stride] + row[x - half + half * stride] + row[x + half + half * stride]) * 0.25f;
+				row[x] = average + displacement(seed, x0 + x, z0 + z) * amplitude;
+			}
+		}
+
+		// Square step: the middle of every side takes the average of its ends and of the centres on either side
+		for (int z = 0; z <= n; z += half) {
+			float *row = square + z * stride;
+			for (int x = (z / half) % 2 ? 0 : half; x <= n; x += 2 * half) {
+				float average;
+				if (z == 0 || z == n)
+					average = (row[x - half] + row[x + half]) * 0.5f;
+				else if (x == 0 || x == n)
+					average = (row[x - half * stride] + row[x + half * stride]) * 0.5f;
+				else
+					average = (row[x - half] + row[x + half] + row[x - half * stride] + row[x + half * stride]) * 0.25f;
+				row[x] = average + displacement(seed, x0 + x, z0 + z) * amplitude;
+			}
+		}
+	}
+}
+
+
+void raiseDiamondSquare (Terrain *terrain) {
+	TRACE_ZONE("diamond-square");
+	if (terrain->complexity <= 0)
+		return;
+	unsigned int seed = hashLattice(terrain->seed, -1, -1);
+	float size = featureSize(terrain);
+
+	// Corners of the chunks by diamond-square over a grid of one point per chunk, a power of two of chunks across
+	int coarse = 1;
+	while (coarse < std::max(terrain->chunks.chunksX(), terrain->chunks.chunksZ()))
+		coarse *= 2;
+	int stride = coarse + 1;
+	std::vector<float> corners((size_t) stride * stride);
+	for (int z = 0; z <= coarse; z += coarse)
+		for (int x = 0; x <= coarse; x += coarse)
+			corners[(size_t) z * stride + x] = displacement(seed, x * CHUNK_SIZE, z * CHUNK_SIZE) * squareAmplitude(size, coarse * CHUNK_SIZE);
+
+	for (int half = coarse / 2; half >= 1; half /= 2) {
+		float amplitude = squareAmplitude(size, 2 * half * CHUNK_SIZE);
+		for (int z = half; z < coarse; z += 2 * half) {
+			for (int x = half; x < coarse; x += 2 * half) {
+				float average = (corners[(size_t) (z - half) * stride + x - half] + corners[(size_t) (z - half) * stride + x + half]
+					+ corners[(size_t) (z + half) * stride + x - half] + corners[(size_t) (z + half) * stride + x + half]) * 0.25f;
+				corners[(size_t) z * stride + x] = average + displacement(seed, x * CHUNK_SIZE, z * CHUNK_SIZE) * amplitude;
+			}
+		}
+
+		// Points on the edge of the grid have three neighbours
+		for (int z = 0; z <= coarse; z += half) {
+			for (int x = (z / half) % 2 ? 0 : half; x <= coarse; x += 2 * half) {
+				float sum = 0;
+				int count = 0;
+				if (x >= half) { sum += corners[(size_t) z * stride + x - half]; count++; }
+				if (x + half <= coarse) { sum += corners[(size_t) z * stride + x + half]; count++; }
+				if (z >= half) { sum += corners[(size_t) (z - half) * stride + x]; count++; }
+				if (z + half <= coarse) { sum += corners[(size_t) (z + half) * stride + x]; count++; }
+				corners[(size_t) z * stride + x] = sum / count + displacement(seed, x * CHUNK_SIZE, z * CHUNK_SIZE) * amplitude;
+			}
+		}
+	}
+
+	// Every chunk fills in its own square from its corners, the points past the terrain's edge are worked out and dropped
+	parallelFor(terrain->chunks.count(), 1, [terrain, &corners, stride, seed, size](int firstChunk, int lastChunk) {
+		TRACE_ZONE("diamond-square chunks");
+		std::vector<float> square((CHUNK_SIZE + 1) * (CHUNK_SIZE + 1));
+		for (int i = firstChunk; i < lastChunk; i++) {
+			TerrainChunk &chunk = terrain->chunks.chunk(i);
+			int cx = chunk.x0 >> CHUNK_SHIFT, cz = chunk.z0 >> CHUNK_SHIFT;
+			square[0] = corners[(size_t) cz * stride + cx];
+			square[CHUNK_SIZE] = corners[(size_t) cz * stride + cx + 1];
+			square[CHUNK_SIZE * (CHUNK_SIZE + 1)] = corners[(size_t) (cz + 1) * stride + cx];
+			square[CHUNK_SIZE * (CHUNK_SIZE + 1) + CHUNK_SIZE] = corners[(size_t) (cz + 1) * stride + cx + 1];
+			fillChunkSquare(seed, size, chunk.x0, chunk.z0, &square[0]);
+
+			for (int z = 0; z < chunk.field.depth(); z++) {
+				float *heights = chunk.field.heightRow(z);
+				const float *row = &square[z * (CHUNK_SIZE + 1)];
+				for (int x = 0; x < chunk.field.width(); x++)
+					heights[x] += row[x];
+			}
+		}
+	});
+}
@@ -0,0 +1,27 @@
+/*
+Nolan Slade
+Terrain Generator - gradient noise and diamond-square generators
+*/
+
+#ifndef NOISE_H
+#define NOISE_H
+
+#include "terrain.h"
+
+extern bool noiseVectorized;			// Use the AVX2 noise kernel when the processor has it (default), false forces the scalar one
+
+/* Adds fractal gradient noise (fBm) to the heights: octaves of 2D gradient noise, each at twice the frequency and half */
+/* the amplitude of the one before, from features sqrt(width * depth / complexity) vertices across down to 2 vertices */
+/* Cells are evaluated 8 at a time with AVX2 where available; the scalar kernel gives bit-identical heights */
+void raiseNoise (Terrain *terrain);
+
+/* Adds diamond-square midpoint displacement to the heights, with features of the same size as raiseNoise */
+/* The chunk corners come from diamond-square over a coarse grid of one point per chunk; each chunk then fills itself */
+/* in from its corners, so chunks are independent of each other. Points along chunk edges are displaced from the two */
+/* ends of their edge only, so that the chunks on both sides work them out the same */
+void raiseDiamondSquare (Terrain *terrain);
+
+/* Name of the noise kernel raiseNoise runs on this machine */
+const char *noiseKernel ();
+
+#endif
@@ -0,0 +1,39 @@
+/*
+Nolan Slade
+Terrain Generator
+*/
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+/* Counter-based random numbers: every value is a pure function of (seed, iteration, counter) */
+/* There is no hidden state, so any iteration or cell can be evaluated on any thread, in any order, */
+/* and a given seed always produces bit-identical terrain */
+
+/* SplitMix64 finalizer, scrambles all 64 bits of its input */
+static inline unsigned long long mixBits (unsigned long long z) {
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+
+/* Returns 64 random bits for the given counter of one iteration of the algorithm */
+static inline unsigned long long counterRandom (unsigned long long seed, unsigned long long iteration, unsigned long long counter) {
+	unsigned long long stream = mixBits(seed * 0x9E3779B97F4A7C15ULL + iteration);
+	return mixBits(stream + (counter + 1) * 0x9E3779B97F4A7C15ULL);
+}
+
+
+/* Returns a random integer from 0 to range - 1 for the given counter of one iteration */
+static inline int counterRange (unsigned long long seed, unsigned long long iteration, unsigned long long counter, int range) {
+	return (int) (((counterRandom(seed, iteration, counter) >> 32) * (unsigned long long) range) >> 32);
+}
+
+
+/* Counter for a cell of the terrain, kept clear of the small counters used for per-iteration values */
+static inline unsigned long long cellCounter (int x, int z) {
+	return 0x8000000000000000ULL | (unsigned long long) (unsigned int) x << 32 | (unsigned int) z;
+}
+
+#endif
@@ -0,0 +1,315 @@
+/*
+Nolan Slade
+Terrain Generator - headless render check
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glu.h>
+
+#include "terrain.h"
+#include "renderer.h"
+#include "compact.h"
+#include "lod.h"
+#include "frametimer.h"
+
+#define VIEW_SIZE	600		// Same as the window of the viewer
+#define TIMED_FRAMES	50		// Frames drawn per path when timing
+#define WIRE_TIE_PIXELS	16		// Wireframe pixels allowed to differ: lines shared by two triangles tie in depth,
+					// and which triangle wins depends on the order chunks are drawn in
+#define SIMPLIFY_ERROR	2.0f		// Height error of the simplified mesh, the viewer's default
+#define COMPACT_LEVELS	8		// Colour levels a compact pixel may be off by before it counts as visibly different
+
+ChunkVisibility lastVisibility;		// Chunks in view for the last frame drawn
+
+
+/* Creates an offscreen GL context with EGL, preferring the surfaceless Mesa platform so no display is needed */
+/* Run with LIBGL_ALWAYS_SOFTWARE=1 to force llvmpipe */
+bool createContext () {
+	EGLDisplay display = EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0)) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		if (!eglInitialize(display, 0, 0))
+			return false;
+	}
+
+	EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 24, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config;
+	EGLint configs = 0;
+	if (!eglChooseConfig(display, configAttributes, &config, 1, &configs) || configs < 1)
+		return false;
+
+	EGLint surfaceAttributes[] = { EGL_WIDTH, VIEW_SIZE, EGL_HEIGHT, VIEW_SIZE, EGL_NONE };
+	EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+	eglBindAPI(EGL_OPENGL_API);
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, 0);
+	return surface != EGL_NO_SURFACE && context != EGL_NO_CONTEXT && eglMakeCurrent(display, surface, surface, context);
+}
+
+
+/* Sets up the same lights, camera and culling as the viewer, with the terrain turned by the arrow key rotations */
+void setupView (const Terrain *terrain, bool lighting, float rotationX, float rotationY) {
+	float amb0[4] = { 0.2, 0.2, 1, 1 }, diff0[4] = { 0, 0, 1, 1 }, spec0[4] = { 0.5, 0.5, 1, 1 };
+	float amb1[4] = { 0.2, 1, 0.2, 1 }, diff1[4] = { 0, 1, 0, 1 }, spec1[4] = { 0.5, 1, 0.5, 1 };
+	float light0[] = { 0, terrain->maxHeight + 50, 0, 1 };
+	float light1[] = { (float) (terrain->width * VERT_SPACING), terrain->maxHeight + 50, (float) (terrain->depth * VERT_SPACING), 1 };
+
+	glViewport(0, 0, VIEW_SIZE, VIEW_SIZE);
+	glClearColor(0, 0, 0, 0);
+	glEnable(GL_DEPTH_TEST);
+	glFrontFace(GL_CCW);
+	glCullFace(GL_BACK);
+	glEnable(GL_CULL_FACE);
+	glShadeModel(GL_FLAT);
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	gluPerspective(45, 1, 1, 10000);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	gluLookAt(-110, terrain->maxHeight + 100, -110, terrain->width / 2.0f, terrain->maxHeight + terrain->minHeight / 2, terrain->depth / 2.0f, 0, 1, 0);
+	glRotatef(rotationX, 1, 0, 0);
+	glRotatef(rotationY, 0, 1, 0);
+	glTranslatef(-1*(terrain->width*VERT_SPACING)/2,0,-1*(terrain->depth*VERT_SPACING)/2);
+
+	if (lighting) {
+		glEnable(GL_LIGHTING);
+		glEnable(GL_LIGHT0);
+		glEnable(GL_LIGHT1);
+		glLightfv(GL_LIGHT0, GL_AMBIENT, amb0); glLightfv(GL_LIGHT0, GL_DIFFUSE, diff0); glLightfv(GL_LIGHT0, GL_SPECULAR, spec0);
+		glLightfv(GL_LIGHT1, GL_AMBIENT, amb1); glLightfv(GL_LIGHT1, GL_DIFFUSE, diff1); glLightfv(GL_LIGHT1, GL_SPECULAR, spec1);
+		glLightfv(GL_LIGHT0, GL_POSITION, light0);
+		glLightfv(GL_LIGHT1, GL_POSITION, light1);
+	} else {
+		glDisable(GL_LIGHTING);
+	}
+}
+
+
+/* Draws one frame the way display() does, with the buffered path, the immediate path ('i'), level of detail ('l') */
+/* or the simplified mesh ('s'). The buffered paths skip the chunks outside the view, as in the viewer */
+void drawFrame (TerrainMesh *mesh, TerrainLod *lod, const Terrain *terrain, const TerrainStyle &style, char path) {
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	mesh->simplifyError = path == 's' ? SIMPLIFY_ERROR : -1;
+	cullTerrainChunks(terrain, &lastVisibility);
+	char passes[2] = { style.wireFrameMode == 'w' ? 'w' : 'n', 'w' };
+	int passCount = style.wireFrameMode == 'b' ? 2 : 1;
+	for (int p = 0; p < passCount; p++) {
+		if (path == 'i')
+			drawTerrainImmediate(terrain, style, passes[p]);
+		else if (path == 'l')
+			drawTerrainLod(lod, terrain, style, passes[p]);
+		else
+			drawTerrainMesh(mesh, terrain, style, passes[p], &lastVisibility);
+	}
+	glFinish();
+}
+
+
+/* Main Method */
+int main (int argc, char** argv) {
+	int width = 300, depth = 300;
+	bool compareViews = true;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-s") == 0 && i + 1 < argc && sscanf(argv[i + 1], "%d,%d", &width, &depth) == 2 && width >= 2 && depth >= 2) {
+			i++;
+		} else if (strcmp(argv[i], "-t") == 0) {
+			compareViews = false;
+		} else {
+			printf("Usage: %s [-s width,depth] [-t]\n", argv[0]);
+			printf("Draws every view mode with the buffered renderer and the immediate reference and compares the pixels\n");
+			printf("-t skips the comparison and only times the circles terrain, for sizes where the immediate path is slow\n");
+			return 1;
+		}
+	}
+
+	if (!createContext()) {
+		printf("Could not create an offscreen GL context\n");
+		return 1;
+	}
+	printf("Renderer: %s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+	terrainVerbose = false;
+	Terrain terrain;
+	initTerrain(&terrain, width, depth);
+	terrain.complexity = 1000;
+	seedTerrain(&terrain, 1);
+
+	TerrainMesh mesh;
+	initTerrainMesh(&mesh);
+	TerrainLod lod;
+	initTerrainLod(&lod);
+
+	std::vector<unsigned char> reference(3 * VIEW_SIZE * VIEW_SIZE), buffered(reference.size());
+	const char algorithms[] = { 'c', 'f', 'd', 'n', 's' };
+	const char strips[] = { 't', 'y' };
+	const char wireFrames[] = { 's', 'w', 'b' };
+	int failures = 0;
+
+	if (compareViews)
+		printf("alg\tstrip\twire\ttopo\tlight\tdiffering pixels\n");
+	for (int a = 0; a < (compareViews ? 5 : 1); a++) {
+		terrain.algorithm = algorithms[a];
+		generateHeightValues(&terrain, true);
+		generateHeightValues(&terrain, false);
+		setNormals(&terrain);
+		markTerrainMeshDirty(&mesh);
+		if (!compareViews)
+			continue;
+
+		for (int s = 0; s < 2; s++) {
+			for (int w = 0; w < 3; w++) {
+				for (int mode = 0; mode < 3; mode++) {
+					// Lit, unlit grayscale and unlit topographic, as reachable with 'L' and 'T'
+					bool lighting = mode == 0;
+					TerrainStyle style = { strips[s], wireFrames[w], mode == 2 };
+					setupView(&terrain, lighting, 30, 20);
+
+					drawFrame(&mesh, &lod, &terrain, style, 'i');
+					glReadPixels(0, 0, VIEW_SIZE, VIEW_SIZE, GL_RGB, GL_UNSIGNED_BYTE, &reference[0]);
+					drawFrame(&mesh, &lod, &terrain, style, 'b');
+					glReadPixels(0, 0, VIEW_SIZE, VIEW_SIZE, GL_RGB, GL_UNSIGNED_BYTE, &buffered[0]);
+
+					int differing = 0;
+					for (size_t p = 0; p < reference.size(); p += 3)
+						if (memcmp(&reference[p], &buffered[p], 3) != 0)
+							differing++;
+					if (differing > (style.wireFrameMode == 's' ? 0 : WIRE_TIE_PIXELS))
+						failures++;
+					printf("%c\t%c\t%c\t%d\t%d\t%d\n", algorithms[a], strips[s], wireFrames[w], mode == 2, lighting, differing);
+				}
+			}
+		}
+	}
+
+	// Culling must not change the picture, whichever way the terrain is turned
+	const float rotations[][2] = { { 30, 20 }, { 0, 90 }, { 0, 200 }, { 60, 300 }, { -40, 135 } };
+	if (compareViews)
+		printf("rotation\tchunks drawn\tculled\tdiffering pixels\n");
+	for (int r = 0; compareViews && r < 5; r++) {
+		TerrainStyle style = { 't', 's', false };
+		setupView(&terrain, true, rotations[r][0], rotations[r][1]);
+		drawFrame(&mesh, &lod, &terrain, style, 'i');
+		glReadPixels(0, 0, VIEW_SIZE, VIEW_SIZE, GL_RGB, GL_UNSIGNED_BYTE, &reference[0]);
+		drawFrame(&mesh, &lod, &terrain, style, 'b');
+		glReadPixels(0, 0, VIEW_SIZE, VIEW_SIZE, GL_RGB, GL_UNSIGNED_BYTE, &buffered[0]);
+
+		int differing = 0;
+		for (size_t p = 0; p < reference.size(); p += 3)
+			if (memcmp(&reference[p], &buffered[p], 3) != 0)
+				differing++;
+		if (differing > 0)
+			failures++;
+		printf("%g,%g\t\t%d\t\t%d\t%d\n", rotations[r][0], rotations[r][1], lastVisibility.drawn, lastVisibility.culled, differing);
+	}
+
+	// Per frame cost of every path once the buffers are up to date
+	TerrainStyle timed = { 't', 's', false };
+	const char paths[] = { 'b', 'i', 'l', 's' };
+	const char *pathNames[] = { "Buffered path", "Immediate path", "Level of detail", "Simplified mesh" };
+	setupView(&terrain, true, 30, 20);
+	markTerrainLodDirty(&lod);
+	for (int p = 0; p < 4; p++) {
+		FrameTimer frames;
+		resetFrameTimer(&frames);
+		drawFrame(&mesh, &lod, &terrain, timed, paths[p]);
+		for (int f = 0; f < TIMED_FRAMES; f++) {
+			double start = frameClock();
+			drawFrame(&mesh, &lod, &terrain, timed, paths[p]);
+			recordFrame(&frames, frameClock() - start);
+		}
+		printFrameTimer(&frames, pathNames[p]);
+	}
+
+	// Level of detail and the simplified mesh are approximations, so their difference from full detail is reported but never fails the check
+	drawFrame(&mesh, &lod, &terrain, timed, 'b');
+	glReadPixels(0, 0, VIEW_SIZE, VIEW_SIZE, GL_RGB, GL_UNSIGNED_BYTE, &reference[0]);
+	long long fullTriangles = mesh.trianglesDrawn;
+	for (int p = 0; p < 2; p++) {
+		drawFrame(&mesh, &lod, &terrain, timed, p == 0 ? 'l' : 's');
+		glReadPixels(0, 0, VIEW_SIZE, VIEW_SIZE, GL_RGB, GL_UNSIGNED_BYTE, &buffered[0]);
+		int differing = 0;
+		for (size_t i = 0; i < reference.size(); i += 3)
+			if (memcmp(&reference[i], &buffered[i], 3) != 0)
+				differing++;
+		if (p == 0)
+			printf("Level of detail: %d of %lld vertices in %d patches, %.2f%% of pixels differ from full detail\n", lod.vertexCount,
+				terrain.chunks.vertices(), (int) lod.patches.size(), 100.0 * differing / (VIEW_SIZE * VIEW_SIZE));
+		else
+			printf("Simplified mesh: %lld of %lld triangles in view within %g of the heights, %.2f%% of pixels differ from full detail\n",
+				mesh.trianglesDrawn, fullTriangles, SIMPLIFY_ERROR, 100.0 * differing / (VIEW_SIZE * VIEW_SIZE));
+	}
+
+	// Compact storage rounds the heights and normals, so only a shader that does not build fails the check; the pixels
+	// that differ from the float terrain at all and by more than COMPACT_LEVELS are reported, with the storage error and
+	// the compact frame time
+	if (compareViews)
+		printf("compact\ttopo\tlight\tdiffering pixels\tover %d levels\n", COMPACT_LEVELS);
+	for (int a = 0; compareViews && a < 5; a++) {
+		terrain.algorithm = algorithms[a];
+		generateHeightValues(&terrain, true);
+		generateHeightValues(&terrain, false);
+		setNormals(&terrain);
+		markTerrainMeshDirty(&mesh);
+		std::vector<unsigned char> floatViews[3];
+		for (int mode = 0; mode < 3; mode++) {
+			TerrainStyle style = { 't', 's', mode == 2 };
+			setupView(&terrain, mode == 0, 30, 20);
+			drawFrame(&mesh, &lod, &terrain, style, 'b');
+			floatViews[mode].resize(reference.size());
+			glReadPixels(0, 0, VIEW_SIZE, VIEW_SIZE, GL_RGB, GL_UNSIGNED_BYTE, &floatViews[mode][0]);
+		}
+
+		CompactError error;
+		compactTerrain(&terrain, &error);
+		markTerrainMeshDirty(&mesh);
+		for (int mode = 0; mode < 3; mode++) {
+			TerrainStyle style = { 't', 's', mode == 2 };
+			setupView(&terrain, mode == 0, 30, 20);
+			drawFrame(&mesh, &lod, &terrain, style, 'b');
+			glReadPixels(0, 0, VIEW_SIZE, VIEW_SIZE, GL_RGB, GL_UNSIGNED_BYTE, &buffered[0]);
+			int differing = 0, distinct = 0;
+			for (size_t p = 0; p < buffered.size(); p += 3) {
+				int largest = 0;
+				for (int c = 0; c < 3; c++)
+					largest = std::max(largest, abs(floatViews[mode][p + c] - buffered[p + c]));
+				differing += largest > 0;
+				distinct += largest > COMPACT_LEVELS;
+			}
+			printf("%c\t%d\t%d\t%.2f%%\t\t\t%.2f%%\n", algorithms[a], mode == 2, mode == 0, 100.0 * differing / (VIEW_SIZE * VIEW_SIZE),
+				100.0 * distinct / (VIEW_SIZE * VIEW_SIZE));
+		}
+		if (mesh.compact.failed)
+			failures++;
+
+		if (a == 4) {
+			printCompactError(error);
+			FrameTimer frames;
+			resetFrameTimer(&frames);
+			setupView(&terrain, true, 30, 20);
+			for (int f = 0; f < TIMED_FRAMES; f++) {
+				double start = frameClock();
+				drawFrame(&mesh, &lod, &terrain, timed, 'b');
+				recordFrame(&frames, frameClock() - start);
+			}
+			printFrameTimer(&frames, "Compact path");
+		}
+		expandTerrain(&terrain);
+	}
+
+	printf(failures == 0 ? "All views match\n" : "%d views differ\n", failures);
+	freeTerrainMesh(&mesh);
+	freeTerrain(&terrain);
+	return failures == 0 ? 0 : 1;
+}
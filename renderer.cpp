@@ -0,0 +1,646 @@
+/*
+Nolan Slade
+Terrain Generator - retained mode rendering
+*/
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+
+#ifdef __APPLE__
+#  include <OpenGL/gl.h>
+#else
+#  include <GL/gl.h>
+#  include <GL/glext.h>
+#endif
+
+#include "renderer.h"
+#include "compact.h"
+
+
+/* Starts an empty mesh, the buffer objects are created on the first draw */
+void initTerrainMesh (TerrainMesh *mesh) {
+	mesh->width = mesh->depth = 0;
+	mesh->simplifyError = -1;
+	mesh->builtError = -1;
+	mesh->errorsChanged = true;
+	mesh->trianglesDrawn = 0;
+	mesh->compact.program = 0;
+	mesh->compact.failed = false;
+}
+
+
+/* Releases the buffer objects, needs the GL context they were created in */
+void freeTerrainMesh (TerrainMesh *mesh) {
+	for (size_t i = 0; i < mesh->chunks.size(); i++) {
+		glDeleteBuffers(1, &mesh->chunks[i].vertexBuffer);
+		glDeleteBuffers(1, &mesh->chunks[i].colourBuffer);
+		glDeleteBuffers(1, &mesh->chunks[i].triangleBuffer);
+	}
+	for (size_t i = 0; i < mesh->strips.size(); i++) {
+		glDeleteBuffers(1, &mesh->strips[i].buffer);
+		glDeleteBuffers(1, &mesh->strips[i].gridBuffer);
+	}
+	if (mesh->compact.program)
+		glDeleteProgram(mesh->compact.program);
+	mesh->compact.program = 0;
+	mesh->compact.failed = false;
+	mesh->chunks.clear();
+	mesh->strips.clear();
+	mesh->width = mesh->depth = 0;
+}
+
+
+/* Call after the heights or normals of the terrain change, the buffers are refreshed on the next draw */
+void markTerrainMeshDirty (TerrainMesh *mesh) {
+	for (size_t i = 0; i < mesh->chunks.size(); i++)
+		mesh->chunks[i].heightsChanged = true;
+	mesh->errorsChanged = true;
+}
+
+
+/* Call after the heights and normals inside a rectangle change, e.g. by sculptTerrain */
+/* Only that part of each chunk mesh it touches is uploaded on the next draw; the simplified triangles */
+/* and the colour range stay as they are until markTerrainMeshSculpted */
+void markTerrainMeshRect (TerrainMesh *mesh, const TerrainRect &rect) {
+	if (rect.firstX >= rect.lastX || rect.firstZ >= rect.lastZ)
+		return;
+	int chunksX = (mesh->width + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+	for (size_t i = 0; i < mesh->chunks.size(); i++) {
+		ChunkMesh &chunkMesh = mesh->chunks[i];
+		int x0 = (int) (i % chunksX) << CHUNK_SHIFT, z0 = (int) (i / chunksX) << CHUNK_SHIFT;
+		TerrainRect part = { std::max(rect.firstX, x0), std::max(rect.firstZ, z0),
+			std::min(rect.lastX, x0 + chunkMesh.width), std::min(rect.lastZ, z0 + chunkMesh.depth) };
+		if (chunkMesh.heightsChanged || part.firstX >= part.lastX || part.firstZ >= part.lastZ)
+			continue;
+
+		TerrainRect &changed = chunkMesh.changed;
+		if (changed.firstX >= changed.lastX) {
+			changed = part;
+		} else {
+			changed.firstX = std::min(changed.firstX, part.firstX);
+			changed.firstZ = std::min(changed.firstZ, part.firstZ);
+			changed.lastX = std::max(changed.lastX, part.lastX);
+			changed.lastZ = std::max(changed.lastZ, part.lastZ);
+		}
+	}
+}
+
+
+/* Call at the end of a sculpt stroke: the simplified triangles are measured again, and every colour is */
+/* refreshed if the terrain's height range changed */
+void markTerrainMeshSculpted (TerrainMesh *mesh, bool rangeChanged) {
+	mesh->errorsChanged = true;
+	if (rangeChanged)
+		for (size_t i = 0; i < mesh->chunks.size(); i++)
+			mesh->chunks[i].coloursChanged = true;
+}
+
+
+/* Returns the strip indices for meshes of the given width, building them the first time */
+/* Row z is one strip over rows z and z + 1, in the order the immediate path drew them */
+static const StripIndices &getStripIndices (TerrainMesh *mesh, int width) {
+	for (size_t i = 0; i < mesh->strips.size(); i++)
+		if (mesh->strips[i].width == width)
+			return mesh->strips[i];
+
+	std::vector<unsigned int> indices(2 * (size_t) width * CHUNK_SIZE);
+	size_t i = 0;
+	for (int z = 0; z < CHUNK_SIZE; z++) {
+		for (int x = 0; x < width; x++) {
+			indices[i++] = z * width + x;
+			indices[i++] = (z + 1) * width + x;
+		}
+	}
+
+	StripIndices strips;
+	strips.width = width;
+	strips.gridBuffer = 0;
+	glGenBuffers(1, &strips.buffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, strips.buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	strips.counts.assign(CHUNK_SIZE, 2 * width);
+	strips.offsets.resize(CHUNK_SIZE);
+	for (int z = 0; z < CHUNK_SIZE; z++)
+		strips.offsets[z] = (const void *) (2 * (size_t) width * z * sizeof(unsigned int));
+	mesh->strips.push_back(strips);
+	return mesh->strips.back();
+}
+
+
+/* Lays out one chunk mesh per chunk of the terrain */
+static void buildChunkMeshes (TerrainMesh *mesh, const Terrain *terrain) {
+	freeTerrainMesh(mesh);
+	const ChunkGrid &grid = terrain->chunks;
+	mesh->chunks.resize(grid.count());
+	for (int i = 0; i < grid.count(); i++) {
+		const TerrainChunk &chunk = grid.chunk(i);
+		ChunkMesh &chunkMesh = mesh->chunks[i];
+		glGenBuffers(1, &chunkMesh.vertexBuffer);
+		glGenBuffers(1, &chunkMesh.colourBuffer);
+		glGenBuffers(1, &chunkMesh.triangleBuffer);
+		chunkMesh.width = std::min(CHUNK_SIZE + 1, terrain->width - chunk.x0);
+		chunkMesh.depth = std::min(CHUNK_SIZE + 1, terrain->depth - chunk.z0);
+		chunkMesh.triangleCount = 0;
+		chunkMesh.heightsChanged = true;
+		chunkMesh.coloursChanged = false;
+		chunkMesh.changed.firstX = chunkMesh.changed.lastX = 0;
+		chunkMesh.trianglesChanged = true;
+	}
+	mesh->width = terrain->width;
+	mesh->depth = terrain->depth;
+	mesh->errorsChanged = true;
+}
+
+
+/* Copies positions and both sets of normals of one chunk mesh into its vertex buffer, one vertex per grid point in row order */
+static void uploadVertices (const ChunkMesh &chunkMesh, const TerrainChunk &chunk, const Terrain *terrain) {
+	size_t vertices = (size_t) chunkMesh.width * chunkMesh.depth;
+	std::vector<float> data(9 * vertices);
+	float *position = &data[0];
+	float *triangleNormal = &data[3 * vertices];
+	float *quadNormal = &data[6 * vertices];
+
+	for (int z = chunk.z0; z < chunk.z0 + chunkMesh.depth; z++) {
+		for (int x = chunk.x0; x < chunk.x0 + chunkMesh.width; x++) {
+			// The last row and column come from the neighbouring chunks
+			const TerrainChunk &owner = terrain->chunks.chunkAt(x, z);
+			const Heightfield &field = owner.field;
+			int index = field.index(x - owner.x0, z - owner.z0);
+			*position++ = (float) (x * VERT_SPACING);
+			*position++ = field.heights()[index];
+			*position++ = (float) (z * VERT_SPACING);
+			for (int axis = 0; axis < 3; axis++) {
+				*triangleNormal++ = field.triangleNormals(axis)[index];
+				*quadNormal++ = field.quadNormals(axis)[index];
+			}
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, chunkMesh.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
+}
+
+
+/* Fills the colour buffer of one chunk mesh with both colour streams */
+static void uploadColours (const ChunkMesh &chunkMesh, const TerrainChunk &chunk, const Terrain *terrain) {
+	int width = chunkMesh.width;
+	size_t vertices = (size_t) width * chunkMesh.depth;
+	std::vector<float> colours(6 * vertices);
+	std::vector<float> row(width);
+
+	for (int z = 0; z < chunkMesh.depth; z++) {
+		terrain->chunks.copyHeights(chunk.x0, chunk.z0 + z, width, &row[0]);
+		heightColours(terrain, &row[0], width, &colours[3 * (size_t) z * width], &colours[3 * (vertices + (size_t) z * width)]);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, chunkMesh.colourBuffer);
+	glBufferData(GL_ARRAY_BUFFER, colours.size() * sizeof(float), &colours[0], GL_STATIC_DRAW);
+}
+
+
+/* Replaces the vertices and colours of one chunk mesh inside its changed rectangle, a row at a time */
+/* Each row of the rectangle is a run in each of the five streams, positions, the two normals and the two colours */
+static void uploadChangedRect (const ChunkMesh &chunkMesh, const TerrainChunk &chunk, const Terrain *terrain) {
+	const TerrainRect &rect = chunkMesh.changed;
+	size_t vertices = (size_t) chunkMesh.width * chunkMesh.depth;
+	int count = rect.lastX - rect.firstX;
+	std::vector<float> heights(count), data(9 * (size_t) count), colours(6 * (size_t) count);
+
+	for (int z = rect.firstZ; z < rect.lastZ; z++) {
+		terrain->chunks.copyHeights(rect.firstX, z, count, &heights[0]);
+		for (int x = rect.firstX; x < rect.lastX; x++) {
+			const TerrainChunk &owner = terrain->chunks.chunkAt(x, z);
+			const Heightfield &field = owner.field;
+			int index = field.index(x - owner.x0, z - owner.z0);
+			float *position = &data[3 * (x - rect.firstX)];
+			position[0] = (float) (x * VERT_SPACING);
+			position[1] = heights[x - rect.firstX];
+			position[2] = (float) (z * VERT_SPACING);
+			for (int axis = 0; axis < 3; axis++) {
+				data[3 * ((size_t) count + x - rect.firstX) + axis] = field.triangleNormals(axis)[index];
+				data[3 * (2 * (size_t) count + x - rect.firstX) + axis] = field.quadNormals(axis)[index];
+			}
+		}
+		heightColours(terrain, &heights[0], count, &colours[0], &colours[3 * (size_t) count]);
+
+		size_t first = (size_t) (z - chunk.z0) * chunkMesh.width + (rect.firstX - chunk.x0);
+		size_t runBytes = 3 * (size_t) count * sizeof(float);
+		glBindBuffer(GL_ARRAY_BUFFER, chunkMesh.vertexBuffer);
+		for (int stream = 0; stream < 3; stream++)
+			glBufferSubData(GL_ARRAY_BUFFER, 3 * (stream * vertices + first) * sizeof(float), runBytes, &data[3 * (size_t) count * stream]);
+		glBindBuffer(GL_ARRAY_BUFFER, chunkMesh.colourBuffer);
+		for (int stream = 0; stream < 2; stream++)
+			glBufferSubData(GL_ARRAY_BUFFER, 3 * (stream * vertices + first) * sizeof(float), runBytes, &colours[3 * (size_t) count * stream]);
+	}
+}
+
+
+/* Fills the index buffer of one chunk mesh with its simplified triangles */
+static void uploadTriangles (ChunkMesh &chunkMesh, const TerrainSimplifier &simplifier, int i, float maxError) {
+	std::vector<unsigned int> triangles;
+	simplifier.triangulate(i, maxError, chunkMesh.width, triangles);
+	chunkMesh.triangleCount = (int) (triangles.size() / 3);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunkMesh.triangleBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangles.size() * sizeof(unsigned int), triangles.empty() ? 0 : &triangles[0], GL_STATIC_DRAW);
+}
+
+
+/* Vertex shader for compact terrains: the position comes from the shared grid coordinates and the packed height, the */
+/* normal is unpacked as unpackNormal does, and the colour is either the fixed-function lighting of up to two lights */
+/* (the viewer's point lights, no colour material) or the colour heightColours gives */
+static const char *compactShaderSource =
+	"#version 120\n"
+	"attribute vec2 grid;\n"
+	"attribute float height;\n"
+	"attribute vec4 normals;\n"
+	"uniform vec3 origin;\n"
+	"uniform float spacing;\n"
+	"uniform float step;\n"
+	"uniform bool quadNormals;\n"
+	"uniform bool lighting;\n"
+	"uniform vec2 lightEnabled;\n"
+	"uniform int colouring;\n"
+	"uniform vec3 gray;\n"
+	"uniform float maxHeight;\n"
+	"uniform vec3 baseGreen;\n"
+	"vec3 unpackNormal (vec2 uv) {\n"
+	"	vec2 ab = uv * 2.0 - 1.0;\n"
+	"	vec3 n = vec3((ab.x + ab.y) * 0.5, 0.0, (ab.x - ab.y) * 0.5);\n"
+	"	n.y = 1.0 - abs(n.x) - abs(n.z);\n"
+	"	return normalize(n);\n"
+	"}\n"
+	"void main () {\n"
+	"	float h = origin.y + height * step;\n"
+	"	vec4 eye = gl_ModelViewMatrix * vec4(origin.x + grid.x * spacing, h, origin.z + grid.y * spacing, 1.0);\n"
+	"	gl_Position = gl_ProjectionMatrix * eye;\n"
+	"	if (lighting) {\n"
+	"		vec3 n = normalize(gl_NormalMatrix * unpackNormal(quadNormals ? normals.zw : normals.xy));\n"
+	"		vec4 colour = gl_FrontLightModelProduct.sceneColor;\n"
+	"		for (int i = 0; i < 2; i++) {\n"
+	"			vec4 position = gl_LightSource[i].position;\n"
+	"			vec3 l = normalize(position.xyz - position.w * eye.xyz);\n"
+	"			float diffuse = dot(n, l);\n"
+	"			float facing = diffuse > 0.0 ? lightEnabled[i] : 0.0;\n"
+	"			float specular = pow(max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0), gl_FrontMaterial.shininess);\n"
+	"			colour += lightEnabled[i] * gl_FrontLightProduct[i].ambient;\n"
+	"			colour += facing * (diffuse * gl_FrontLightProduct[i].diffuse + specular * gl_FrontLightProduct[i].specular);\n"
+	"		}\n"
+	"		gl_FrontColor = vec4(clamp(colour.rgb, 0.0, 1.0), gl_FrontMaterial.diffuse.a);\n"
+	"	} else if (colouring == 0) {\n"
+	"		float value = gray.z > 0.0 ? 1.0 : (h + gray.x) / gray.y;\n"
+	"		gl_FrontColor = vec4(value, value, value, 1.0);\n"
+	"	} else if (colouring == 1) {\n"
+	"		gl_FrontColor = vec4(baseGreen + h / maxHeight * vec3(1.0, 0.125, 0.25), 1.0);\n"
+	"	} else {\n"
+	"		gl_FrontColor = gl_Color;\n"
+	"	}\n"
+	"}\n";
+
+
+/* Compiles and links the compact shader, printing the log if it fails */
+static void buildCompactProgram (CompactProgram *compact) {
+	unsigned int shader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(shader, 1, &compactShaderSource, 0);
+	glCompileShader(shader);
+	unsigned int program = glCreateProgram();
+	glAttachShader(program, shader);
+	glBindAttribLocation(program, 0, "grid");
+	glLinkProgram(program);
+
+	int linked = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		char log[1024] = "";
+		glGetShaderInfoLog(shader, sizeof(log), 0, log);
+		printf("Could not build the compact terrain shader, compact terrains are not drawn\n%s\n", log);
+		glDeleteShader(shader);
+		glDeleteProgram(program);
+		compact->failed = true;
+		return;
+	}
+	glDeleteShader(shader);
+
+	compact->program = program;
+	compact->height = glGetAttribLocation(program, "height");
+	compact->normals = glGetAttribLocation(program, "normals");
+	compact->origin = glGetUniformLocation(program, "origin");
+	compact->spacing = glGetUniformLocation(program, "spacing");
+	compact->step = glGetUniformLocation(program, "step");
+	compact->quadNormals = glGetUniformLocation(program, "quadNormals");
+	compact->lighting = glGetUniformLocation(program, "lighting");
+	compact->lightEnabled = glGetUniformLocation(program, "lightEnabled");
+	compact->colouring = glGetUniformLocation(program, "colouring");
+	compact->gray = glGetUniformLocation(program, "gray");
+	compact->maxHeight = glGetUniformLocation(program, "maxHeight");
+	compact->baseGreen = glGetUniformLocation(program, "baseGreen");
+}
+
+
+/* Returns the grid coordinates compact meshes of the given width read their x and z from, building them the first time */
+static unsigned int getGridBuffer (TerrainMesh *mesh, int width) {
+	getStripIndices(mesh, width);
+	for (size_t i = 0; i < mesh->strips.size(); i++) {
+		StripIndices &strips = mesh->strips[i];
+		if (strips.width != width)
+			continue;
+		if (!strips.gridBuffer) {
+			std::vector<unsigned short> grid(2 * (size_t) width * (CHUNK_SIZE + 1));
+			for (int z = 0; z <= CHUNK_SIZE; z++) {
+				for (int x = 0; x < width; x++) {
+					grid[2 * ((size_t) z * width + x)] = (unsigned short) x;
+					grid[2 * ((size_t) z * width + x) + 1] = (unsigned short) z;
+				}
+			}
+			glGenBuffers(1, &strips.gridBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, strips.gridBuffer);
+			glBufferData(GL_ARRAY_BUFFER, grid.size() * sizeof(unsigned short), &grid[0], GL_STATIC_DRAW);
+		}
+		return strips.gridBuffer;
+	}
+	return 0;
+}
+
+
+/* Copies the packed normals and heights of one chunk mesh of a compact terrain into its vertex buffer as they are */
+/* Every chunk packs its heights over the terrain's range, so the last row and column can be taken from the neighbours */
+static void uploadCompactVertices (const ChunkMesh &chunkMesh, const TerrainChunk &chunk, const Terrain *terrain) {
+	size_t vertices = (size_t) chunkMesh.width * chunkMesh.depth;
+	std::vector<unsigned char> data(COMPACT_VERTEX_BYTES * vertices);
+	unsigned char *normals = &data[0];
+	unsigned short *heights = (unsigned short *) &data[COMPACT_NORMAL_BYTES * vertices];
+
+	for (int z = chunk.z0; z < chunk.z0 + chunkMesh.depth; z++) {
+		for (int x = chunk.x0; x < chunk.x0 + chunkMesh.width; x++) {
+			const TerrainChunk &owner = terrain->chunks.chunkAt(x, z);
+			const CompactHeightfield &compact = owner.compact;
+			size_t packed = (size_t) (z - owner.z0) * compact.width + (x - owner.x0);
+			*heights++ = compact.heights[packed];
+			for (int b = 0; b < COMPACT_NORMAL_BYTES; b++)
+				*normals++ = compact.normals[COMPACT_NORMAL_BYTES * packed + b];
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, chunkMesh.vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, data.size(), &data[0], GL_STATIC_DRAW);
+}
+
+
+/* Sets the uniforms of the compact shader that hold for the whole pass */
+static void setCompactUniforms (const CompactProgram &compact, const Terrain *terrain, const TerrainStyle &style, bool overlay) {
+	// The same grayscale offset and scale as heightColours
+	float difference = signedHeights(terrain->algorithm) && terrain->minHeight < 0 ? -1 * terrain->minHeight + 10 : 0;
+	bool flat = !signedHeights(terrain->algorithm) && terrain->maxHeight == 0 && terrain->minHeight == 0;
+
+	glUniform1f(compact.spacing, VERT_SPACING);
+	glUniform1f(compact.step, compactStep(terrain));
+	glUniform1i(compact.quadNormals, style.stripMode != 't');
+	glUniform1i(compact.lighting, glIsEnabled(GL_LIGHTING));
+	glUniform2f(compact.lightEnabled, glIsEnabled(GL_LIGHT0) ? 1 : 0, glIsEnabled(GL_LIGHT1) ? 1 : 0);
+	glUniform1i(compact.colouring, overlay ? 2 : style.topographic ? 1 : 0);
+	glUniform3f(compact.gray, difference, terrain->maxHeight + difference, flat ? 1 : 0);
+	glUniform1f(compact.maxHeight, terrain->maxHeight);
+	glUniform3f(compact.baseGreen, baseGreen[0], baseGreen[1], baseGreen[2]);
+}
+
+
+/* Tests the chunk boxes of the terrain against the frustum of the current projection and modelview */
+void cullTerrainChunks (const Terrain *terrain, ChunkVisibility *visibility) {
+	float projection[16], modelview[16];
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	Frustum frustum;
+	frustumFromMatrices(projection, modelview, &frustum);
+	visibility->drawn = terrain->bounds.cull(frustum, visibility->visible);
+	visibility->culled = terrain->chunks.count() - visibility->drawn;
+}
+
+
+/* Draws the terrain chunk by chunk from the buffer objects, refreshing only what changed since the last draw */
+/* wireMode is 'w' for the wireframe pass and anything else for the filled pass */
+/* Chunks outside the view are skipped, and keep any pending refresh until they come into view; null visibility draws every chunk */
+/* With a simplifyError of zero or more each chunk is drawn as the simplified triangles instead of the strips */
+void drawTerrainMesh (TerrainMesh *mesh, const Terrain *terrain, const TerrainStyle &style, char wireMode, const ChunkVisibility *visibility) {
+	if (terrain->width < 2 || terrain->depth < 2)
+		return;
+	if (mesh->width != terrain->width || mesh->depth != terrain->depth)
+		buildChunkMeshes(mesh, terrain);
+
+	// Compact terrains are drawn by the compact shader from their packed vertices, as strips only
+	bool compact = terrain->compact;
+	if (compact && !mesh->compact.program && !mesh->compact.failed)
+		buildCompactProgram(&mesh->compact);
+	if (compact && mesh->compact.failed)
+		return;
+
+	// The errors take in the whole terrain, so they are measured again only when the heights change
+	bool simplified = mesh->simplifyError >= 0 && !compact;
+	if (simplified && (mesh->errorsChanged || mesh->builtError != mesh->simplifyError)) {
+		if (mesh->errorsChanged)
+			mesh->simplifier.build(terrain);
+		for (size_t i = 0; i < mesh->chunks.size(); i++)
+			mesh->chunks[i].trianglesChanged = true;
+		mesh->errorsChanged = false;
+		mesh->builtError = mesh->simplifyError;
+	}
+	mesh->trianglesDrawn = 0;
+
+	// Determine the polygon mode based on our global wiremode setting
+	if (wireMode == 'w')
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);	// Wire frame
+	else
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);	// Normal (filled)
+
+	// The wireframe drawn over the filled terrain is a single colour, everything else is coloured per vertex
+	bool overlay = style.wireFrameMode == 'b' && wireMode == 'w';
+	if (overlay) {
+		if (style.topographic)
+			glColor3f(0,0,0);
+		else
+			glColor3f(1,0,0);
+	} else if (!compact) {
+		glEnableClientState(GL_COLOR_ARRAY);
+	}
+	if (compact) {
+		glUseProgram(mesh->compact.program);
+		setCompactUniforms(mesh->compact, terrain, style, overlay);
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(mesh->compact.height);
+		glEnableVertexAttribArray(mesh->compact.normals);
+	} else {
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glEnableClientState(GL_NORMAL_ARRAY);
+	}
+
+	for (size_t i = 0; i < mesh->chunks.size(); i++) {
+		ChunkMesh &chunkMesh = mesh->chunks[i];
+		if (chunkMesh.width < 2 || chunkMesh.depth < 2)
+			continue;
+		if (visibility && !visibility->visible[i])
+			continue;
+		if (compact && (chunkMesh.heightsChanged || chunkMesh.changed.firstX < chunkMesh.changed.lastX)) {
+			// The colours come from the heights in the shader, so the packed vertices are all there is to upload
+			uploadCompactVertices(chunkMesh, terrain->chunks.chunk(i), terrain);
+			chunkMesh.heightsChanged = false;
+			chunkMesh.coloursChanged = false;
+			chunkMesh.changed.firstX = chunkMesh.changed.lastX = 0;
+		}
+		if (chunkMesh.heightsChanged) {
+			uploadVertices(chunkMesh, terrain->chunks.chunk(i), terrain);
+			uploadColours(chunkMesh, terrain->chunks.chunk(i), terrain);
+			chunkMesh.heightsChanged = false;
+			chunkMesh.coloursChanged = false;
+			chunkMesh.changed.firstX = chunkMesh.changed.lastX = 0;
+		}
+		if (chunkMesh.changed.firstX < chunkMesh.changed.lastX) {
+			uploadChangedRect(chunkMesh, terrain->chunks.chunk(i), terrain);
+			chunkMesh.changed.firstX = chunkMesh.changed.lastX = 0;
+		}
+		if (chunkMesh.coloursChanged && !compact) {
+			uploadColours(chunkMesh, terrain->chunks.chunk(i), terrain);
+			chunkMesh.coloursChanged = false;
+		}
+
+		size_t vertices = (size_t) chunkMesh.width * chunkMesh.depth;
+		if (compact) {
+			const TerrainChunk &chunk = terrain->chunks.chunk(i);
+			glUniform3f(mesh->compact.origin, (float) (chunk.x0 * VERT_SPACING), terrain->minHeight, (float) (chunk.z0 * VERT_SPACING));
+			glBindBuffer(GL_ARRAY_BUFFER, getGridBuffer(mesh, chunkMesh.width));
+			glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_FALSE, 0, (const void *) 0);
+			glBindBuffer(GL_ARRAY_BUFFER, chunkMesh.vertexBuffer);
+			glVertexAttribPointer(mesh->compact.normals, COMPACT_NORMAL_BYTES, GL_UNSIGNED_BYTE, GL_TRUE, 0, (const void *) 0);
+			glVertexAttribPointer(mesh->compact.height, 1, GL_UNSIGNED_SHORT, GL_FALSE, 0, (const void *) (COMPACT_NORMAL_BYTES * vertices));
+		} else {
+			size_t normalOffset = (style.stripMode == 't' ? 3 : 6) * vertices * sizeof(float);
+			glBindBuffer(GL_ARRAY_BUFFER, chunkMesh.vertexBuffer);
+			glVertexPointer(3, GL_FLOAT, 0, (const void *) 0);
+			glNormalPointer(GL_FLOAT, 0, (const void *) normalOffset);
+		}
+		if (!overlay && !compact) {
+			size_t colourOffset = (style.topographic ? 3 : 0) * vertices * sizeof(float);
+			glBindBuffer(GL_ARRAY_BUFFER, chunkMesh.colourBuffer);
+			glColorPointer(3, GL_FLOAT, 0, (const void *) colourOffset);
+		}
+
+		if (simplified) {
+			if (chunkMesh.trianglesChanged) {
+				uploadTriangles(chunkMesh, mesh->simplifier, (int) i, mesh->simplifyError);
+				chunkMesh.trianglesChanged = false;
+			}
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunkMesh.triangleBuffer);
+			glDrawElements(GL_TRIANGLES, 3 * chunkMesh.triangleCount, GL_UNSIGNED_INT, (const void *) 0);
+			mesh->trianglesDrawn += chunkMesh.triangleCount;
+			continue;
+		}
+
+		const StripIndices &strips = getStripIndices(mesh, chunkMesh.width);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, strips.buffer);
+		glMultiDrawElements(style.stripMode == 't' ? GL_TRIANGLE_STRIP : GL_QUAD_STRIP, &strips.counts[0], GL_UNSIGNED_INT,
+			&strips.offsets[0], chunkMesh.depth - 1);
+		mesh->trianglesDrawn += 2LL * (chunkMesh.width - 1) * (chunkMesh.depth - 1);
+	}
+
+	if (compact) {
+		glDisableVertexAttribArray(0);
+		glDisableVertexAttribArray(mesh->compact.height);
+		glDisableVertexAttribArray(mesh->compact.normals);
+		glUseProgram(0);
+	}
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+/* Draws the terrain one vertex at a time, kept as the reference the buffered path is checked against */
+void drawTerrainImmediate (const Terrain *terrain, const TerrainStyle &style, char wireMode) {
+	// Determine the polygon mode based on our global wiremode setting
+	if (wireMode == 'w')
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);	// Wire frame
+	else
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);	// Normal (filled)
+
+	// Render the terrain using the newly set polygon mode
+	// Draw by going through the triangle-strip pattern across the grid for each z.
+	// Each strip joins row z to row z + 1, so the last row has no strip of its own
+	for (int z = 0; z < terrain->depth - 1; z++) {
+		int i = z;				// Models the depth (z)
+		int j = 0;				// Models the current width position (x)
+		int counter = 0;			// Counter for index modification
+		int vertexIndex = 0;
+
+		// Render a new strip for each z layer
+		if (style.stripMode == 't')
+			glBegin(GL_TRIANGLE_STRIP);
+		else if (style.stripMode == 'y')
+			glBegin(GL_QUAD_STRIP);
+				while (1) {
+					// If we're at the end of this Z layer, we break the loop to move to the next layer
+					if (counter == 2 * terrain->width) {
+						break;
+					} else {
+						// Construct a vector for our vertex and place the vertex
+						const TerrainChunk &chunk = terrain->chunks.chunkAt(j, i);
+						const Heightfield &field = chunk.field;
+						vertexIndex = field.index(j - chunk.x0, i - chunk.z0);
+						float height = field.heights()[vertexIndex];
+						float currentV[] = {(float) (j * VERT_SPACING), height, (float) (i * VERT_SPACING)};
+
+						// Determine vertex colouring
+						if (style.topographic && style.wireFrameMode == 'b' && wireMode == 'w')
+							glColor3f(0,0,0);
+
+						else if (style.topographic)
+							glColor3f(baseGreen[0] + height/terrain->maxHeight, baseGreen[1] + height/terrain->maxHeight/8, baseGreen[2]+ height/terrain->maxHeight/4);
+
+						else if (style.wireFrameMode == 'b' && wireMode == 'w')
+							glColor3f(1,0,0);
+
+						else {
+							if (signedHeights(terrain->algorithm)) {
+								// Account for possible negative height values
+								float difference = 0;
+
+								// Add a number to avoid floating point inaccuracies
+								if (terrain->minHeight < 0)
+									difference = -1 * terrain->minHeight + 10;
+
+								glColor3f((height+difference)/(terrain->maxHeight+difference),(height+difference)/(terrain->maxHeight+difference),(height+difference)/(terrain->maxHeight+difference));
+							} else {
+								if (terrain->maxHeight == 0 && terrain->minHeight == 0)
+									glColor3f(1.0,1.0,1.0);
+								else
+									glColor3f(height/terrain->maxHeight,height/terrain->maxHeight,height/terrain->maxHeight);
+							}
+						}
+
+						// Determine which normal we are using (quad or triangle-based vertex normal)
+						if (style.stripMode == 't')
+							glNormal3f(field.triangleNormals(0)[vertexIndex],field.triangleNormals(1)[vertexIndex],field.triangleNormals(2)[vertexIndex]);
+						else
+							glNormal3f(field.quadNormals(0)[vertexIndex],field.quadNormals(1)[vertexIndex],field.quadNormals(2)[vertexIndex]);
+
+						// Add the vertex with the assigned normal and colouring
+						glVertex3fv(currentV);
+
+						// Modulo operator used to increment the appropriate variables
+						if (counter % 2 == 0) {
+							i++;
+						} else {
+							j++;
+							i--;
+						}
+
+						// Number of vertices has increased
+						counter++;
+					}
+				}
+			glEnd();
+	}
+}
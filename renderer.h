@@ -0,0 +1,84 @@
+/*
+Nolan Slade
+Terrain Generator - retained mode rendering
+*/
+
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <vector>
+
+#include "terrain.h"
+#include "simplify.h"
+
+/* View settings that change what drawTerrain puts on screen */
+struct TerrainStyle {
+	char stripMode;				// 't' for triangle strips, 'y' for quad strips
+	char wireFrameMode;			// 's' solid, 'w' wireframe, 'b' both (the wireframe pass is then drawn red or black)
+	bool topographic;			// Topographic colouring instead of grayscale
+};
+
+/* Buffer objects for one chunk of the terrain, so that a frame only issues draw calls */
+/* The mesh also takes the first row and column of the next chunks, so that neighbouring meshes join up */
+struct ChunkMesh {
+	unsigned int vertexBuffer;		// Positions, then triangle-strip normals, then quad-strip normals
+						// (for a compact terrain, the packed normals and then the packed heights)
+	unsigned int colourBuffer;		// Grayscale colours, then topographic colours, one RGB colour per vertex each (unused when compact)
+	unsigned int triangleBuffer;		// Indices of the simplified triangles into the vertex buffer, when simplifying
+	int width;				// Vertices across and down the mesh
+	int depth;
+	int triangleCount;
+	bool heightsChanged;			// Set by markTerrainMeshDirty, the buffers are rebuilt on the next draw
+	bool coloursChanged;			// Only the colours are rebuilt on the next draw
+	TerrainRect changed;			// Vertices of the mesh refreshed on the next draw, in terrain coordinates, empty if firstX >= lastX
+	bool trianglesChanged;			// The simplified triangles are rebuilt on the next simplified draw
+};
+
+/* Strip indices shared by every chunk mesh of one width, shallower meshes draw fewer of the strips */
+struct StripIndices {
+	unsigned int buffer;			// Two vertices per column for each row of strips, CHUNK_SIZE rows
+	unsigned int gridBuffer;		// x and z of every vertex as unsigned shorts, for compact meshes; 0 until one is drawn
+	int width;
+	std::vector<int> counts;		// Per row arguments for glMultiDrawElements
+	std::vector<const void *> offsets;
+};
+
+/* Vertex shader that draws compact terrains straight from their packed heights and normals, built on the first compact draw */
+struct CompactProgram {
+	unsigned int program;			// 0 until built
+	bool failed;				// The shader did not compile or link, compact terrains are then not drawn
+	int height, normals;			// Attribute locations, the grid coordinates are bound to 0
+	int origin, spacing, step, quadNormals, lighting, lightEnabled, colouring, gray, maxHeight, baseGreen;	// Uniform locations
+};
+
+/* Copy of a whole terrain held in GL buffer objects, one set per chunk */
+struct TerrainMesh {
+	std::vector<ChunkMesh> chunks;		// In the same order as the chunks of the terrain
+	std::vector<StripIndices> strips;	// One per distinct chunk mesh width, at most two
+	int width;				// Terrain size the chunk meshes were laid out for
+	int depth;
+	float simplifyError;			// Largest height error of the simplified triangles, negative draws every cell (as compact terrains always do)
+	float builtError;			// Error the chunks' triangles were built for
+	bool errorsChanged;			// The simplifier is rebuilt on the next simplified draw
+	TerrainSimplifier simplifier;
+	CompactProgram compact;
+	long long trianglesDrawn;		// Triangles drawn by the last pass
+};
+
+/* Chunks found inside the view frustum for the frame being drawn */
+struct ChunkVisibility {
+	std::vector<char> visible;		// One flag per chunk, in the same order as the chunks of the terrain
+	int drawn;				// Chunks whose box touches the frustum
+	int culled;				// Chunks skipped because their box is entirely outside it
+};
+
+void initTerrainMesh (TerrainMesh *mesh);
+void freeTerrainMesh (TerrainMesh *mesh);
+void markTerrainMeshDirty (TerrainMesh *mesh);
+void markTerrainMeshRect (TerrainMesh *mesh, const TerrainRect &rect);
+void markTerrainMeshSculpted (TerrainMesh *mesh, bool rangeChanged);
+void cullTerrainChunks (const Terrain *terrain, ChunkVisibility *visibility);
+void drawTerrainMesh (TerrainMesh *mesh, const Terrain *terrain, const TerrainStyle &style, char wireMode, const ChunkVisibility *visibility);
+void drawTerrainImmediate (const Terrain *terrain, const TerrainStyle &style, char wireMode);
+
+#endif
@@ -0,0 +1,709 @@
+/*
+Nolan Slade
+Terrain Generator - local tile server
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <algorithm>
+
+#include "terrain.h"
+#include "frametimer.h"
+#include "threadpool.h"
+#include "trace.h"
+
+#define TILE_VERSION		1		// Version of the binary tile the server sends
+#define TILE_HEADER_BYTES	32		// "TILE", version, width, depth, x0, z0, min and max height
+#define REQUEST_BYTES		8192		// Longest request head read, anything longer is refused
+#define SEND_BYTES		65536		// Tile bytes gathered before each send
+#define MAX_COMPLEXITY		1000000		// Largest complexity served, as circles and particle deposition cost grows with it
+#define RECEIVE_SECONDS		5		// How long a connection may take to send its request
+#define SEND_SECONDS		30		// How long a send may wait on a client that stopped reading
+
+/* Terrain a tile comes from; the same key always generates the same terrain */
+struct TerrainKey {
+	unsigned int seed;
+	char algorithm;
+	int complexity;
+	int side;				// Vertices along each side of the whole terrain
+
+	bool operator< (const TerrainKey &other) const {
+		if (seed != other.seed) return seed < other.seed;
+		if (algorithm != other.algorithm) return algorithm < other.algorithm;
+		if (complexity != other.complexity) return complexity < other.complexity;
+		return side < other.side;
+	}
+};
+
+struct CachedTerrain;
+
+/* One tile to send back on an open connection */
+struct TileRequest {
+	int socket;
+	int tileX, tileZ;			// Chunk of the terrain the tile is
+	bool normals;				// Send both sets of normals after the heights
+	double start;				// frameClock() when the request was read, for the latency
+	std::shared_ptr<CachedTerrain> source;
+};
+
+/* A cached terrain, or one being generated with the tile requests waiting for it */
+struct CachedTerrain {
+	TerrainKey key;
+	Terrain terrain;
+	bool ready;				// Generated; the terrain is only read from then on
+	std::vector<TileRequest> waiting;	// Requests that arrived while it was being generated
+	std::list<TerrainKey>::iterator use;	// Place in the least recently used list, once ready
+	size_t bytes;
+
+	CachedTerrain () : ready(false), bytes(0) {}
+	~CachedTerrain () { freeTerrain(&terrain); }
+};
+
+/* A connection whose request head is still arriving, read by the accept thread as its bytes come in */
+struct PendingHead {
+	int socket;
+	double start;				// frameClock() when it was accepted
+	std::string head;
+};
+
+/* Counters behind the stats endpoint */
+struct ServerStats {
+	long long tiles;			// Tiles sent in full
+	long long failed;			// Connections that closed before their tile was sent
+	long long badRequests;
+	long long generated;			// Terrains generated
+	long long coalesced;			// Requests that waited on a generation another request started
+	long long cacheHits;			// Requests whose terrain was already generated
+	long long largestBatch;			// Most requests served by one generation
+	long long evicted;
+	long long bytesSent;
+	FrameTimer latency;			// Request read to tile sent, in ms
+	FrameTimer generation;			// Generation and normals of each terrain, in ms
+};
+
+
+int maxSide = 4096;				// Largest terrain served, 28 bytes per vertex have to fit in the cache
+size_t cacheBudget = (size_t) 1024 << 20;	// Bytes of generated terrains kept for later requests
+
+std::mutex queueMutex;				// Guards the cache, the queues and the stats
+std::condition_variable workReady;
+std::map<TerrainKey, std::shared_ptr<CachedTerrain> > cache;
+std::list<TerrainKey> leastRecent;		// Ready terrains, most recently used first
+size_t cacheBytes = 0;
+std::deque<std::shared_ptr<CachedTerrain> > generateQueue;
+std::deque<TileRequest> sendQueue;		// Requests whose terrain is ready
+ServerStats stats;
+double startTime;
+
+
+/* Prints command line usage */
+void printUsage (const char *program) {
+	printf("Usage: %s [options]\n", program);
+	printf("\t-port port\tServe HTTP on 127.0.0.1 at this port (default 8080)\n");
+	printf("\t-unix path\tServe HTTP on a Unix socket at this path instead\n");
+	printf("\t-t threads\tWorkers generating terrains and sending tiles (default: number of cores)\n");
+	printf("\t-p threads\tThreads shared by the generation and normal passes (default: number of cores)\n");
+	printf("\t-m MB\t\tMemory kept for generated terrains (default 1024)\n");
+	printf("\t-s side\t\tLargest terrain side served, in vertices (default 4096)\n");
+	printf("\t-client\t\tRun the test client against a running server instead, see -n, -c, -a, -r, -k, -S\n");
+	printf("\t-n requests\tClient: tile requests to send (default 256)\n");
+	printf("\t-c connections\tClient: requests in flight at once (default 8)\n");
+	printf("\t-a c|f|d|n|s\tClient: algorithm (default n)\n");
+	printf("\t-r side\t\tClient: terrain side in vertices (default 1024)\n");
+	printf("\t-k complexity\tClient: complexity (default 100)\n");
+	printf("\t-S seeds\tClient: different seeds the requests are spread over (default 4)\n");
+}
+
+
+/* Sends all of the bytes, returns false if the connection closed */
+bool sendAll (int socket, const void *data, size_t length) {
+	const char *bytes = (const char *) data;
+	while (length > 0) {
+		ssize_t sent = send(socket, bytes, length, MSG_NOSIGNAL);
+		if (sent <= 0)
+			return false;
+		bytes += sent;
+		length -= sent;
+	}
+	return true;
+}
+
+
+/* Sends a complete response with a text body and closes the connection */
+void sendText (int socket, const char *status, const char *type, const std::string &body) {
+	char head[256];
+	snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", status, type, body.size());
+	if (sendAll(socket, head, strlen(head)))
+		sendAll(socket, body.data(), body.size());
+	close(socket);
+}
+
+
+/* Gathers the tile into SEND_BYTES pieces, so it is streamed without being copied out whole */
+struct TileWriter {
+	int socket;
+	std::vector<char> buffer;
+	bool ok;
+	size_t sent;
+
+	void put (const void *data, size_t length) {
+		buffer.insert(buffer.end(), (const char *) data, (const char *) data + length);
+		if (buffer.size() >= SEND_BYTES)
+			flush();
+	}
+	void flush () {
+		if (ok && !buffer.empty()) {
+			ok = sendAll(socket, &buffer[0], buffer.size());
+			sent += buffer.size();
+		}
+		buffer.clear();
+	}
+};
+
+
+/* Bytes of the tile body for a chunk of the given size */
+size_t tileBytes (int width, int depth, bool normals) {
+	return TILE_HEADER_BYTES + (size_t) width * depth * sizeof(float) * (normals ? HEIGHTFIELD_PLANES : 1);
+}
+
+
+/* Sends one tile: the header, the heights row by row, then the triangle-strip and quad-strip normals (3 floats per vertex each) */
+/* Returns the bytes sent, 0 if the connection closed first */
+size_t sendTile (const TileRequest &request) {
+	TRACE_ZONE("send tile");
+	const TerrainChunk &chunk = request.source->terrain.chunks.chunk(request.tileX, request.tileZ);
+	const Heightfield &field = chunk.field;
+	int width = field.width(), depth = field.depth();
+	size_t length = tileBytes(width, depth, request.normals);
+
+	char head[160];
+	snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n", length);
+	TileWriter writer = { request.socket, std::vector<char>(), true, 0 };
+	writer.buffer.reserve(SEND_BYTES + sizeof(float) * 3 * CHUNK_SIZE);
+	writer.put(head, strlen(head));
+	int header[6] = { 0, TILE_VERSION, width, depth, chunk.x0, chunk.z0 };
+	memcpy(header, "TILE", 4);
+	writer.put(header, sizeof(header));
+	writer.put(&chunk.minHeight, sizeof(float));
+	writer.put(&chunk.maxHeight, sizeof(float));
+
+	for (int z = 0; z < depth && writer.ok; z++)
+		writer.put(field.heightRow(z), width * sizeof(float));
+	// The normal planes are interleaved a row at a time
+	std::vector<float> row(3 * width);
+	for (int set = 0; request.normals && set < 2 && writer.ok; set++) {
+		for (int z = 0; z < depth && writer.ok; z++) {
+			for (int axis = 0; axis < 3; axis++) {
+				const float *plane = (set == 0 ? field.triangleNormals(axis) : field.quadNormals(axis)) + field.index(0, z);
+				for (int x = 0; x < width; x++)
+					row[3 * x + axis] = plane[x];
+			}
+			writer.put(&row[0], row.size() * sizeof(float));
+		}
+	}
+	writer.flush();
+	return writer.ok ? writer.sent : 0;
+}
+
+
+/* Stats as JSON: counters since the start, throughput, and latency and generation percentiles over the recent requests */
+std::string statsJson () {
+	std::lock_guard<std::mutex> lock(queueMutex);
+	double seconds = (frameClock() - startTime) / 1000;
+	char text[1536];
+	snprintf(text, sizeof(text),
+		"{\"uptime_s\": %.1f, \"tiles\": %lld, \"failed\": %lld, \"bad_requests\": %lld, \"generated\": %lld, \"coalesced\": %lld, "
+		"\"cache_hits\": %lld, \"largest_batch\": %lld, \"evicted\": %lld, \"cached_terrains\": %d, \"cache_mb\": %.1f, "
+		"\"queued_tiles\": %d, \"queued_terrains\": %d, \"tiles_per_s\": %.2f, \"mb_per_s\": %.2f, "
+		"\"latency_ms\": {\"p50\": %.2f, \"p95\": %.2f, \"p99\": %.2f, \"max\": %.2f}, "
+		"\"generate_ms\": {\"p50\": %.2f, \"p95\": %.2f, \"p99\": %.2f, \"max\": %.2f}}\n",
+		seconds, stats.tiles, stats.failed, stats.badRequests, stats.generated, stats.coalesced,
+		stats.cacheHits, stats.largestBatch, stats.evicted, (int) leastRecent.size(), cacheBytes / 1048576.0,
+		(int) sendQueue.size(), (int) generateQueue.size(), stats.tiles / seconds, stats.bytesSent / 1048576.0 / seconds,
+		framePercentile(&stats.latency, 50), framePercentile(&stats.latency, 95), framePercentile(&stats.latency, 99), framePercentile(&stats.latency, 100),
+		framePercentile(&stats.generation, 50), framePercentile(&stats.generation, 95), framePercentile(&stats.generation, 99), framePercentile(&stats.generation, 100));
+	return text;
+}
+
+
+/* Drops the least recently used terrains until the cache fits its budget; requests still sending keep theirs alive */
+void evictTerrains () {
+	while (cacheBytes > cacheBudget && leastRecent.size() > 1) {
+		TerrainKey oldest = leastRecent.back();
+		leastRecent.pop_back();
+		std::map<TerrainKey, std::shared_ptr<CachedTerrain> >::iterator found = cache.find(oldest);
+		cacheBytes -= found->second->bytes;
+		cache.erase(found);
+		stats.evicted++;
+	}
+}
+
+
+/* Queues a tile request: sent right away from a cached terrain, added to a generation under way, or starting a new one */
+void queueTile (TileRequest request, const TerrainKey &key) {
+	std::lock_guard<std::mutex> lock(queueMutex);
+	std::shared_ptr<CachedTerrain> &entry = cache[key];
+	if (!entry) {
+		entry = std::make_shared<CachedTerrain>();
+		entry->key = key;
+		generateQueue.push_back(entry);
+	} else if (entry->ready) {
+		leastRecent.splice(leastRecent.begin(), leastRecent, entry->use);
+		stats.cacheHits++;
+	} else {
+		stats.coalesced++;
+	}
+	request.source = entry;
+	if (entry->ready)
+		sendQueue.push_back(request);
+	else
+		entry->waiting.push_back(request);
+	workReady.notify_one();
+}
+
+
+/* Generates a terrain with its normals, as the batch tool does, and hands its waiting requests to the workers */
+void generateTerrain (std::shared_ptr<CachedTerrain> entry) {
+	TRACE_ZONE("generate terrain");
+	double start = frameClock();
+	Terrain *terrain = &entry->terrain;
+	initTerrain(terrain, entry->key.side, entry->key.side);
+	terrain->algorithm = entry->key.algorithm;
+	terrain->complexity = entry->key.complexity;
+	seedTerrain(terrain, entry->key.seed);
+	generateHeightValues(terrain, true);
+	generateHeightValues(terrain, false);
+	setNormals(terrain);
+
+	// No request generates onwards from these heights, so the checkpoints would only take up cache memory
+	resetGeneration(terrain);
+	double ms = frameClock() - start;
+
+	std::lock_guard<std::mutex> lock(queueMutex);
+	entry->ready = true;
+	entry->bytes = terrain->chunks.bytes();
+	leastRecent.push_front(entry->key);
+	entry->use = leastRecent.begin();
+	cacheBytes += entry->bytes;
+	stats.generated++;
+	stats.largestBatch = std::max(stats.largestBatch, (long long) entry->waiting.size());
+	recordFrame(&stats.generation, ms);
+	sendQueue.insert(sendQueue.end(), entry->waiting.begin(), entry->waiting.end());
+	entry->waiting.clear();
+	evictTerrains();
+	workReady.notify_all();
+}
+
+
+/* Worker loop: sends tiles whose terrain is ready first, otherwise generates the next terrain asked for */
+void runWorker () {
+	while (true) {
+		std::shared_ptr<CachedTerrain> generate;
+		TileRequest request;
+		{
+			std::unique_lock<std::mutex> lock(queueMutex);
+			workReady.wait(lock, []() { return !sendQueue.empty() || !generateQueue.empty(); });
+			if (!sendQueue.empty()) {
+				request = sendQueue.front();
+				sendQueue.pop_front();
+			} else {
+				generate = generateQueue.front();
+				generateQueue.pop_front();
+			}
+		}
+		if (generate) {
+			generateTerrain(generate);
+			continue;
+		}
+
+		// The stats are updated before closing, so a client that asks for them next finds its tile counted
+		size_t sent = sendTile(request);
+		double ms = frameClock() - request.start;
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			if (sent) {
+				stats.tiles++;
+				stats.bytesSent += sent;
+				recordFrame(&stats.latency, ms);
+			} else {
+				stats.failed++;
+			}
+		}
+		close(request.socket);
+	}
+}
+
+
+/* Value of name in a query string such as "seed=1&algorithm=n", or null */
+const char *queryValue (const std::string &query, const char *name, std::string &value) {
+	size_t length = strlen(name);
+	for (size_t at = 0; at < query.size(); ) {
+		size_t end = query.find('&', at);
+		if (end == std::string::npos)
+			end = query.size();
+		if (query.compare(at, length, name) == 0 && at + length < end && query[at + length] == '=') {
+			value = query.substr(at + length + 1, end - at - length - 1);
+			return value.c_str();
+		}
+		at = end + 1;
+	}
+	return 0;
+}
+
+
+/* Reads an integer query parameter within [low, high], returns false if it is missing or out of range */
+bool queryInt (const std::string &query, const char *name, long long low, long long high, long long *out) {
+	std::string value;
+	if (!queryValue(query, name, value) || value.empty())
+		return false;
+	char *end;
+	long long number = strtoll(value.c_str(), &end, 10);
+	if (*end || number < low || number > high)
+		return false;
+	*out = number;
+	return true;
+}
+
+
+/* Answers or queues a request whose head has been read (all of it, or what arrived before it stopped) */
+/* GET /tile?seed=&algorithm=&complexity=&resolution=&x=&z=[&normals=0] queues a tile, GET /stats answers right away */
+void handleRequest (int socket, const char *head, double start) {
+	// Replies are sent blocking, from here or by a worker, with a limit on clients that stop reading
+	fcntl(socket, F_SETFL, fcntl(socket, F_GETFL) & ~O_NONBLOCK);
+	timeval timeout = { SEND_SECONDS, 0 };
+	setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	char method[8], target[1024];
+	if (sscanf(head, "%7s %1023s", method, target) != 2 || strcmp(method, "GET") != 0) {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stats.badRequests++;
+		}
+		sendText(socket, "400 Bad Request", "text/plain", "Expected GET /tile?... or GET /stats\n");
+		return;
+	}
+	std::string path(target), query;
+	size_t mark = path.find('?');
+	if (mark != std::string::npos) {
+		query = path.substr(mark + 1);
+		path.resize(mark);
+	}
+
+	if (path == "/stats") {
+		sendText(socket, "200 OK", "application/json", statsJson());
+		return;
+	}
+	if (path != "/tile") {
+		sendText(socket, "404 Not Found", "text/plain", "Unknown path, expected /tile or /stats\n");
+		return;
+	}
+
+	long long seed, complexity, side, tileX, tileZ, normals = 1;
+	std::string algorithm;
+	bool ok = queryInt(query, "seed", 0, 0xffffffffLL, &seed) && queryValue(query, "algorithm", algorithm)
+		&& algorithm.size() == 1 && strchr("cfdns", algorithm[0]) && queryInt(query, "complexity", 0, MAX_COMPLEXITY, &complexity)
+		&& queryInt(query, "resolution", 2, maxSide, &side) && (query.find("normals=") == std::string::npos || queryInt(query, "normals", 0, 1, &normals));
+	int chunks = ok ? (int) ((side + CHUNK_SIZE - 1) / CHUNK_SIZE) : 0;
+	ok = ok && queryInt(query, "x", 0, chunks - 1, &tileX) && queryInt(query, "z", 0, chunks - 1, &tileZ);
+	if (!ok) {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stats.badRequests++;
+		}
+		char message[256];
+		snprintf(message, sizeof(message), "Expected seed, algorithm (c|f|d|n|s), complexity (0 to %d), resolution (2 to %d), "
+			"x and z (0 to resolution / %d), and optionally normals=0\n", MAX_COMPLEXITY, maxSide, CHUNK_SIZE);
+		sendText(socket, "400 Bad Request", "text/plain", message);
+		return;
+	}
+
+	TerrainKey key = { (unsigned int) seed, algorithm[0], (int) complexity, (int) side };
+	TileRequest request = { socket, (int) tileX, (int) tileZ, normals != 0, start, std::shared_ptr<CachedTerrain>() };
+	queueTile(request, key);
+}
+
+
+/* Opens the listening socket, on 127.0.0.1:port or at a Unix socket path */
+int openListener (int port, const char *unixPath) {
+	int listener;
+	if (unixPath) {
+		sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (strlen(unixPath) >= sizeof(address.sun_path))
+			return -1;
+		strcpy(address.sun_path, unixPath);
+		unlink(unixPath);
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0 || bind(listener, (sockaddr *) &address, sizeof(address)) != 0)
+			return -1;
+	} else {
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		listener = socket(AF_INET, SOCK_STREAM, 0);
+		int reuse = 1;
+		if (listener < 0 || setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+			|| bind(listener, (sockaddr *) &address, sizeof(address)) != 0)
+			return -1;
+	}
+	return listen(listener, 128) == 0 ? listener : -1;
+}
+
+
+/* Connects to the server for one request, returns the socket or -1 */
+int connectServer (int port, const char *unixPath) {
+	int server;
+	if (unixPath) {
+		sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		strncpy(address.sun_path, unixPath, sizeof(address.sun_path) - 1);
+		server = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (server >= 0 && connect(server, (sockaddr *) &address, sizeof(address)) == 0)
+			return server;
+	} else {
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		server = socket(AF_INET, SOCK_STREAM, 0);
+		if (server >= 0 && connect(server, (sockaddr *) &address, sizeof(address)) == 0)
+			return server;
+	}
+	if (server >= 0)
+		close(server);
+	return -1;
+}
+
+
+/* Sends a GET for target and reads the whole response, returns the status code (0 if the connection failed) */
+int fetch (int port, const char *unixPath, const char *target, std::string &body) {
+	int server = connectServer(port, unixPath);
+	if (server < 0)
+		return 0;
+	char request[512];
+	snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n", target);
+	std::string response;
+	if (sendAll(server, request, strlen(request))) {
+		char buffer[SEND_BYTES];
+		ssize_t received;
+		while ((received = recv(server, buffer, sizeof(buffer), 0)) > 0)
+			response.append(buffer, received);
+	}
+	close(server);
+
+	int status = 0;
+	size_t split = response.find("\r\n\r\n");
+	if (split == std::string::npos || sscanf(response.c_str(), "HTTP/1.%*d %d", &status) != 1)
+		return 0;
+	body = response.substr(split + 4);
+	return status;
+}
+
+
+/* Test client: sends requests for every tile of a few terrains from several connections at once, so that requests */
+/* for the same terrain overlap, checks each tile's size and header, then prints the latency and the server's stats */
+int runClient (int port, const char *unixPath, int requests, int connections, char algorithm, int side, int complexity, int seeds) {
+	int chunks = (side + CHUNK_SIZE - 1) / CHUNK_SIZE, tiles = chunks * chunks;
+	std::atomic<int> next(0), failures(0);
+	std::mutex timesMutex;
+	FrameTimer times;
+	resetFrameTimer(&times);
+	long long bytes = 0;
+	double start = frameClock();
+
+	std::vector<std::thread> clients;
+	for (int c = 0; c < connections; c++) {
+		clients.push_back(std::thread([&]() {
+			int i;
+			while ((i = next++) < requests) {
+				// Consecutive requests go to different terrains, so each terrain's tiles are asked for by several connections at once
+				int tile = (i / seeds) % tiles, tileX = tile % chunks, tileZ = tile / chunks;
+				char target[256];
+				snprintf(target, sizeof(target), "/tile?seed=%d&algorithm=%c&complexity=%d&resolution=%d&x=%d&z=%d", 1 + i % seeds, algorithm,
+					complexity, side, tileX, tileZ);
+				double requestStart = frameClock();
+				std::string body;
+				int status = fetch(port, unixPath, target, body);
+				double ms = frameClock() - requestStart;
+
+				int width = std::min(CHUNK_SIZE, side - tileX * CHUNK_SIZE), depth = std::min(CHUNK_SIZE, side - tileZ * CHUNK_SIZE);
+				int header[6];
+				bool ok = status == 200 && body.size() == tileBytes(width, depth, true);
+				if (ok) {
+					memcpy(header, body.data(), sizeof(header));
+					ok = memcmp(header, "TILE", 4) == 0 && header[1] == TILE_VERSION && header[2] == width && header[3] == depth
+						&& header[4] == tileX * CHUNK_SIZE && header[5] == tileZ * CHUNK_SIZE;
+				}
+				if (!ok) {
+					printf("Request %s failed (status %d, %zu bytes)\n", target, status, body.size());
+					failures++;
+					continue;
+				}
+				std::lock_guard<std::mutex> lock(timesMutex);
+				recordFrame(&times, ms);
+				bytes += body.size();
+			}
+		}));
+	}
+	for (size_t c = 0; c < clients.size(); c++)
+		clients[c].join();
+	double seconds = (frameClock() - start) / 1000;
+
+	printf("%d of %d tiles of %d %dx%d %c terrains in %.2f s over %d connections: %.1f tiles/s, %.1f MB/s\n", requests - failures.load(), requests,
+		seeds, side, side, algorithm, seconds, connections, (requests - failures.load()) / seconds, bytes / 1048576.0 / seconds);
+	printFrameTimer(&times, "Tile latency");
+	std::string body;
+	if (fetch(port, unixPath, "/stats", body) == 200)
+		printf("Server stats: %s", body.c_str());
+	return failures == 0 ? 0 : 1;
+}
+
+
+/* Main Method */
+int main (int argc, char** argv) {
+	int port = 8080;
+	const char *unixPath = 0;
+	int threads = (int) std::thread::hardware_concurrency();
+	int passThreads = 0;
+	bool client = false;
+	int requests = 256, connections = 8, side = 1024, complexity = 100, seeds = 4;
+	char algorithm = 'n';
+
+	// Parse the command line
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "-port") == 0 && hasValue) {
+			port = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-unix") == 0 && hasValue) {
+			unixPath = argv[++i];
+		} else if (strcmp(argv[i], "-t") == 0 && hasValue) {
+			threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-p") == 0 && hasValue) {
+			passThreads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-m") == 0 && hasValue) {
+			cacheBudget = (size_t) std::max(atoi(argv[++i]), 1) << 20;
+		} else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+			maxSide = std::min(std::max(atoi(argv[++i]), 2), MAX_TERRAIN_SIDE);
+		} else if (strcmp(argv[i], "-client") == 0) {
+			client = true;
+		} else if (strcmp(argv[i], "-n") == 0 && hasValue) {
+			requests = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-c") == 0 && hasValue) {
+			connections = std::max(atoi(argv[++i]), 1);
+		} else if (strcmp(argv[i], "-a") == 0 && hasValue) {
+			algorithm = argv[++i][0];
+		} else if (strcmp(argv[i], "-r") == 0 && hasValue) {
+			side = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-k") == 0 && hasValue) {
+			complexity = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-S") == 0 && hasValue) {
+			seeds = std::max(atoi(argv[++i]), 1);
+		} else {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (client) {
+		if (side < 2) {
+			printf("Invalid terrain side %d\n", side);
+			return 1;
+		}
+		return runClient(port, unixPath, requests, connections, algorithm, side, complexity, seeds);
+	}
+
+	terrainVerbose = false;
+	setWorkerThreads(passThreads);
+	int listener = openListener(port, unixPath);
+	if (listener < 0) {
+		if (unixPath)
+			printf("Could not listen on %s\n", unixPath);
+		else
+			printf("Could not listen on 127.0.0.1:%d\n", port);
+		return 1;
+	}
+	if (unixPath)
+		printf("Serving tiles on %s", unixPath);
+	else
+		printf("Serving tiles on http://127.0.0.1:%d", port);
+	printf(" with %d workers and %d pass threads, terrains up to %dx%d, %zu MB cache\n", std::max(threads, 1), workerThreads(), maxSide, maxSide, cacheBudget >> 20);
+	fflush(stdout);
+
+	startTime = frameClock();
+	resetFrameTimer(&stats.latency);
+	resetFrameTimer(&stats.generation);
+	for (int t = 0; t < std::max(threads, 1); t++)
+		std::thread(runWorker).detach();
+
+	// Request heads are read here as their bytes arrive, so a slow or idle client holds up nobody else; complete
+	// requests are queued and the workers generate and send
+	fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+	std::vector<PendingHead> pending;
+	std::vector<pollfd> polled;
+	while (true) {
+		polled.clear();
+		pollfd listening = { listener, POLLIN, 0 };
+		polled.push_back(listening);
+		for (size_t i = 0; i < pending.size(); i++) {
+			pollfd reading = { pending[i].socket, POLLIN, 0 };
+			polled.push_back(reading);
+		}
+		if (poll(&polled[0], polled.size(), 1000) < 0)
+			continue;
+		double now = frameClock();
+
+		// A head is finished once it is complete, too long, closed, or out of time, and then answered as it stands
+		std::vector<PendingHead> reading;
+		for (size_t i = 0; i < pending.size(); i++) {
+			PendingHead &connection = pending[i];
+			bool finished = now - connection.start > RECEIVE_SECONDS * 1000.0;
+			if (polled[i + 1].revents) {
+				char buffer[REQUEST_BYTES];
+				ssize_t received = recv(connection.socket, buffer, REQUEST_BYTES - connection.head.size(), 0);
+				if (received > 0)
+					connection.head.append(buffer, received);
+				finished = finished || received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR)
+					|| connection.head.find("\r\n\r\n") != std::string::npos || connection.head.size() >= REQUEST_BYTES;
+			}
+			if (finished)
+				handleRequest(connection.socket, connection.head.c_str(), connection.start);
+			else
+				reading.push_back(connection);
+		}
+		pending.swap(reading);
+
+		if (polled[0].revents) {
+			int connection;
+			while ((connection = accept(listener, 0, 0)) >= 0) {
+				fcntl(connection, F_SETFL, fcntl(connection, F_GETFL) | O_NONBLOCK);
+				PendingHead head = { connection, now, std::string() };
+				pending.push_back(head);
+			}
+		}
+	}
+}
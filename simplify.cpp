@@ -0,0 +1,221 @@
+/*
+Nolan Slade
+Terrain Generator - error-bounded mesh simplification
+*/
+
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include <algorithm>
+
+#include "simplify.h"
+#include "threadpool.h"
+
+// A vertex that must be kept whatever the allowed error: it halves the side of a square whose neighbour across
+// that side is split into smaller squares (along the far edges of the terrain), so it is a corner over there
+#define FORCED_ERROR	FLT_MAX
+
+
+/* Error of the triangle a, b, c: the largest height difference between the plane through its corners and */
+/* the grid points it covers, its edges included. Every side of an RTIN triangle is axis-aligned or diagonal, */
+/* so where a row of the grid crosses them is always a whole vertex */
+static float triangleError (const ChunkGrid &grid, const int *a, const int *b, const int *c) {
+	const int *corners[] = { a, b, c };
+	float base = grid.height(a[0], a[1]);
+	float toB = grid.height(b[0], b[1]) - base, toC = grid.height(c[0], c[1]) - base;
+	float bx = (float) (b[0] - a[0]), bz = (float) (b[1] - a[1]), cx = (float) (c[0] - a[0]), cz = (float) (c[1] - a[1]);
+	float determinant = bx * cz - cx * bz;
+	float slopeX = (toB * cz - toC * bz) / determinant;
+	float slopeZ = (bx * toC - cx * toB) / determinant;
+
+	int zLow = std::min(a[1], std::min(b[1], c[1])), zHigh = std::max(a[1], std::max(b[1], c[1]));
+	float worst = 0;
+	for (int z = zLow; z <= zHigh; z++) {
+		// Span of the row inside the triangle
+		int low = INT_MAX, high = INT_MIN;
+		for (int e = 0; e < 3; e++) {
+			const int *p = corners[e], *q = corners[(e + 1) % 3];
+			if (z < std::min(p[1], q[1]) || z > std::max(p[1], q[1]))
+				continue;
+			if (p[1] == q[1]) {
+				low = std::min(low, std::min(p[0], q[0]));
+				high = std::max(high, std::max(p[0], q[0]));
+			} else {
+				int x = p[0] + (z - p[1]) * (q[0] - p[0]) / (q[1] - p[1]);
+				low = std::min(low, x);
+				high = std::max(high, x);
+			}
+		}
+
+		const TerrainChunk *chunk = &grid.chunkAt(low, z);
+		const float *row = chunk->field.heightRow(z - chunk->z0);
+		float rowPlane = base + slopeZ * (z - a[1]);
+		for (int x = low; x <= high; x++) {
+			// A triangle only reaches into the next chunk by its last column
+			if (x - chunk->x0 == chunk->field.width()) {
+				chunk = &grid.chunkAt(x, z);
+				row = chunk->field.heightRow(z - chunk->z0);
+			}
+			worst = std::max(worst, fabsf(row[x - chunk->x0] - (rowPlane + slopeX * (x - a[0]))));
+		}
+	}
+	return worst;
+}
+
+
+/* Measures the vertices of chunk i that halve a side of a size by size square */
+/* Each such side is the long side of a triangle in the square on either side of it */
+void TerrainSimplifier::measureSides (const ChunkGrid &grid, int i, int size) {
+	const ChunkErrors &chunk = chunks[i];
+	int half = size / 2, quarter = size / 4;
+	int chunkDepth = (int) chunk.errors.size() / chunk.width;
+
+	// Pass 0 takes the sides along x, pass 1 the sides along z
+	for (int pass = 0; pass < 2; pass++) {
+		int along[] = { pass ? 0 : 1, pass ? 1 : 0 };
+		int across[] = { along[1], along[0] };
+		int acrossLimit = pass ? width : depth;
+		for (int z = chunk.z0 + pass * half; z < chunk.z0 + chunkDepth; z += size) {
+			for (int x = chunk.x0 + (1 - pass) * half; x < chunk.x0 + chunk.width; x += size) {
+				int middle[] = { x, z };
+				int a[] = { x - half * along[0], z - half * along[1] };
+				int b[] = { x + half * along[0], z + half * along[1] };
+				int acrossMiddle = pass ? x : z;
+
+				float worst = 0;
+				int sides = 0;
+				bool forced = false;
+				for (int side = -1; side <= 1; side += 2) {
+					int corner[] = { a[0] + (side < 0 ? -size : 0) * across[0], a[1] + (side < 0 ? -size : 0) * across[1] };
+					if (corner[0] < 0 || corner[1] < 0 || !squareFits(corner[0], corner[1], size)) {
+						// Cells on this side but no square of this size: they belong to smaller squares
+						if (side < 0 ? acrossMiddle >= 1 : acrossMiddle + 1 <= acrossLimit - 1)
+							forced = true;
+						continue;
+					}
+					int apex[] = { x + side * half * across[0], z + side * half * across[1] };
+					worst = std::max(worst, triangleError(grid, a, b, apex));
+					if (quarter > 0) {
+						for (int end = -1; end <= 1; end += 2)
+							worst = std::max(worst, error(middle[0] + end * quarter * along[0] + side * quarter * across[0],
+								middle[1] + end * quarter * along[1] + side * quarter * across[1]));
+					}
+					sides++;
+				}
+
+				// With no square of this size on either side the vertex is only ever a corner of smaller ones
+				if (sides > 0)
+					error(x, z) = forced ? FORCED_ERROR : worst;
+			}
+		}
+	}
+}
+
+
+/* Measures the vertices of chunk i at the centre of a size by size square, which halve its diagonal */
+void TerrainSimplifier::measureCentres (const ChunkGrid &grid, int i, int size) {
+	const ChunkErrors &chunk = chunks[i];
+	int half = size / 2;
+	int chunkDepth = (int) chunk.errors.size() / chunk.width;
+
+	for (int z = chunk.z0 + half; z < chunk.z0 + chunkDepth; z += size) {
+		for (int x = chunk.x0 + half; x < chunk.x0 + chunk.width; x += size) {
+			int x0 = x - half, z0 = z - half;
+			if (!squareFits(x0, z0, size))
+				continue;
+
+			// Neighbouring squares alternate diagonals, as the halving of larger squares leaves them
+			bool rising = ((x0 / size + z0 / size) & 1) == 0;
+			int a[] = { x0, rising ? z0 : z0 + size };
+			int b[] = { x0 + size, rising ? z0 + size : z0 };
+			int apex1[] = { rising ? x0 + size : x0, z0 };
+			int apex2[] = { rising ? x0 : x0 + size, z0 + size };
+
+			float worst = std::max(triangleError(grid, a, b, apex1), triangleError(grid, a, b, apex2));
+			worst = std::max(worst, std::max(error(x, z0), error(x, z0 + size)));
+			worst = std::max(worst, std::max(error(x0, z), error(x0 + size, z)));
+			error(x, z) = worst;
+		}
+	}
+}
+
+
+/* Measures the error of every vertex, from the smallest triangles up so that each vertex can take in those below it */
+void TerrainSimplifier::build (const Terrain *terrain) {
+	const ChunkGrid &grid = terrain->chunks;
+	width = terrain->width;
+	depth = terrain->depth;
+	chunksX = grid.chunksX();
+	chunks.resize(grid.count());
+	for (int i = 0; i < grid.count(); i++) {
+		const TerrainChunk &chunk = grid.chunk(i);
+		chunks[i].x0 = chunk.x0;
+		chunks[i].z0 = chunk.z0;
+		chunks[i].width = chunk.field.width();
+		chunks[i].errors.assign((size_t) chunk.field.width() * chunk.field.depth(), 0.0f);
+	}
+
+	// Each chunk writes only its own vertices, and reads the smaller triangles finished by the pass before
+	for (int size = 2; size <= CHUNK_SIZE; size *= 2) {
+		parallelFor(grid.count(), 1, [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+				measureSides(grid, i, size);
+		});
+		parallelFor(grid.count(), 1, [&](int begin, int end) {
+			for (int i = begin; i < end; i++)
+				measureCentres(grid, i, size);
+		});
+	}
+}
+
+
+/* Adds triangle a, b, c, whose long side runs from a to b, or its halves if it is not within the allowed error */
+void TerrainSimplifier::triangulateTriangle (const int *a, const int *b, const int *c, const ChunkErrors &chunk, float maxError, int stride,
+	std::vector<unsigned int> &triangles) const {
+	// Triangles of a single cell have no vertex to split at
+	if ((a[0] + b[0]) % 2 == 0 && (a[1] + b[1]) % 2 == 0) {
+		int middle[] = { (a[0] + b[0]) / 2, (a[1] + b[1]) / 2 };
+		if (error(middle[0], middle[1]) > maxError) {
+			triangulateTriangle(a, c, middle, chunk, maxError, stride, triangles);
+			triangulateTriangle(c, b, middle, chunk, maxError, stride, triangles);
+			return;
+		}
+	}
+
+	// Same turn as the strips: for the first triangle of a cell, (x, z), (x, z + 1), (x + 1, z)
+	bool turn = (b[1] - a[1]) * (c[0] - a[0]) - (b[0] - a[0]) * (c[1] - a[1]) > 0;
+	const int *corners[] = { a, turn ? b : c, turn ? c : b };
+	for (int k = 0; k < 3; k++)
+		triangles.push_back((unsigned int) ((corners[k][1] - chunk.z0) * stride + corners[k][0] - chunk.x0));
+}
+
+
+/* Covers the cells of a size by size square with the largest aligned squares that fit in the terrain */
+void TerrainSimplifier::triangulateSquare (int x, int z, int size, const ChunkErrors &chunk, float maxError, int stride,
+	std::vector<unsigned int> &triangles) const {
+	if (x >= width - 1 || z >= depth - 1)
+		return;
+	if (!squareFits(x, z, size)) {
+		int half = size / 2;
+		triangulateSquare(x, z, half, chunk, maxError, stride, triangles);
+		triangulateSquare(x + half, z, half, chunk, maxError, stride, triangles);
+		triangulateSquare(x, z + half, half, chunk, maxError, stride, triangles);
+		triangulateSquare(x + half, z + half, half, chunk, maxError, stride, triangles);
+		return;
+	}
+
+	bool rising = ((x / size + z / size) & 1) == 0;
+	int a[] = { x, rising ? z : z + size };
+	int b[] = { x + size, rising ? z + size : z };
+	int apex1[] = { rising ? x + size : x, z };
+	int apex2[] = { rising ? x : x + size, z + size };
+	triangulateTriangle(a, b, apex1, chunk, maxError, stride, triangles);
+	triangulateTriangle(b, a, apex2, chunk, maxError, stride, triangles);
+}
+
+
+/* Appends the triangles of chunk i within maxError of the grid */
+void TerrainSimplifier::triangulate (int i, float maxError, int stride, std::vector<unsigned int> &triangles) const {
+	const ChunkErrors &chunk = chunks[i];
+	triangulateSquare(chunk.x0, chunk.z0, CHUNK_SIZE, chunk, maxError, stride, triangles);
+}
@@ -0,0 +1,57 @@
+/*
+Nolan Slade
+Terrain Generator - error-bounded mesh simplification
+*/
+
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include <vector>
+
+#include "terrain.h"
+
+/* Right-triangulated irregular network (RTIN) over the terrain grid: each chunk is split into aligned */
+/* power-of-two squares, each square into two right triangles along a diagonal, and each triangle is halved */
+/* at the midpoint of its longest side until it is within the allowed error. A vertex's error is the largest */
+/* height difference between the grid and either triangle it splits, or anything below them, so every grid */
+/* point ends up within the allowed error of the simplified surface. Triangles on both sides of a shared */
+/* side read the same error, so the triangulation has no cracks, across chunks as well */
+class TerrainSimplifier {
+public:
+	/* Measures the error of every vertex, call again after the heights change */
+	void build (const Terrain *terrain);
+
+	/* Appends the triangles covering the cells of chunk i, three indices each, counter-clockwise seen from above */
+	/* like the strips. A vertex's index is (z - z0) * stride + (x - x0), z0 and x0 being the chunk's first vertex */
+	void triangulate (int i, float maxError, int stride, std::vector<unsigned int> &triangles) const;
+
+private:
+	struct ChunkErrors {
+		int x0, z0;
+		int width;				// Vertices across the chunk, the row length of errors
+		std::vector<float> errors;		// One per vertex the chunk owns, row by row
+	};
+
+	float &error (int x, int z) {
+		ChunkErrors &c = chunks[(z >> CHUNK_SHIFT) * chunksX + (x >> CHUNK_SHIFT)];
+		return c.errors[(z - c.z0) * c.width + (x - c.x0)];
+	}
+	float error (int x, int z) const {
+		const ChunkErrors &c = chunks[(z >> CHUNK_SHIFT) * chunksX + (x >> CHUNK_SHIFT)];
+		return c.errors[(z - c.z0) * c.width + (x - c.x0)];
+	}
+
+	/* True if the size by size square with its first vertex at (x, z) lies within the terrain */
+	bool squareFits (int x, int z, int size) const { return x + size <= width - 1 && z + size <= depth - 1; }
+
+	void measureSides (const ChunkGrid &grid, int i, int size);
+	void measureCentres (const ChunkGrid &grid, int i, int size);
+	void triangulateSquare (int x, int z, int size, const ChunkErrors &chunk, float maxError, int stride, std::vector<unsigned int> &triangles) const;
+	void triangulateTriangle (const int *a, const int *b, const int *c, const ChunkErrors &chunk, float maxError, int stride, std::vector<unsigned int> &triangles) const;
+
+	std::vector<ChunkErrors> chunks;		// In the same order as the chunks of the terrain
+	int chunksX;
+	int width, depth;
+};
+
+#endif
@@ -0,0 +1,1034 @@
+/*
+Nolan Slade
+Terrain Generator
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <map>
+
+#include "terrain.h"
+#include "noise.h"
+#include "threadpool.h"
+#include "random.h"
+#include "trace.h"
+
+#define ROWS_PER_TASK	16		// Rows of the grid handed to a worker thread at a time
+#define CIRCLES_PER_TASK	8		// Circles of one wave handed to a worker thread at a time
+#define CIRCLE_BUCKET	16		// Side of the coarse grid cells used to find overlapping circles
+#define WALK_STEPS	100		// Steps of each particle deposition walk
+#define DEPOSIT_TILE	16		// Side of the tiles deposits are counted in, divides CHUNK_SIZE so that a tile never crosses chunks
+
+bool terrainVerbose = true;
+float baseGreen[] = {0.168, 0.388, 0.196};	// Topographic green (lowest point)
+
+
+/* Sizes the chunks of height values and normals for a terrain of the given size, can be called again to resize */
+void initTerrain (Terrain *terrain, int width, int depth) {
+	terrain->width 			= width;
+	terrain->depth 			= depth;
+	terrain->chunks.resize(width, depth);
+	terrain->bounds.resize(terrain->chunks);
+	terrain->maxHeight 		= 0;
+	terrain->minHeight 		= 0;
+	terrain->compact		= false;
+	resetGeneration(terrain);
+}
+
+
+/* Releases the memory held by the terrain */
+void freeTerrain (Terrain *terrain) {
+	terrain->chunks.release();
+	terrain->bounds.resize(terrain->chunks);
+	resetGeneration(terrain);
+	terrain->width = terrain->depth = 0;
+	terrain->compact = false;
+}
+
+
+/* Sets the seed the terrain is generated from, the same seed always gives the same terrain */
+void seedTerrain (Terrain *terrain, unsigned int seed) {
+	terrain->seed = seed;
+}
+
+
+/* Normals of one row of faces (fixed z) next to a run of vertices, one structure-of-arrays entry per face */
+/* For vertices firstX to firstX + count - 1, entry k holds face (firstX - 1 + k, z); faces outside the terrain */
+/* stay zero so that the vertex pass needs no edge cases */
+struct FaceRow {
+	std::vector<float> t1x, t1y, t1z;		// First triangle of the face
+	std::vector<float> t2x, t2y, t2z;		// Second triangle of the face
+	std::vector<float> qx, qy, qz;			// The face as one quad
+
+	explicit FaceRow (int count) : t1x(count + 1), t1y(count + 1), t1z(count + 1), t2x(count + 1), t2y(count + 1), t2z(count + 1),
+		qx(count + 1), qy(count + 1), qz(count + 1) {}
+
+	void clear () {
+		std::fill(t1x.begin(), t1x.end(), 0.0f); std::fill(t1y.begin(), t1y.end(), 0.0f); std::fill(t1z.begin(), t1z.end(), 0.0f);
+		std::fill(t2x.begin(), t2x.end(), 0.0f); std::fill(t2y.begin(), t2y.end(), 0.0f); std::fill(t2z.begin(), t2z.end(), 0.0f);
+		std::fill(qx.begin(), qx.end(), 0.0f); std::fill(qy.begin(), qy.end(), 0.0f); std::fill(qz.begin(), qz.end(), 0.0f);
+	}
+};
+
+
+/* Copies the heights of row z from firstX to firstX + count - 1, reaching into neighbouring chunks */
+/* Vertices outside the terrain read as 0, the faces they would belong to are never used */
+static void gatherHeights (const Terrain *terrain, int z, int firstX, int count, float *out) {
+	int start = std::max(firstX, 0);
+	int end = std::min(firstX + count, terrain->width);
+	std::fill(out, out + count, 0.0f);
+	if (start < end)
+		terrain->chunks.copyHeights(start, z, end - start, out + (start - firstX));
+}
+
+
+/* Fills a row of normalized face normals for vertices firstX to firstX + count - 1 straight from the heights */
+/* near and far are scratch space for count + 2 heights each */
+static void computeFaceRow (const Terrain *terrain, int z, int firstX, int count, float *near, float *far, FaceRow &row) {
+	row.clear();
+	if (z < 0 || z >= terrain->depth - 1)
+		return;
+
+	// Heights of rows z and z + 1, from one vertex before the run to one after it
+	gatherHeights(terrain, z, firstX - 1, count + 2, near);
+	gatherHeights(terrain, z + 1, firstX - 1, count + 2, far);
+
+	// Only faces 0 to width - 2 exist
+	int first = firstX == 0 ? 1 : 0;
+	int last = std::min(count + 1, terrain->width - firstX);
+	const float spacing = VERT_SPACING;
+	const float spacingSquared = spacing * spacing;
+
+	for (int k = first; k < last; k++) {
+		// With A = (0, a, S) to (x, z+1), B = (S, b, S) to (x+1, z+1) and C = (S, c, 0) to (x+1, z),
+		// triangle one is A X B, triangle two is B X C and the quad is A X C
+		float a = far[k] - near[k];
+		float b = far[k + 1] - near[k];
+		float c = near[k + 1] - near[k];
+
+		float oneX = spacing * (a - b), oneZ = -a * spacing;
+		float twoX = -c * spacing, twoZ = spacing * (c - b);
+
+		float inverseOne = 1.0f / sqrtf(oneX * oneX + spacingSquared * spacingSquared + oneZ * oneZ);
+		float inverseTwo = 1.0f / sqrtf(twoX * twoX + spacingSquared * spacingSquared + twoZ * twoZ);
+		float inverseQuad = 1.0f / sqrtf(twoX * twoX + spacingSquared * spacingSquared + oneZ * oneZ);
+
+		row.t1x[k] = oneX * inverseOne; row.t1y[k] = spacingSquared * inverseOne; row.t1z[k] = oneZ * inverseOne;
+		row.t2x[k] = twoX * inverseTwo; row.t2y[k] = spacingSquared * inverseTwo; row.t2z[k] = twoZ * inverseTwo;
+		row.qx[k] = twoX * inverseQuad; row.qy[k] = spacingSquared * inverseQuad; row.qz[k] = oneZ * inverseQuad;
+	}
+}
+
+
+/* Vertex normals of rows firstRow to lastRow - 1 and columns firstColumn to lastColumn - 1 of one chunk */
+/* A vertex averages the normals of the triangles (up to six) or quads (up to four) around it */
+/* Only two rows of face normals are kept at a time, and faces outside the terrain are zero, so there are no edge cases */
+static void setBlockNormals (const Terrain *terrain, TerrainChunk &chunk, int firstRow, int lastRow, int firstColumn, int lastColumn) {
+	Heightfield &field = chunk.field;
+	int width = lastColumn - firstColumn;
+	std::vector<float> near(width + 2), far(width + 2);
+	FaceRow before(width), after(width);		// Face rows z - 1 and z
+	computeFaceRow(terrain, chunk.z0 + firstRow - 1, chunk.x0 + firstColumn, width, &near[0], &far[0], after);
+
+	for (int z = firstRow; z < lastRow; z++) {
+		std::swap(before, after);
+		computeFaceRow(terrain, chunk.z0 + z, chunk.x0 + firstColumn, width, &near[0], &far[0], after);
+
+		// Faces around vertex (x, z): (x, z) and (x-1, z) after it, (x, z-1) and (x-1, z-1) before it
+		// Triangles: both of (x, z) and (x-1, z-1), the second of (x-1, z) and the first of (x, z-1)
+		int start = field.index(firstColumn, z);
+		float *triangleX = field.triangleNormals(0) + start, *triangleY = field.triangleNormals(1) + start, *triangleZ = field.triangleNormals(2) + start;
+		float *quadX = field.quadNormals(0) + start, *quadY = field.quadNormals(1) + start, *quadZ = field.quadNormals(2) + start;
+		for (int x = 0; x < width; x++) {
+			float tx = after.t1x[x + 1] + after.t2x[x + 1] + after.t2x[x] + before.t1x[x] + before.t2x[x] + before.t1x[x + 1];
+			float ty = after.t1y[x + 1] + after.t2y[x + 1] + after.t2y[x] + before.t1y[x] + before.t2y[x] + before.t1y[x + 1];
+			float tz = after.t1z[x + 1] + after.t2z[x + 1] + after.t2z[x] + before.t1z[x] + before.t2z[x] + before.t1z[x + 1];
+			float qx = after.qx[x + 1] + after.qx[x] + before.qx[x + 1] + before.qx[x];
+			float qy = after.qy[x + 1] + after.qy[x] + before.qy[x + 1] + before.qy[x];
+			float qz = after.qz[x + 1] + after.qz[x] + before.qz[x + 1] + before.qz[x];
+
+			// Every vertex touches at least one face and every face points up, so the sums are never zero
+			float inverseTriangle = 1.0f / sqrtf(tx * tx + ty * ty + tz * tz);
+			float inverseQuad = 1.0f / sqrtf(qx * qx + qy * qy + qz * qz);
+			triangleX[x] = tx * inverseTriangle; triangleY[x] = ty * inverseTriangle; triangleZ[x] = tz * inverseTriangle;
+			quadX[x] = qx * inverseQuad; quadY[x] = qy * inverseQuad; quadZ[x] = qz * inverseQuad;
+		}
+	}
+}
+
+
+/* Calculates the vertex normals for gourard shading in a single pass over the height map */
+void setNormals (Terrain *terrain) {
+	TRACE_ZONE("normals");
+	if (terrainVerbose)
+		printf("Calculating vertex normals...\n");
+
+	// Each band of rows within one chunk is independent, reading a one vertex border from the neighbouring chunks
+	int bandsPerChunk = (CHUNK_SIZE + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+	int tasks = terrain->chunks.count() * bandsPerChunk;
+	parallelFor(tasks, 1, [terrain, bandsPerChunk](int firstTask, int lastTask) {
+		for (int task = firstTask; task < lastTask; task++) {
+			TerrainChunk &chunk = terrain->chunks.chunk(task / bandsPerChunk);
+			TRACE_ZONE("normals band");
+			int firstRow = (task % bandsPerChunk) * ROWS_PER_TASK;
+			int lastRow = std::min(firstRow + ROWS_PER_TASK, chunk.field.depth());
+			if (firstRow < lastRow)
+				setBlockNormals(terrain, chunk, firstRow, lastRow, 0, chunk.field.width());
+		}
+	});
+}
+
+
+/* Recalculates the vertex normals inside a rectangle only, giving the same normals as setNormals */
+/* After changing the heights of a rectangle, pass it widened by one vertex on every side */
+void setNormalsInRect (Terrain *terrain, const TerrainRect &rect) {
+	TRACE_ZONE("normals rect");
+	if (rect.firstX >= rect.lastX || rect.firstZ >= rect.lastZ)
+		return;
+	int firstCX = rect.firstX >> CHUNK_SHIFT, lastCX = ((rect.lastX - 1) >> CHUNK_SHIFT) + 1;
+	int firstCZ = rect.firstZ >> CHUNK_SHIFT, lastCZ = ((rect.lastZ - 1) >> CHUNK_SHIFT) + 1;
+	int columns = lastCX - firstCX;
+	parallelFor(columns * (lastCZ - firstCZ), 1, [&](int first, int last) {
+		for (int c = first; c < last; c++) {
+			TerrainChunk &chunk = terrain->chunks.chunk(firstCX + c % columns, firstCZ + c / columns);
+			setBlockNormals(terrain, chunk, std::max(rect.firstZ - chunk.z0, 0), std::min(rect.lastZ - chunk.z0, chunk.field.depth()),
+				std::max(rect.firstX - chunk.x0, 0), std::min(rect.lastX - chunk.x0, chunk.field.width()));
+		}
+	});
+}
+
+
+/* Applies one dab of the brush centred on vertex position (x, z) and returns the rectangle whose heights or */
+/* normals changed: the vertices the brush reaches plus a one vertex border, empty if it is off the terrain */
+/* Chunk height ranges, chunk boxes and normals are brought up to date within the rectangle only; the terrain's */
+/* own range, which the colours are scaled by, is left for finishSculpting so that a stroke keeps one colouring */
+TerrainRect sculptTerrain (Terrain *terrain, const SculptBrush &brush, float x, float z) {
+	TRACE_ZONE("sculpt");
+	TerrainRect changed = { 0, 0, 0, 0 };
+	int firstX = std::max((int) ceilf(x - brush.radius), 0), lastX = std::min((int) floorf(x + brush.radius) + 1, terrain->width);
+	int firstZ = std::max((int) ceilf(z - brush.radius), 0), lastZ = std::min((int) floorf(z + brush.radius) + 1, terrain->depth);
+	if (firstX >= lastX || firstZ >= lastZ)
+		return changed;
+
+	// Smoothing averages the heights from before the dab, so keep them with a one vertex border
+	TerrainRect source = { std::max(firstX - 1, 0), std::max(firstZ - 1, 0), std::min(lastX + 1, terrain->width), std::min(lastZ + 1, terrain->depth) };
+	int sourceWidth = source.lastX - source.firstX;
+	std::vector<float> before;
+	if (brush.mode == 's') {
+		before.resize((size_t) sourceWidth * (source.lastZ - source.firstZ));
+		for (int row = source.firstZ; row < source.lastZ; row++)
+			terrain->chunks.copyHeights(source.firstX, row, sourceWidth, &before[(size_t) (row - source.firstZ) * sourceWidth]);
+	}
+
+	// Chunk by chunk, so that each chunk's height range can follow its own changes
+	int firstCX = firstX >> CHUNK_SHIFT, lastCX = ((lastX - 1) >> CHUNK_SHIFT) + 1;
+	int firstCZ = firstZ >> CHUNK_SHIFT, lastCZ = ((lastZ - 1) >> CHUNK_SHIFT) + 1;
+	for (int cz = firstCZ; cz < lastCZ; cz++) {
+		for (int cx = firstCX; cx < lastCX; cx++) {
+			TerrainChunk &chunk = terrain->chunks.chunk(cx, cz);
+			float high = chunk.maxHeight, low = chunk.minHeight;
+			bool rescan = false;
+			for (int vz = std::max(firstZ, chunk.z0); vz < std::min(lastZ, chunk.z0 + chunk.field.depth()); vz++) {
+				float *row = chunk.field.heightRow(vz - chunk.z0);
+				for (int vx = std::max(firstX, chunk.x0); vx < std::min(lastX, chunk.x0 + chunk.field.width()); vx++) {
+					// Cosine falloff, full strength at the centre and none at the radius
+					float distance = sqrtf((vx - x) * (vx - x) + (vz - z) * (vz - z));
+					if (distance >= brush.radius)
+						continue;
+					float weight = 0.5f * (1 + cosf(3.14159265f * distance / brush.radius));
+
+					float &height = row[vx - chunk.x0];
+					float old = height;
+					if (brush.mode == 'r') {
+						height += brush.strength * weight;
+					} else if (brush.mode == 'l') {
+						height -= brush.strength * weight;
+					} else {
+						float sum = 0;
+						int count = 0;
+						for (int nz = std::max(vz - 1, 0); nz <= std::min(vz + 1, terrain->depth - 1); nz++) {
+							for (int nx = std::max(vx - 1, 0); nx <= std::min(vx + 1, terrain->width - 1); nx++) {
+								sum += before[(size_t) (nz - source.firstZ) * sourceWidth + nx - source.firstX];
+								count++;
+							}
+						}
+						height += std::min(brush.strength * weight, 1.0f) * (sum / count - old);
+					}
+
+					// Only a vertex that held the chunk's highest or lowest point moving inwards needs the chunk scanned again
+					if ((old == chunk.maxHeight && height < old) || (old == chunk.minHeight && height > old))
+						rescan = true;
+					high = std::max(high, height);
+					low = std::min(low, height);
+				}
+			}
+
+			if (rescan) {
+				high = low = chunk.field.heightRow(0)[0];
+				for (int row = 0; row < chunk.field.depth(); row++) {
+					const float *heights = chunk.field.heightRow(row);
+					for (int column = 0; column < chunk.field.width(); column++) {
+						high = std::max(high, heights[column]);
+						low = std::min(low, heights[column]);
+					}
+				}
+			}
+			chunk.maxHeight = high;
+			chunk.minHeight = low;
+		}
+	}
+
+	// A chunk's box also takes the first row and column of the next chunks, so the chunks before the rectangle are refreshed too
+	terrain->bounds.refresh(terrain->chunks, VERT_SPACING, std::max(firstX - 1, 0) >> CHUNK_SHIFT, std::max(firstZ - 1, 0) >> CHUNK_SHIFT, lastCX, lastCZ);
+
+	// The heights no longer come from the generation settings
+	terrain->generatedComplexity = -1;
+
+	// Normals of a vertex depend on the faces around it, so the border changes as well
+	changed = source;
+	setNormalsInRect(terrain, changed);
+	return changed;
+}
+
+
+/* Ends a sculpt stroke by updating the terrain's height range from the chunks' ranges */
+/* Returns true if it changed, in which case every colour is now scaled differently */
+bool finishSculpting (Terrain *terrain) {
+	float high = terrain->chunks.chunk(0).maxHeight, low = terrain->chunks.chunk(0).minHeight;
+	for (int i = 1; i < terrain->chunks.count(); i++) {
+		high = std::max(high, terrain->chunks.chunk(i).maxHeight);
+		low = std::min(low, terrain->chunks.chunk(i).minHeight);
+	}
+	bool changed = high != terrain->maxHeight || low != terrain->minHeight;
+	terrain->maxHeight = high;
+	terrain->minHeight = low;
+	return changed;
+}
+
+
+#define FALLOFF_STEPS	1024		// Resolution of the circle falloff lookup table
+
+/* Stamp for one circle size, covering the circle's bounding square */
+struct CircleKernel {
+	int radius;				// Half the side of the bounding square, in cells
+	float heightScale;			// Converts a squared height difference into the same units as planar
+	std::vector<float> planar;		// Squared scaled distance (pd^2) from the centre for each cell of the square
+};
+
+
+/* Builds one kernel per possible circle size, CIRCLE_MIN to CIRCLE_MIN + CIRCLE_RANGE - 1 */
+static std::vector<CircleKernel> buildCircleKernels () {
+	std::vector<CircleKernel> kernels(CIRCLE_RANGE);
+	for (int k = 0; k < CIRCLE_RANGE; k++) {
+		int circleSize = CIRCLE_MIN + k;
+		CircleKernel &kernel = kernels[k];
+		kernel.radius = circleSize / 2;
+		kernel.heightScale = 4.0f / (circleSize * circleSize);
+
+		int side = 2 * kernel.radius + 1;
+		kernel.planar.resize(side * side);
+		for (int dz = -kernel.radius; dz <= kernel.radius; dz++)
+			for (int dx = -kernel.radius; dx <= kernel.radius; dx++)
+				kernel.planar[(dz + kernel.radius) * side + (dx + kernel.radius)] = (dx * dx + dz * dz) * kernel.heightScale;
+	}
+	return kernels;
+}
+
+
+/* Returns the kernel for a circle size, the kernels are built once and shared by all terrains */
+static const CircleKernel &getCircleKernel (int circleSize) {
+	static const std::vector<CircleKernel> kernels = buildCircleKernels();
+	return kernels[circleSize - CIRCLE_MIN];
+}
+
+
+/* Builds the table of cos(pd * 3.14) indexed by pd^2 from 0 to 1, with one extra entry for interpolation */
+static std::vector<float> buildFalloffTable () {
+	std::vector<float> table(FALLOFF_STEPS + 2);
+	for (int i = 0; i <= FALLOFF_STEPS + 1; i++)
+		table[i] = (float) cos(sqrt((double) i / FALLOFF_STEPS) * 3.14);
+	return table;
+}
+
+
+/* Returns cos(pd * 3.14) given pd^2 between 0 and 1, without calling sqrt or cos */
+static inline float circleFalloff (const float *table, float pdSquared) {
+	float position = pdSquared * FALLOFF_STEPS;
+	int step = (int) position;
+	return table[step] + (table[step + 1] - table[step]) * (position - step);
+}
+
+
+/* One circle of the circles algorithm */
+struct Circle {
+	int x, z;				// Centre point on the terrain
+	int size;				// CIRCLE_MIN to CIRCLE_MIN + CIRCLE_RANGE - 1
+	int iteration;				// Which iteration of the algorithm placed the circle
+};
+
+
+/* Raises the cells under one circle */
+static void stampCircle (Terrain *terrain, const Circle &circle) {
+	static const std::vector<float> falloff = buildFalloffTable();
+	const float *falloffTable = &falloff[0];
+
+	int randomY = terrain->chunks.height(circle.x, circle.z);	// Height corresponding to our random point
+
+	// Precomputed distances for this circle size
+	const CircleKernel &kernel = getCircleKernel(circle.size);
+	int side = 2 * kernel.radius + 1;
+
+	// Only the bounding square of the circle can be displaced, clipped to the terrain
+	int minX = std::max(circle.x - kernel.radius, 0);
+	int maxX = std::min(circle.x + kernel.radius, terrain->width - 1);
+	int minZ = std::max(circle.z - kernel.radius, 0);
+	int maxZ = std::min(circle.z + kernel.radius, terrain->depth - 1);
+
+	for (int z = minZ; z <= maxZ; z++) {
+		const float *planar = &kernel.planar[(z - circle.z + kernel.radius) * side];
+
+		// The square can cross into the next chunk, so each row is done one chunk at a time
+		for (int x = minX; x <= maxX; ) {
+			TerrainChunk &chunk = terrain->chunks.chunkAt(x, z);
+			float *row = chunk.field.heightRow(z - chunk.z0);
+			int end = std::min(maxX, chunk.x0 + chunk.field.width() - 1);
+			for (; x <= end; x++) {
+				// Distance is still measured in 3D, so the height difference to the centre counts too
+				float dy = row[x - chunk.x0] - randomY;
+				float pdSquared = planar[x - circle.x + kernel.radius] + dy * dy * kernel.heightScale;
+
+				if (pdSquared <= 1.0f) {
+					int randomDisp = counterRange(terrain->seed, circle.iteration, cellCounter(x, z), MAX_DISP) + 1;	// Displacement is 1 to MAX_DISP + 1
+					row[x - chunk.x0] += (randomDisp / 2 + circleFalloff(falloffTable, pdSquared) * randomDisp / 2);
+				}
+			}
+		}
+	}
+}
+
+
+/* Groups the circles into waves that can be stamped in parallel */
+/* A circle depends on the heights left by earlier circles that overlap it, so it goes in the wave after */
+/* the latest of those; overlap is checked conservatively with a coarse grid of CIRCLE_BUCKET cells */
+static std::vector<std::vector<int> > scheduleCircles (const Terrain *terrain, const std::vector<Circle> &circles) {
+	int bucketsX = terrain->width / CIRCLE_BUCKET + 1;
+	int bucketsZ = terrain->depth / CIRCLE_BUCKET + 1;
+	std::vector<int> bucketWave(bucketsX * bucketsZ, -1);	// Latest wave that touched each bucket
+	std::vector<std::vector<int> > waves;
+
+	for (size_t c = 0; c < circles.size(); c++) {
+		int radius = circles[c].size / 2;
+		int firstX = std::max(circles[c].x - radius, 0) / CIRCLE_BUCKET;
+		int lastX = std::min(circles[c].x + radius, terrain->width - 1) / CIRCLE_BUCKET;
+		int firstZ = std::max(circles[c].z - radius, 0) / CIRCLE_BUCKET;
+		int lastZ = std::min(circles[c].z + radius, terrain->depth - 1) / CIRCLE_BUCKET;
+
+		int wave = 0;
+		for (int bx = firstX; bx <= lastX; bx++)
+			for (int bz = firstZ; bz <= lastZ; bz++)
+				wave = std::max(wave, bucketWave[bx * bucketsZ + bz] + 1);
+		for (int bx = firstX; bx <= lastX; bx++)
+			for (int bz = firstZ; bz <= lastZ; bz++)
+				bucketWave[bx * bucketsZ + bz] = wave;
+
+		if (wave == (int) waves.size())
+			waves.push_back(std::vector<int>());
+		waves[wave].push_back((int) c);
+	}
+	return waves;
+}
+
+
+/* A fault line through two random points of the terrain */
+struct FaultLine {
+	int x1, z1;
+	int x2, z2;
+};
+
+
+/* Integer division rounding towards negative infinity, for a positive divisor */
+static inline long long floorDivide (long long a, long long b) {
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+
+/* Finds the span [start, end) of row z that a fault raises, every other cell of the row is lowered */
+/* A cell (x,z) is raised when (x2 - x1) * (z - z1) - (z2 - z1) * (x - x1) > 0 */
+static void faultSpan (const FaultLine &fault, int z, int width, int *start, int *end) {
+	long long slope = fault.z2 - fault.z1;
+	long long offset = (long long) (fault.x2 - fault.x1) * (z - fault.z1);
+	long long first, last;
+
+	if (slope > 0) {
+		// Raised when x - x1 < offset / slope
+		first = 0;
+		last = fault.x1 - floorDivide(-offset, slope);
+	} else if (slope < 0) {
+		// Raised when x - x1 > offset / slope
+		first = fault.x1 + floorDivide(-offset, -slope) + 1;
+		last = width;
+	} else {
+		// Horizontal line, the whole row is on one side
+		first = 0;
+		last = offset > 0 ? width : 0;
+	}
+
+	*start = (int) std::min(std::max(first, 0LL), (long long) width);
+	*end = (int) std::min(std::max(last, (long long) *start), (long long) width);
+}
+
+
+/* Number of times the algorithm's loop runs for a complexity, particle deposition makes five walks per unit above 200 */
+static int generationSteps (char algorithm, int complexity) {
+	complexity = std::max(complexity, 0);
+	if (algorithm == 'd' && complexity > 200)
+		return 5 * complexity;
+	return complexity;
+}
+
+
+/* True for the algorithms worked out in one pass over the terrain (fault, noise and diamond-square), which have no */
+/* iterations to carry on from or checkpoint */
+static bool generatedWhole (char algorithm) {
+	return algorithm == 'f' || algorithm == 'n' || algorithm == 's';
+}
+
+
+/* True for the algorithms whose heights can go below 0 (fault, noise and diamond-square) */
+bool signedHeights (char algorithm) {
+	return algorithm == 'f' || algorithm == 'n' || algorithm == 's';
+}
+
+
+/* Sets every height to 0 */
+static void flattenHeights (Terrain *terrain) {
+	TRACE_ZONE("flatten");
+	parallelFor(terrain->chunks.count(), 1, [terrain](int firstChunk, int lastChunk) {
+		for (int i = firstChunk; i < lastChunk; i++) {
+			// Initialize all initial height values to 0
+			TerrainChunk &chunk = terrain->chunks.chunk(i);
+			for (int z = 0; z < chunk.field.depth(); z++) {
+				float *row = chunk.field.heightRow(z);
+				std::fill(row, row + chunk.field.width(), 0.0f);
+			}
+			chunk.minHeight = chunk.maxHeight = 0;
+		}
+	});
+}
+
+
+/* Circles algorithm, iterations first to last - 1 */
+/* Every cell takes the circles over it in iteration order however the waves fall, so running the iterations */
+/* in several calls leaves exactly the same heights as running them in one */
+static void raiseCircles (Terrain *terrain, int first, int last) {
+	TRACE_ZONE("circles");
+	// We use the circles algorithm to randomly generate our terrain
+	// We run the algorithm using a random point a number of times equal to the terrain complexity
+	// That is currently set (default 100 - user selectable)
+	// Pick every circle first: a random point on our terrain and a random size
+	std::vector<Circle> circles(last - first);
+	for (int i = first; i < last; i++) {
+		Circle &circle = circles[i - first];
+		circle.x = counterRange(terrain->seed, i, 0, terrain->width);		// 0 to (width - 1)
+		circle.z = counterRange(terrain->seed, i, 1, terrain->depth);		// 0 to (depth - 1)
+		circle.size = counterRange(terrain->seed, i, 2, CIRCLE_RANGE) + CIRCLE_MIN;
+		circle.iteration = i;
+	}
+
+	// Circles of the same wave never overlap, so each wave is stamped in parallel
+	std::vector<std::vector<int> > waves = scheduleCircles(terrain, circles);
+	for (size_t w = 0; w < waves.size(); w++) {
+		const std::vector<int> &wave = waves[w];
+		TRACE_ZONE("circles wave");
+		parallelFor((int) wave.size(), CIRCLES_PER_TASK, [&](int firstCircle, int lastCircle) {
+			for (int c = firstCircle; c < lastCircle; c++)
+				stampCircle(terrain, circles[wave[c]]);
+		});
+	}
+}
+
+
+/* Fault algorithm, every one of the terrain's faults at once */
+/* A cell's height only depends on how many of the faults raise it, so there is nothing to carry on from */
+static void raiseFaults (Terrain *terrain) {
+	TRACE_ZONE("faults");
+	// We use the fault algorithm to randomly generate our terrain
+	// We run the algorithm a number of times determined by the terrain complexity currently set
+	// Pick two random points (x,z) for every fault first, each line is a fault
+	std::vector<FaultLine> faults(terrain->complexity);
+	for (int counter = 0; counter < terrain->complexity; counter++) {
+		faults[counter].x1 = counterRange(terrain->seed, counter, 0, terrain->width);	// 0 to (width - 1)
+		faults[counter].z1 = counterRange(terrain->seed, counter, 1, terrain->depth);	// 0 to (depth - 1)
+		faults[counter].x2 = counterRange(terrain->seed, counter, 2, terrain->width);	// 0 to (width - 1)
+		faults[counter].z2 = counterRange(terrain->seed, counter, 3, terrain->depth);	// 0 to (depth - 1)
+	}
+
+	// A fault crosses each row (fixed z) at most once, so every row splits into two spans
+	// We count how many faults raise each cell with a difference array, then resolve it with a prefix sum
+	// Rows are independent of each other, so they are shared out between the worker threads
+	parallelFor(terrain->depth, ROWS_PER_TASK, [terrain, &faults](int firstRow, int lastRow) {
+		TRACE_ZONE("fault rows");
+		float displacement = 0.3;
+		std::vector<int> raised(terrain->width + 1);
+		for (int z = firstRow; z < lastRow; z++) {
+			std::fill(raised.begin(), raised.end(), 0);
+			for (int counter = 0; counter < terrain->complexity; counter++) {
+				int start, end;
+				faultSpan(faults[counter], z, terrain->width, &start, &end);
+				raised[start]++;
+				raised[end]--;
+			}
+
+			// Depending on the side of each fault, displacement is either negative or positive
+			int raisedCount = 0;
+			for (int cx = 0; cx < terrain->chunks.chunksX(); cx++) {
+				TerrainChunk &chunk = terrain->chunks.chunk(cx, z >> CHUNK_SHIFT);
+				float *row = chunk.field.heightRow(z - chunk.z0);
+				for (int x = 0; x < chunk.field.width(); x++) {
+					raisedCount += raised[chunk.x0 + x];
+					row[x] += displacement * (2 * raisedCount - terrain->complexity);
+				}
+			}
+		}
+	});
+}
+
+
+/* Walks particle i of the deposition, either adding each of its WALK_STEPS deposits straight to the heights */
+/* or, when xs and zs are given, filling in the vertex of each step */
+static void walkParticle (Terrain *terrain, int i, int *xs, int *zs) {
+	// Local copies, as the stores to xs and zs could otherwise change them for all the compiler knows
+	unsigned int seed = terrain->seed;
+	int width = terrain->width, depth = terrain->depth;
+
+	// Generate a random point on our terrain
+	// Each walk is one iteration, its steps use the counters after the start point
+	int randomX = counterRange(seed, i, 0, width);	// 0 to (width - 1)
+	int randomZ = counterRange(seed, i, 1, depth);	// 0 to (depth - 1)
+
+	for (int count = 0; count < WALK_STEPS; count++) {
+		// Use a switch statement to randomly move around to nearby points
+		int randNum = counterRange(seed, i, 2 + count, 4);	// 0 to 3
+
+		// Switch statement handles movement between nearby, existing vertices
+		switch (randNum) {
+			case 0:
+				if (randomX + 1 < width) 
+					randomX++;
+				break;
+			case 1:
+				if (randomX - 1 >= 0) 
+					randomX--;
+				break;
+			case 2:
+				if (randomZ + 1 < depth) 
+					randomZ++;
+				break;
+			case 3:
+				if (randomZ - 1 >= 0) 
+					randomZ--;
+				break;
+		}
+
+		// Modify height at the current point, or record it
+		if (xs) {
+			xs[count] = randomX;
+			zs[count] = randomZ;
+		} else {
+			float displacement = 0.3;
+			terrain->chunks.height(randomX, randomZ) += displacement;
+		}
+	}
+}
+
+
+/* Deposits counted by one task, a block of DEPOSIT_TILE x DEPOSIT_TILE counts for each tile its walks reached */
+struct DepositCounts {
+	std::map<long long, int> blockOf;	// Tile id (row-major over the whole terrain) to the block its counts are in
+	std::vector<unsigned int> blocks;
+};
+
+
+/* Particle deposition algorithm, walks first to last - 1 */
+/* Every deposit adds the same displacement, so a vertex ends up the same however its deposits are ordered: */
+/* only how many it gets matters. The walks are shared out between tasks, each counting its deposits in its */
+/* own tiles, and the counts are then summed and added tile by tile, giving the same heights on any number of threads */
+/* Only the tiles some walk reached take memory, so the cost follows the complexity rather than the terrain size */
+/* A single task adds its deposits straight to the heights instead, which gives the same heights again */
+static void depositParticles (Terrain *terrain, int first, int last) {
+	TRACE_ZONE("deposition");
+	// We use the my particle deposition algorithm to randomly generate our terrain
+	// Pick a random start point a total of terrain->complexity times, then build small islands around the point
+	int tasks = std::min(workerThreads(), last - first);
+	if (tasks <= 1) {
+		for (int i = first; i < last; i++)
+			walkParticle(terrain, i, 0, 0);
+		return;
+	}
+
+	long long tilesX = (terrain->width + DEPOSIT_TILE - 1) / DEPOSIT_TILE;
+	std::vector<DepositCounts> counts(tasks);
+	parallelFor(tasks, 1, [&](int firstTask, int lastTask) {
+		int taskXs[WALK_STEPS], taskZs[WALK_STEPS];
+		for (int task = firstTask; task < lastTask; task++) {
+			TRACE_ZONE("deposition walks");
+			DepositCounts &tiles = counts[task];
+			long long lastTile = -1;
+			size_t block = 0;
+			int begin = first + (int) ((long long) (last - first) * task / tasks);
+			int end = first + (int) ((long long) (last - first) * (task + 1) / tasks);
+			for (int i = begin; i < end; i++) {
+				// Count a deposit at each step, a tile's block is only allocated once a walk reaches it
+				// Walks take small steps, so the block of the previous step is usually the one needed again
+				walkParticle(terrain, i, taskXs, taskZs);
+				for (int step = 0; step < WALK_STEPS; step++) {
+					int x = taskXs[step], z = taskZs[step];
+					long long tile = (z / DEPOSIT_TILE) * tilesX + x / DEPOSIT_TILE;
+					if (tile != lastTile) {
+						std::map<long long, int>::iterator found = tiles.blockOf.find(tile);
+						if (found == tiles.blockOf.end()) {
+							found = tiles.blockOf.insert(std::make_pair(tile, (int) (tiles.blocks.size() / (DEPOSIT_TILE * DEPOSIT_TILE)))).first;
+							tiles.blocks.resize(tiles.blocks.size() + DEPOSIT_TILE * DEPOSIT_TILE, 0);
+						}
+						block = (size_t) found->second * DEPOSIT_TILE * DEPOSIT_TILE;
+						lastTile = tile;
+					}
+					tiles.blocks[block + (z % DEPOSIT_TILE) * DEPOSIT_TILE + x % DEPOSIT_TILE]++;
+				}
+			}
+		}
+	});
+
+	// Only the tiles some task reached are merged, in tile order
+	std::vector<long long> reached;
+	for (int task = 0; task < tasks; task++)
+		for (std::map<long long, int>::const_iterator it = counts[task].blockOf.begin(); it != counts[task].blockOf.end(); ++it)
+			reached.push_back(it->first);
+	std::sort(reached.begin(), reached.end());
+	reached.erase(std::unique(reached.begin(), reached.end()), reached.end());
+
+	// Sum the tasks' counts and add the deposits, a tile never crosses a chunk
+	parallelFor((int) reached.size(), 8, [&](int firstTile, int lastTile) {
+		std::vector<unsigned int> total(DEPOSIT_TILE * DEPOSIT_TILE);
+		for (int r = firstTile; r < lastTile; r++) {
+			long long t = reached[r];
+			std::fill(total.begin(), total.end(), 0);
+			for (int task = 0; task < tasks; task++) {
+				std::map<long long, int>::const_iterator found = counts[task].blockOf.find(t);
+				if (found == counts[task].blockOf.end())
+					continue;
+				const unsigned int *tile = &counts[task].blocks[(size_t) found->second * DEPOSIT_TILE * DEPOSIT_TILE];
+				for (int k = 0; k < DEPOSIT_TILE * DEPOSIT_TILE; k++)
+					total[k] += tile[k];
+			}
+
+			// Each deposit raises the point by the same displacement, added one at a time as the walks would
+			float displacement = 0.3;
+			int x0 = (int) (t % tilesX) * DEPOSIT_TILE, z0 = (int) (t / tilesX) * DEPOSIT_TILE;
+			TerrainChunk &chunk = terrain->chunks.chunkAt(x0, z0);
+			for (int z = z0; z < std::min(z0 + DEPOSIT_TILE, terrain->depth); z++) {
+				float *row = chunk.field.heightRow(z - chunk.z0);
+				for (int x = x0; x < std::min(x0 + DEPOSIT_TILE, terrain->width); x++) {
+					for (unsigned int n = total[(z - z0) * DEPOSIT_TILE + x - x0]; n > 0; n--)
+						row[x - chunk.x0] += displacement;
+				}
+			}
+		}
+	});
+}
+
+
+/* Runs iterations first to last - 1 of the terrain's algorithm on top of the current heights */
+static void runIterations (Terrain *terrain, int first, int last) {
+	if (terrain->algorithm == 'c') {
+		if (terrainVerbose)
+			printf("Generating terrain with the circles algorithm...\n");
+		raiseCircles(terrain, first, last);
+	} else if (terrain->algorithm == 'f') {
+		if (terrainVerbose)
+			printf("Generating terrain with the fault algorithm...\n");
+		raiseFaults(terrain);
+	} else if (terrain->algorithm == 'd') {
+		if (terrainVerbose)
+			printf("Generating terrain with the particle deposition algorithm...\n");
+		depositParticles(terrain, first, last);
+	} else if (terrain->algorithm == 'n') {
+		if (terrainVerbose)
+			printf("Generating terrain with the gradient noise algorithm (%s kernel)...\n", noiseKernel());
+		raiseNoise(terrain);
+	} else if (terrain->algorithm == 's') {
+		if (terrainVerbose)
+			printf("Generating terrain with the diamond-square algorithm...\n");
+		raiseDiamondSquare(terrain);
+	}
+}
+
+
+/* Finds the highest and lowest points of every chunk and of the terrain, and rebuilds the chunk boxes */
+void measureHeights (Terrain *terrain) {
+	TRACE_ZONE("min/max");
+	// Every chunk finds its own max/min and we combine them in order
+	parallelFor(terrain->chunks.count(), 1, [terrain](int firstChunk, int lastChunk) {
+		for (int i = firstChunk; i < lastChunk; i++) {
+			TerrainChunk &chunk = terrain->chunks.chunk(i);
+			float high = chunk.field.heightRow(0)[0];
+			float low = high;
+			for (int z = 0; z < chunk.field.depth(); z++) {
+				const float *row = chunk.field.heightRow(z);
+				for (int x = 0; x < chunk.field.width(); x++) {
+					high = std::max(high, row[x]);
+					low = std::min(low, row[x]);
+				}
+			}
+			chunk.maxHeight = high;
+			chunk.minHeight = low;
+		}
+	});
+	terrain->maxHeight = terrain->chunks.chunk(0).maxHeight;
+	terrain->minHeight = terrain->chunks.chunk(0).minHeight;
+	for (int i = 1; i < terrain->chunks.count(); i++) {
+		terrain->maxHeight = std::max(terrain->maxHeight, terrain->chunks.chunk(i).maxHeight);
+		terrain->minHeight = std::min(terrain->minHeight, terrain->chunks.chunk(i).minHeight);
+	}
+
+	// Every chunk has new heights, so every box is rebuilt
+	terrain->bounds.refresh(terrain->chunks, VERT_SPACING, 0, 0, terrain->chunks.chunksX(), terrain->chunks.chunksZ());
+}
+
+
+/* Generate Values for the height map */
+/* Generating on top of a flat terrain sets the cursor, so that updateHeightValues can carry on from it */
+void generateHeightValues (Terrain *terrain, bool flatten) {
+	TRACE_ZONE("generate");
+	//  If argument is true, we flatten the terrain (initializing, reinitializing)
+	if (flatten) {
+		flattenHeights(terrain);
+		terrain->generatedComplexity = 0;
+	} else {
+		runIterations(terrain, 0, generationSteps(terrain->algorithm, terrain->complexity));
+		terrain->generatedComplexity = terrain->generatedComplexity == 0 ? std::max(terrain->complexity, 0) : -1;
+		terrain->generatedAlgorithm = terrain->algorithm;
+		terrain->generatedSeed = terrain->seed;
+	}
+
+	// Set our max and min for non-lighting colouring
+	// A flattened terrain is all 0
+	if (flatten) {
+		terrain->maxHeight = 0;
+		terrain->minHeight = 0;
+		terrain->bounds.refresh(terrain->chunks, VERT_SPACING, 0, 0, terrain->chunks.chunksX(), terrain->chunks.chunksZ());
+	} else {
+		measureHeights(terrain);
+	}
+}
+
+
+/* Copies the heights into a checkpoint for the cursor, replacing the least recently used one when full */
+static void saveCheckpoint (Terrain *terrain, int steps) {
+	TRACE_ZONE("checkpoint save");
+	size_t bytes = (size_t) terrain->chunks.vertices() * sizeof(float);
+	if (bytes * std::min(MAX_CHECKPOINTS, 2) > CHECKPOINT_BUDGET)
+		return;
+	size_t slots = std::min((size_t) MAX_CHECKPOINTS, CHECKPOINT_BUDGET / bytes);
+	if (terrain->checkpoints.size() >= slots) {
+		size_t oldest = 0;
+		for (size_t c = 1; c < terrain->checkpoints.size(); c++)
+			if (terrain->checkpoints[c].lastUsed < terrain->checkpoints[oldest].lastUsed)
+				oldest = c;
+		terrain->checkpoints.erase(terrain->checkpoints.begin() + oldest);
+	}
+
+	terrain->checkpoints.push_back(TerrainCheckpoint());
+	TerrainCheckpoint &checkpoint = terrain->checkpoints.back();
+	checkpoint.algorithm = terrain->algorithm;
+	checkpoint.seed = terrain->seed;
+	checkpoint.steps = steps;
+	checkpoint.lastUsed = terrain->generations;
+	checkpoint.heights.resize(terrain->chunks.count());
+	parallelFor(terrain->chunks.count(), 1, [terrain, &checkpoint](int firstChunk, int lastChunk) {
+		for (int i = firstChunk; i < lastChunk; i++) {
+			const Heightfield &field = terrain->chunks.chunk(i).field;
+			std::vector<float> &heights = checkpoint.heights[i];
+			heights.resize((size_t) field.width() * field.depth());
+			for (int z = 0; z < field.depth(); z++)
+				std::copy(field.heightRow(z), field.heightRow(z) + field.width(), &heights[(size_t) z * field.width()]);
+		}
+	});
+}
+
+
+/* Copies a checkpoint's heights back into the terrain */
+static void restoreCheckpoint (Terrain *terrain, TerrainCheckpoint &checkpoint) {
+	TRACE_ZONE("checkpoint restore");
+	checkpoint.lastUsed = terrain->generations;
+	parallelFor(terrain->chunks.count(), 1, [terrain, &checkpoint](int firstChunk, int lastChunk) {
+		for (int i = firstChunk; i < lastChunk; i++) {
+			Heightfield &field = terrain->chunks.chunk(i).field;
+			const std::vector<float> &heights = checkpoint.heights[i];
+			for (int z = 0; z < field.depth(); z++)
+				std::copy(&heights[(size_t) z * field.width()], &heights[(size_t) (z + 1) * field.width()], field.heightRow(z));
+		}
+	});
+}
+
+
+/* Brings the heights to the terrain's algorithm, seed and complexity, running only the iterations that are missing */
+/* More iterations of the terrain the heights hold carry on from there; fewer, or another terrain, start from the */
+/* latest checkpoint of the same algorithm and seed that is not past the complexity, or from flat */
+/* The heights always come out exactly as flattening and generating from scratch would leave them */
+void updateHeightValues (Terrain *terrain) {
+	TRACE_ZONE("generate");
+	int target = generationSteps(terrain->algorithm, terrain->complexity);
+	terrain->generations++;
+
+	// Where the heights are now, if they are on the way to the target
+	int from = -1;
+	if (terrain->generatedComplexity == 0)
+		from = 0;
+	else if (terrain->generatedComplexity > 0 && terrain->generatedAlgorithm == terrain->algorithm && terrain->generatedSeed == terrain->seed)
+		from = generationSteps(terrain->algorithm, terrain->generatedComplexity);
+	if (from > target)
+		from = -1;
+
+	// Fault, noise and diamond-square have no iterations to carry on from, they are always worked out whole from flat
+	TerrainCheckpoint *resume = 0;
+	if (!generatedWhole(terrain->algorithm)) {
+		for (size_t c = 0; c < terrain->checkpoints.size(); c++) {
+			TerrainCheckpoint &checkpoint = terrain->checkpoints[c];
+			if (checkpoint.algorithm == terrain->algorithm && checkpoint.seed == terrain->seed && checkpoint.steps <= target
+				&& checkpoint.steps > from && (!resume || checkpoint.steps > resume->steps))
+				resume = &checkpoint;
+		}
+	} else if (from != 0) {
+		from = -1;
+	}
+
+	if (resume) {
+		restoreCheckpoint(terrain, *resume);
+		from = resume->steps;
+	} else if (from < 0) {
+		flattenHeights(terrain);
+		from = 0;
+	}
+	if (terrainVerbose && from > 0)
+		printf("Carrying on from iteration %d of %d\n", from, target);
+
+	if (generatedWhole(terrain->algorithm) || from < target)
+		runIterations(terrain, from, target);
+	terrain->generatedComplexity = std::max(terrain->complexity, 0);
+	terrain->generatedAlgorithm = terrain->algorithm;
+	terrain->generatedSeed = terrain->seed;
+	measureHeights(terrain);
+
+	// Keep the result, unless a checkpoint already holds it
+	if (!generatedWhole(terrain->algorithm) && target > 0) {
+		bool saved = false;
+		for (size_t c = 0; c < terrain->checkpoints.size(); c++) {
+			TerrainCheckpoint &checkpoint = terrain->checkpoints[c];
+			if (checkpoint.algorithm == terrain->algorithm && checkpoint.seed == terrain->seed && checkpoint.steps == target) {
+				checkpoint.lastUsed = terrain->generations;
+				saved = true;
+			}
+		}
+		if (!saved)
+			saveCheckpoint(terrain, target);
+	}
+}
+
+
+/* Forgets what the heights were generated from and drops the checkpoints, for a new size or heights from elsewhere */
+void resetGeneration (Terrain *terrain) {
+	terrain->generatedComplexity = -1;
+	terrain->generations = 0;
+	terrain->checkpoints.clear();
+}
+
+
+/* Colours a run of heights with the same arithmetic the immediate path of the renderer uses, either output can be null */
+/* The run is first reduced to one value per vertex in loops the compiler can vectorize, then spread to RGB */
+void heightColours (const Terrain *terrain, const float *heights, int count, float *grayColour, float *topographicColour) {
+	// Account for possible negative height values of the fault, noise and diamond-square algorithms, adding a number to avoid floating point inaccuracies
+	float difference = 0;
+	if (signedHeights(terrain->algorithm) && terrain->minHeight < 0)
+		difference = -1 * terrain->minHeight + 10;
+	float grayScale = terrain->maxHeight + difference;
+	float maxHeight = terrain->maxHeight;
+	bool flat = !signedHeights(terrain->algorithm) && terrain->maxHeight == 0 && terrain->minHeight == 0;
+
+	std::vector<float> value(count);
+	if (grayColour) {
+		for (int x = 0; x < count; x++)
+			value[x] = (heights[x] + difference) / grayScale;
+		if (flat)
+			std::fill(value.begin(), value.end(), 1.0f);
+		for (int x = 0; x < count; x++, grayColour += 3)
+			grayColour[0] = grayColour[1] = grayColour[2] = value[x];
+	}
+	if (topographicColour) {
+		for (int x = 0; x < count; x++)
+			value[x] = heights[x] / maxHeight;
+		for (int x = 0; x < count; x++, topographicColour += 3) {
+			topographicColour[0] = baseGreen[0] + value[x];
+			topographicColour[1] = baseGreen[1] + value[x]/8;
+			topographicColour[2] = baseGreen[2] + value[x]/4;
+		}
+	}
+}
+
+
+/* Writes the height map and vertex normals to a binary file */
+/* Layout: "TERR", int version, int width, int depth, int complexity, unsigned int seed, */
+/* char algorithm + 3 pad bytes, float minHeight, float maxHeight, then width*depth heights row by row (x fastest), */
+/* followed by the triangle-strip and quad-strip vertex normals in the same order (3 floats per vertex each) */
+bool writeTerrain (const Terrain *terrain, const char *path) {
+	// Written beside the file and renamed over it, as the file may be the mapped one the terrain's tiles come from
+	std::string temporary = std::string(path) + ".tmp";
+	FILE *file = fopen(temporary.c_str(), "wb");
+	if (!file)
+		return false;
+
+	int header[] = { 2, terrain->width, terrain->depth, terrain->complexity };
+	char algorithm[] = { terrain->algorithm, 0, 0, 0 };
+	float range[] = { terrain->minHeight, terrain->maxHeight };
+
+	bool ok = fwrite("TERR", 1, 4, file) == 4
+		&& fwrite(header, sizeof(int), 4, file) == 4
+		&& fwrite(&terrain->seed, sizeof(unsigned int), 1, file) == 1
+		&& fwrite(algorithm, 1, 4, file) == 4
+		&& fwrite(range, sizeof(float), 2, file) == 2;
+
+	// Heights gathered across the chunks one row at a time, normals interleaved one row at a time
+	std::vector<float> heights(terrain->width);
+	for (int z = 0; ok && z < terrain->depth; z++) {
+		terrain->chunks.copyHeights(0, z, terrain->width, &heights[0]);
+		ok = fwrite(&heights[0], sizeof(float), heights.size(), file) == heights.size();
+	}
+
+	std::vector<float> normals(3 * terrain->width);
+	for (int type = 0; type < 2; type++) {
+		for (int z = 0; ok && z < terrain->depth; z++) {
+			for (int cx = 0; cx < terrain->chunks.chunksX(); cx++) {
+				const TerrainChunk &chunk = terrain->chunks.chunk(cx, z >> CHUNK_SHIFT);
+				const Heightfield &field = chunk.field;
+				for (int x = 0; x < field.width(); x++)
+					for (int axis = 0; axis < 3; axis++)
+						normals[3 * (chunk.x0 + x) + axis] = (type == 0 ? field.triangleNormals(axis) : field.quadNormals(axis))[field.index(x, z - chunk.z0)];
+			}
+			ok = fwrite(&normals[0], sizeof(float), normals.size(), file) == normals.size();
+		}
+	}
+
+	if (fclose(file) != 0)
+		ok = false;
+	if (ok && rename(temporary.c_str(), path) != 0)
+		ok = false;
+	if (!ok)
+		remove(temporary.c_str());
+	return ok;
+}
@@ -0,0 +1,82 @@
+/*
+Nolan Slade
+Terrain Generator
+*/
+
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include "chunkgrid.h"
+#include "chunktree.h"
+
+#define CIRCLE_MIN	5 		// Minimum size of our circle for our circles algorithm
+#define CIRCLE_RANGE	10 		// Range for our circle size, thus the circle will be 25 + (0 to range-1)
+#define MAX_DISP 	5 		// Maximum displacement used by the terrain generation algorithms
+#define VERT_SPACING	3		// Distance between vertices
+#define MAX_TERRAIN_SIDE	(1 << 20)	// Largest width or depth, keeps vertex coordinates and positions well inside an int
+#define MAX_CHECKPOINTS		8		// Generation checkpoints kept per terrain, the least recently used goes first
+#define CHECKPOINT_BUDGET	(256 << 20)	// Bytes of heights the checkpoints of one terrain may hold
+
+/* Heights saved at the end of a generation, so that a later generation of the same terrain with more or fewer */
+/* iterations can carry on from here rather than from flat */
+struct TerrainCheckpoint {
+	char algorithm;
+	unsigned int seed;
+	int steps;				// Iterations of the algorithm the heights hold
+	unsigned long long lastUsed;		// Generation that last saved or restored it
+	std::vector<std::vector<float> > heights;	// One list per chunk, row by row without padding
+};
+
+/* Vertices firstX to lastX - 1 by firstZ to lastZ - 1 */
+struct TerrainRect {
+	int firstX, firstZ;
+	int lastX, lastZ;
+};
+
+/* Brush for sculptTerrain */
+struct SculptBrush {
+	char mode;				// 'r' raise, 'l' lower, 's' smooth
+	float radius;				// In vertices, the brush fades to nothing at this distance
+	float strength;				// Height added or taken at the centre per dab, or the share of the way to the average of the neighbours
+};
+
+/* Everything needed to generate one terrain, independent of any window or GL context */
+struct Terrain {
+	ChunkGrid chunks;			// Height values and vertex normals (triangle-strip and quad-strip), chunk by chunk
+	ChunkTree bounds;			// Bounding boxes of the chunks, refreshed by generateHeightValues
+	int width;				// Width of the terrain (number of vertices in x direction)
+	int depth;				// Depth of the terrain (number of vertices in z direction)
+	int complexity;				// Essentially how many times the algorithm will be run
+	char algorithm;				// 'c' for circles algorithm, 'f' for fault algorithm, 'd' for particle deposition, 'n' for gradient noise, 's' for diamond-square
+	unsigned int seed;			// Every random choice is a function of this seed, the iteration and a counter
+	float maxHeight;			// Highest point of the last generated terrain
+	float minHeight;			// Lowest point of the last generated terrain
+	bool compact;				// The chunks hold their compact fields instead of float ones, see compactTerrain
+
+	// Generation cursor: what the heights hold, so that generating again only adds the missing iterations
+	int generatedComplexity;		// Complexity the heights were generated to from flat (0 when flat), -1 when unknown
+	char generatedAlgorithm;
+	unsigned int generatedSeed;
+	unsigned long long generations;		// Generations run so far, orders the checkpoints by use
+	std::vector<TerrainCheckpoint> checkpoints;
+};
+
+extern bool terrainVerbose;			// Print progress messages while generating (off for batch jobs)
+extern float baseGreen[];			// Topographic green (lowest point)
+
+void initTerrain (Terrain *terrain, int width, int depth);
+void freeTerrain (Terrain *terrain);
+void seedTerrain (Terrain *terrain, unsigned int seed);
+void generateHeightValues (Terrain *terrain, bool flatten);
+void updateHeightValues (Terrain *terrain);
+void resetGeneration (Terrain *terrain);
+void measureHeights (Terrain *terrain);
+void setNormals (Terrain *terrain);
+void setNormalsInRect (Terrain *terrain, const TerrainRect &rect);
+TerrainRect sculptTerrain (Terrain *terrain, const SculptBrush &brush, float x, float z);
+bool finishSculpting (Terrain *terrain);
+bool signedHeights (char algorithm);
+void heightColours (const Terrain *terrain, const float *heights, int count, float *grayColour, float *topographicColour);
+bool writeTerrain (const Terrain *terrain, const char *path);
+
+#endif
@@ -0,0 +1,311 @@
+/*
+Nolan Slade
+Terrain Generator - tiled terrain files
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <algorithm>
+#include <vector>
+#include <string>
+
+#include "terrainfile.h"
+#include "threadpool.h"
+
+#define WRITE_WINDOW	32		// Tiles encoded at once while writing, bounds the memory held by encoded tiles
+
+static_assert(sizeof(TiledHeader) == 64, "TiledHeader must stay 64 bytes");
+static_assert(sizeof(TileEntry) == 48, "TileEntry must stay 48 bytes");
+
+
+/* Rounds a file offset up to the next tile boundary */
+static uint64_t alignOffset (uint64_t offset) {
+	return (offset + TILE_ALIGN - 1) / TILE_ALIGN * TILE_ALIGN;
+}
+
+
+/* Bytes of one tile's data before encoding */
+static size_t tileBytes (int width, int depth, bool normals) {
+	return normals ? Heightfield::blockBytes(width, depth) : (size_t) width * depth * sizeof(float);
+}
+
+
+/* Lays out one chunk as tile data, see terrainfile.h */
+static void tileData (const TerrainChunk &chunk, bool normals, std::vector<unsigned char> &out) {
+	const Heightfield &field = chunk.field;
+	int width = field.width(), depth = field.depth();
+	out.assign(tileBytes(width, depth, normals), 0);
+	float *data = (float *) &out[0];
+
+	if (!normals) {
+		for (int z = 0; z < depth; z++)
+			for (int x = 0; x < width; x++)
+				data[(size_t) z * width + x] = field.heights()[field.index(x, z)];
+		return;
+	}
+
+	// The same planes, strides and padding as a Heightfield in the row layout
+	int stride = (width + HEIGHTFIELD_ALIGN / sizeof(float) - 1) / (HEIGHTFIELD_ALIGN / sizeof(float)) * (HEIGHTFIELD_ALIGN / sizeof(float));
+	size_t planeFloats = out.size() / sizeof(float) / HEIGHTFIELD_PLANES;
+	for (int p = 0; p < HEIGHTFIELD_PLANES; p++) {
+		const float *plane = p == 0 ? field.heights() : p < 4 ? field.triangleNormals(p - 1) : field.quadNormals(p - 4);
+		for (int z = 0; z < depth; z++)
+			for (int x = 0; x < width; x++)
+				data[p * planeFloats + (size_t) z * stride + x] = plane[field.index(x, z)];
+	}
+}
+
+
+/* Groups the bytes of every float by significance, and back */
+static void shuffleBytes (const unsigned char *in, size_t bytes, unsigned char *out) {
+	size_t floats = bytes / sizeof(float);
+	for (size_t b = 0; b < sizeof(float); b++)
+		for (size_t i = 0; i < floats; i++)
+			out[b * floats + i] = in[i * sizeof(float) + b];
+}
+
+static void unshuffleBytes (const unsigned char *in, size_t bytes, unsigned char *out) {
+	size_t floats = bytes / sizeof(float);
+	for (size_t b = 0; b < sizeof(float); b++)
+		for (size_t i = 0; i < floats; i++)
+			out[i * sizeof(float) + b] = in[b * floats + i];
+}
+
+
+/* Encodes one tile and fills in everything of its index entry but the offset */
+/* Deflated tiles that come out no smaller are kept raw */
+static void encodeTile (const Terrain *terrain, int tile, bool normals, bool compress, std::vector<unsigned char> &encoded, TileEntry &entry) {
+	const TerrainChunk &chunk = terrain->chunks.chunk(tile);
+	const BoundingBox &box = terrain->bounds.box(0, tile % terrain->chunks.chunksX(), tile / terrain->chunks.chunksX());
+	entry.minHeight = chunk.minHeight;
+	entry.maxHeight = chunk.maxHeight;
+	entry.meshMinHeight = box.low[1];
+	entry.meshMaxHeight = box.high[1];
+
+	tileData(chunk, normals, encoded);
+	entry.rawBytes = encoded.size();
+	entry.storedBytes = encoded.size();
+	entry.encoding = TILE_RAW;
+	if (!compress)
+		return;
+
+	std::vector<unsigned char> shuffled(encoded.size());
+	shuffleBytes(&encoded[0], encoded.size(), &shuffled[0]);
+	std::vector<unsigned char> deflated(compressBound(encoded.size()));
+	uLongf deflatedBytes = deflated.size();
+	if (compress2(&deflated[0], &deflatedBytes, &shuffled[0], shuffled.size(), Z_BEST_SPEED) == Z_OK && deflatedBytes < encoded.size()) {
+		deflated.resize(deflatedBytes);
+		encoded.swap(deflated);
+		entry.storedBytes = deflatedBytes;
+		entry.encoding = TILE_DEFLATE;
+	}
+}
+
+
+/* Writes the terrain as a tiled file: header, tile index, then one page-aligned block per chunk */
+/* normals stores both sets of normals with the heights; compress deflates each tile on its own */
+bool writeTiledTerrain (const Terrain *terrain, const char *path, bool normals, bool compress) {
+	// Written beside the file and renamed over it, as the file may be the mapped one the terrain's tiles come from
+	std::string temporary = std::string(path) + ".tmp";
+	FILE *file = fopen(temporary.c_str(), "wb");
+	if (!file)
+		return false;
+
+	const ChunkGrid &grid = terrain->chunks;
+	TiledHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "TERR", 4);
+	header.version = TILED_VERSION;
+	header.width = terrain->width;
+	header.depth = terrain->depth;
+	header.complexity = terrain->complexity;
+	header.seed = terrain->seed;
+	header.algorithm = terrain->algorithm;
+	header.minHeight = terrain->minHeight;
+	header.maxHeight = terrain->maxHeight;
+	header.tileShift = CHUNK_SHIFT;
+	header.tilesX = grid.chunksX();
+	header.tilesZ = grid.chunksZ();
+	header.flags = normals ? TILED_NORMALS : 0;
+
+	// The index is written once the tile offsets are known
+	std::vector<TileEntry> index(grid.count());
+	memset(&index[0], 0, index.size() * sizeof(TileEntry));
+	uint64_t offset = alignOffset(sizeof(header) + index.size() * sizeof(TileEntry));
+	std::vector<unsigned char> padding(TILE_ALIGN, 0);
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(&index[0], sizeof(TileEntry), index.size(), file) == index.size()
+		&& fwrite(&padding[0], 1, offset - sizeof(header) - index.size() * sizeof(TileEntry), file) == offset - sizeof(header) - index.size() * sizeof(TileEntry);
+
+	// Tiles are encoded a window at a time on the pool and written in order
+	std::vector<std::vector<unsigned char> > encoded(WRITE_WINDOW);
+	for (int first = 0; ok && first < grid.count(); first += WRITE_WINDOW) {
+		int count = std::min(WRITE_WINDOW, grid.count() - first);
+		parallelFor(count, 1, [&](int begin, int end) {
+			for (int t = begin; t < end; t++)
+				encodeTile(terrain, first + t, normals, compress, encoded[t], index[first + t]);
+		});
+		for (int t = 0; ok && t < count; t++) {
+			TileEntry &entry = index[first + t];
+			entry.offset = offset;
+			uint64_t next = alignOffset(offset + entry.storedBytes);
+			ok = fwrite(&encoded[t][0], 1, entry.storedBytes, file) == entry.storedBytes
+				&& fwrite(&padding[0], 1, next - offset - entry.storedBytes, file) == next - offset - entry.storedBytes;
+			offset = next;
+		}
+	}
+
+	ok = ok && fseek(file, sizeof(header), SEEK_SET) == 0 && fwrite(&index[0], sizeof(TileEntry), index.size(), file) == index.size();
+	if (fclose(file) != 0)
+		ok = false;
+	if (ok && rename(temporary.c_str(), path) != 0)
+		ok = false;
+	if (!ok)
+		remove(temporary.c_str());
+	return ok;
+}
+
+
+/* True if the file starts like a tiled terrain file */
+bool isTiledTerrainFile (const char *path) {
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+	TiledHeader header;
+	bool tiled = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "TERR", 4) == 0 && header.version == TILED_VERSION;
+	fclose(file);
+	return tiled;
+}
+
+
+/* Checks the header and index of a mapped file against its length before anything is read through them */
+static bool validTiledFile (const unsigned char *bytes, size_t length) {
+	if (length < sizeof(TiledHeader))
+		return false;
+	const TiledHeader *header = (const TiledHeader *) bytes;
+	if (memcmp(header->magic, "TERR", 4) != 0 || header->version != TILED_VERSION || header->tileShift != CHUNK_SHIFT)
+		return false;
+	if (header->width < 2 || header->depth < 2 || header->width > MAX_TERRAIN_SIDE || header->depth > MAX_TERRAIN_SIDE)
+		return false;
+	if (header->tilesX != (header->width + CHUNK_SIZE - 1) >> CHUNK_SHIFT || header->tilesZ != (header->depth + CHUNK_SIZE - 1) >> CHUNK_SHIFT)
+		return false;
+	size_t tiles = (size_t) header->tilesX * header->tilesZ;
+	if (length < sizeof(TiledHeader) + tiles * sizeof(TileEntry))
+		return false;
+
+	const TileEntry *index = (const TileEntry *) (bytes + sizeof(TiledHeader));
+	bool normals = header->flags & TILED_NORMALS;
+	for (size_t t = 0; t < tiles; t++) {
+		int x0 = (int) (t % header->tilesX) << CHUNK_SHIFT, z0 = (int) (t / header->tilesX) << CHUNK_SHIFT;
+		const TileEntry &entry = index[t];
+		if (entry.offset > length || entry.storedBytes > length - entry.offset)
+			return false;
+		if (entry.rawBytes != tileBytes(std::min(CHUNK_SIZE, header->width - x0), std::min(CHUNK_SIZE, header->depth - z0), normals))
+			return false;
+		if (entry.encoding == TILE_RAW && (entry.storedBytes != entry.rawBytes || entry.offset % HEIGHTFIELD_ALIGN != 0))
+			return false;
+		if (entry.encoding != TILE_RAW && entry.encoding != TILE_DEFLATE)
+			return false;
+	}
+	return true;
+}
+
+
+/* Decodes one tile into a chunk that owns its memory, returns false if the data is corrupt */
+static bool decodeTile (const unsigned char *stored, const TileEntry &entry, bool normals, TerrainChunk &chunk, int width, int depth) {
+	std::vector<unsigned char> raw(entry.rawBytes);
+	if (entry.encoding == TILE_DEFLATE) {
+		std::vector<unsigned char> shuffled(entry.rawBytes);
+		uLongf rawBytes = entry.rawBytes;
+		if (uncompress(&shuffled[0], &rawBytes, stored, entry.storedBytes) != Z_OK || rawBytes != entry.rawBytes)
+			return false;
+		unshuffleBytes(&shuffled[0], shuffled.size(), &raw[0]);
+	} else {
+		memcpy(&raw[0], stored, entry.rawBytes);
+	}
+
+	chunk.field.resize(width, depth);
+	if (normals) {
+		memcpy(chunk.field.block(), &raw[0], raw.size());
+	} else {
+		for (int z = 0; z < depth; z++)
+			memcpy(chunk.field.heightRow(z), &raw[(size_t) z * width * sizeof(float)], width * sizeof(float));
+	}
+	return true;
+}
+
+
+/* Opens a tiled file in place of the terrain's contents */
+/* The file is mapped privately: raw tiles with normals become the chunks' memory as they are, so only the pages */
+/* that are touched are ever read, and processes mapping the same file share them. Deflated tiles are decoded */
+/* here on the pool, and files without normals have them computed. On failure the terrain is left empty */
+bool readTiledTerrain (Terrain *terrain, const char *path) {
+	int descriptor = open(path, O_RDONLY);
+	if (descriptor < 0)
+		return false;
+	struct stat info;
+	if (fstat(descriptor, &info) != 0 || info.st_size < (off_t) sizeof(TiledHeader)) {
+		close(descriptor);
+		return false;
+	}
+	size_t length = info.st_size;
+	void *mapping = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+	if (mapping == MAP_FAILED)
+		return false;
+
+	const unsigned char *bytes = (const unsigned char *) mapping;
+	if (!validTiledFile(bytes, length)) {
+		munmap(mapping, length);
+		return false;
+	}
+	const TiledHeader *header = (const TiledHeader *) bytes;
+	const TileEntry *index = (const TileEntry *) (bytes + sizeof(TiledHeader));
+	bool normals = header->flags & TILED_NORMALS;
+
+	terrain->width = header->width;
+	terrain->depth = header->depth;
+	terrain->complexity = header->complexity;
+	terrain->seed = header->seed;
+	terrain->algorithm = header->algorithm;
+	terrain->minHeight = header->minHeight;
+	terrain->maxHeight = header->maxHeight;
+	terrain->compact = false;
+	ChunkGrid &grid = terrain->chunks;
+	grid.layOut(header->width, header->depth);
+	resetGeneration(terrain);
+	grid.adoptMapping(mapping, length);
+
+	std::vector<char> corrupt(grid.count(), 0);
+	std::vector<float> meshRanges(2 * grid.count());
+	parallelFor(grid.count(), 1, [&](int first, int last) {
+		for (int t = first; t < last; t++) {
+			TerrainChunk &chunk = grid.chunk(t);
+			const TileEntry &entry = index[t];
+			int width = std::min(CHUNK_SIZE, grid.width() - chunk.x0), depth = std::min(CHUNK_SIZE, grid.depth() - chunk.z0);
+			chunk.minHeight = entry.minHeight;
+			chunk.maxHeight = entry.maxHeight;
+			meshRanges[2 * t] = entry.meshMinHeight;
+			meshRanges[2 * t + 1] = entry.meshMaxHeight;
+			if (normals && entry.encoding == TILE_RAW)
+				chunk.field.attach((float *) ((unsigned char *) mapping + entry.offset), width, depth);
+			else if (!decodeTile(bytes + entry.offset, entry, normals, chunk, width, depth))
+				corrupt[t] = 1;
+		}
+	});
+	if (std::find(corrupt.begin(), corrupt.end(), 1) != corrupt.end()) {
+		freeTerrain(terrain);
+		return false;
+	}
+
+	terrain->bounds.resize(grid);
+	terrain->bounds.refresh(grid, VERT_SPACING, &meshRanges[0]);
+	if (!normals)
+		setNormals(terrain);
+	return true;
+}
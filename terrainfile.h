@@ -0,0 +1,57 @@
+/*
+Nolan Slade
+Terrain Generator - tiled terrain files
+*/
+
+#ifndef TERRAINFILE_H
+#define TERRAINFILE_H
+
+#include <stdint.h>
+
+#include "terrain.h"
+
+#define TILED_VERSION		3		// Version number of tiled files, the streamed format written by writeTerrain is 2
+#define TILE_ALIGN		4096		// Every tile starts on a page boundary so stored tiles can be mapped in place
+
+#define TILED_NORMALS		1		// Header flag: tiles hold both sets of normals as well as heights
+#define TILE_RAW		0		// Tile encodings
+#define TILE_DEFLATE		1
+
+/* Start of a tiled file, 64 bytes */
+/* Every number is stored in the byte order of the machine that wrote it, like the streamed format */
+struct TiledHeader {
+	char magic[4];				// "TERR"
+	int32_t version;			// TILED_VERSION
+	int32_t width, depth;
+	int32_t complexity;
+	uint32_t seed;
+	char algorithm;
+	char pad[3];
+	float minHeight, maxHeight;
+	int32_t tileShift;			// Tiles are 2^tileShift vertices on a side, the chunk size of the writer
+	int32_t tilesX, tilesZ;
+	int32_t flags;				// TILED_NORMALS
+	char reserved[12];
+};
+
+/* One entry of the tile index that follows the header, one per tile row by row, 48 bytes */
+struct TileEntry {
+	uint64_t offset;			// Position of the tile's data in the file
+	uint64_t storedBytes;			// Bytes the data takes in the file
+	uint64_t rawBytes;			// Bytes once decoded
+	int32_t encoding;			// TILE_RAW or TILE_DEFLATE
+	float minHeight, maxHeight;		// Height range of the tile's own vertices
+	float meshMinHeight, meshMaxHeight;	// Also counting the row and column its mesh shares with the next tiles
+	int32_t pad;
+};
+
+/* Tile data, before encoding: with normals, the seven planes of the tile's Heightfield exactly as they are */
+/* held in memory in the row layout (padding zeroed), so raw tiles can be used straight from the mapped file; */
+/* without normals, the tile's heights row by row with no padding. Deflated tiles are byte-shuffled first */
+/* (every float's first bytes, then their second bytes, ...), which lets deflate find the repeated exponents */
+
+bool writeTiledTerrain (const Terrain *terrain, const char *path, bool normals, bool compress);
+bool readTiledTerrain (Terrain *terrain, const char *path);
+bool isTiledTerrainFile (const char *path);
+
+#endif
@@ -0,0 +1,239 @@
+/*
+Nolan Slade
+Terrain Generator
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "threadpool.h"
+
+#define IDLE_SPINS	64		// Failed pops and steals a caller yields through before sleeping until its batch is done
+
+/* One parallelFor call, shared by all of its pieces */
+struct Batch {
+	const std::function<void (int, int)> *body;
+	std::atomic<int> pending;			// Pieces that have not finished yet
+	std::mutex doneLock;
+	std::condition_variable done;
+	bool finished;					// Set under doneLock by the last piece, after which nothing touches the batch
+};
+
+/* A piece of a batch: the range [begin, end) */
+struct Task {
+	Batch *batch;
+	int begin;
+	int end;
+};
+
+/* Queue of one worker, the owner works from the back and thieves take from the front */
+struct WorkerQueue {
+	std::mutex lock;
+	std::deque<Task> tasks;
+};
+
+
+/* Fixed set of threads, each with its own queue */
+class WorkStealingPool {
+public:
+	explicit WorkStealingPool (int threads);
+	~WorkStealingPool ();
+
+	int threadCount () const { return (int) queues.size(); }
+	void run (int count, int grain, const std::function<void (int, int)> &body);
+
+private:
+	void workerLoop (int self);
+	bool popTask (int self, Task *task);
+	bool stealTask (int self, Task *task);
+	void runTask (const Task &task);
+
+	std::vector<WorkerQueue *> queues;		// One per worker plus one for outside callers (the last)
+	std::vector<std::thread> workers;
+	std::atomic<int> queued;			// Tasks sitting in any queue
+	std::atomic<unsigned> nextQueue;		// Round-robin start for handing out new batches
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	bool stopping;
+};
+
+// The worker index of the current thread, or -1 outside the pool
+static thread_local int currentWorker = -1;
+
+
+WorkStealingPool::WorkStealingPool (int threads) : queued(0), nextQueue(0), stopping(false) {
+	// The calling thread always works too, so we only start threads - 1 workers
+	for (int i = 0; i < threads; i++)
+		queues.push_back(new WorkerQueue());
+	for (int i = 0; i < threads - 1; i++)
+		workers.push_back(std::thread(&WorkStealingPool::workerLoop, this, i));
+}
+
+
+WorkStealingPool::~WorkStealingPool () {
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	for (size_t i = 0; i < queues.size(); i++)
+		delete queues[i];
+}
+
+
+/* Takes the newest task from our own queue */
+bool WorkStealingPool::popTask (int self, Task *task) {
+	WorkerQueue &queue = *queues[self];
+	std::lock_guard<std::mutex> guard(queue.lock);
+	if (queue.tasks.empty())
+		return false;
+	*task = queue.tasks.back();
+	queue.tasks.pop_back();
+	queued--;
+	return true;
+}
+
+
+/* Takes the oldest task from any other queue */
+bool WorkStealingPool::stealTask (int self, Task *task) {
+	int count = (int) queues.size();
+	for (int i = 1; i <= count; i++) {
+		WorkerQueue &queue = *queues[(self + i) % count];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if (!queue.tasks.empty()) {
+			*task = queue.tasks.front();
+			queue.tasks.pop_front();
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+void WorkStealingPool::runTask (const Task &task) {
+	Batch *batch = task.batch;
+	(*batch->body)(task.begin, task.end);
+	if (--batch->pending == 0) {
+		std::lock_guard<std::mutex> guard(batch->doneLock);
+		batch->finished = true;
+		batch->done.notify_all();
+	}
+}
+
+
+void WorkStealingPool::workerLoop (int self) {
+	currentWorker = self;
+	Task task;
+	while (true) {
+		if (popTask(self, &task) || stealTask(self, &task)) {
+			runTask(task);
+			continue;
+		}
+
+		// Nothing to do anywhere, sleep until more work is queued
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wake.wait(guard, [this]() { return stopping || queued.load() > 0; });
+		if (stopping)
+			return;
+	}
+}
+
+
+void WorkStealingPool::run (int count, int grain, const std::function<void (int, int)> &body) {
+	if (count <= 0)
+		return;
+	if (grain < 1)
+		grain = 1;
+
+	int pieces = (count + grain - 1) / grain;
+	if (pieces == 1 || queues.size() == 1) {
+		body(0, count);
+		return;
+	}
+
+	Batch batch;
+	batch.body = &body;
+	batch.pending = pieces;
+	batch.finished = false;
+
+	// Deal the pieces out over all queues, starting somewhere different each time
+	// Threads outside the pool (the last queue) and the pool's own threads may both call this
+	int self = currentWorker >= 0 ? currentWorker : (int) queues.size() - 1;
+	int start = (int) (nextQueue++ % queues.size());
+	for (int p = 0; p < pieces; p++) {
+		Task task = { &batch, p * grain, std::min(count, (p + 1) * grain) };
+		WorkerQueue &queue = *queues[(start + p) % queues.size()];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		queue.tasks.push_back(task);
+		queued++;
+	}
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+	}
+	wake.notify_all();
+
+	// Help out until our batch is done, possibly running pieces of other batches in the meantime
+	Task task;
+	int idle = 0;
+	while (batch.pending.load() > 0 && idle < IDLE_SPINS) {
+		if (popTask(self, &task) || stealTask(self, &task)) {
+			runTask(task);
+			idle = 0;
+		} else {
+			idle++;
+			std::this_thread::yield();
+		}
+	}
+
+	// Every queue was empty, so the pieces left are running on other threads: sleep until the last one finishes
+	// Waiting for finished rather than pending also keeps the batch alive until that piece is done with it
+	std::unique_lock<std::mutex> guard(batch.doneLock);
+	batch.done.wait(guard, [&batch]() { return batch.finished; });
+}
+
+
+static WorkStealingPool *pool = 0;
+static std::mutex poolLock;
+
+
+/* Returns the shared pool, starting it with one thread per core the first time */
+static WorkStealingPool &getPool () {
+	std::lock_guard<std::mutex> guard(poolLock);
+	if (!pool) {
+		int threads = (int) std::thread::hardware_concurrency();
+		pool = new WorkStealingPool(threads > 0 ? threads : 1);
+	}
+	return *pool;
+}
+
+
+void setWorkerThreads (int threads) {
+	if (threads <= 0)
+		threads = (int) std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+
+	std::lock_guard<std::mutex> guard(poolLock);
+	if (pool && pool->threadCount() == threads)
+		return;
+	delete pool;
+	pool = new WorkStealingPool(threads);
+}
+
+
+int workerThreads () {
+	return getPool().threadCount();
+}
+
+
+void parallelFor (int count, int grain, const std::function<void (int, int)> &body) {
+	getPool().run(count, grain, body);
+}
@@ -0,0 +1,22 @@
+/*
+Nolan Slade
+Terrain Generator
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <functional>
+
+/* Sets how many threads the terrain passes run on, including the calling thread (0 = number of cores) */
+void setWorkerThreads (int threads);
+
+/* Returns how many threads the terrain passes currently run on */
+int workerThreads ();
+
+/* Runs body(begin, end) over the range [0, count), split into pieces of at most grain items */
+/* Pieces are spread over the worker queues and idle workers steal from busy ones */
+/* Returns once every piece has run; the calling thread helps out while it waits */
+void parallelFor (int count, int grain, const std::function<void (int, int)> &body);
+
+#endif
@@ -0,0 +1,145 @@
+/*
+Nolan Slade
+Terrain Generator - scoped zone tracing
+*/
+
+#include "trace.h"
+
+#ifdef TERRAIN_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* One finished zone */
+struct TraceEvent {
+	const char *name;
+	long long start;			// Nanoseconds since the first zone
+	long long duration;
+};
+
+/* Totals of every zone with one name, over all threads */
+struct ZoneSummary {
+	long long count;
+	long long total;
+	long long longest;
+};
+
+/* Events of one thread, only ever written by that thread */
+/* The tracer owns it, so it outlives the thread, e.g. when the worker pool is resized */
+struct ThreadTrace {
+	int id;
+	std::vector<TraceEvent> events;
+	std::map<const char *, ZoneSummary> dropped;		// Zones past TRACE_MAX_EVENTS
+};
+
+static std::mutex traceLock;					// Guards the list of threads
+static std::vector<std::unique_ptr<ThreadTrace> > threads;
+static thread_local ThreadTrace *currentTrace = 0;
+static std::chrono::steady_clock::time_point traceStart;
+
+
+/* Adds one zone to the summary of its name */
+static void addToSummary (std::map<std::string, ZoneSummary> &summary, const char *name, long long count, long long total, long long longest) {
+	ZoneSummary &zone = summary[name];
+	zone.count += count;
+	zone.total += total;
+	zone.longest = std::max(zone.longest, longest);
+}
+
+
+/* Writes the trace file and prints the summary, run at exit */
+/* Every other thread is expected to be idle by then, as the viewer and the batch tool only exit between passes */
+static void writeTrace () {
+	std::lock_guard<std::mutex> guard(traceLock);
+	const char *path = getenv("TERRAIN_TRACE_FILE");
+	if (!path || !*path)
+		path = TRACE_FILE;
+
+	std::map<std::string, ZoneSummary> summary;
+	FILE *file = fopen(path, "w");
+	if (file)
+		fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	bool first = true;
+	for (size_t t = 0; t < threads.size(); t++) {
+		const ThreadTrace &thread = *threads[t];
+		if (file) {
+			fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+				first ? "" : ",\n", thread.id, thread.id);
+			first = false;
+		}
+		for (size_t e = 0; e < thread.events.size(); e++) {
+			const TraceEvent &event = thread.events[e];
+			addToSummary(summary, event.name, 1, event.duration, event.duration);
+			if (file)
+				fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+					event.name, thread.id, event.start / 1000.0, event.duration / 1000.0);
+		}
+		for (std::map<const char *, ZoneSummary>::const_iterator z = thread.dropped.begin(); z != thread.dropped.end(); ++z)
+			addToSummary(summary, z->first, z->second.count, z->second.total, z->second.longest);
+	}
+	if (file) {
+		fprintf(file, "\n]}\n");
+		fclose(file);
+		fprintf(stderr, "Trace written to %s\n", path);
+	} else {
+		fprintf(stderr, "Could not write the trace to %s\n", path);
+	}
+
+	// Longest total first
+	std::vector<std::pair<long long, std::string> > order;
+	for (std::map<std::string, ZoneSummary>::const_iterator z = summary.begin(); z != summary.end(); ++z)
+		order.push_back(std::make_pair(-z->second.total, z->first));
+	std::sort(order.begin(), order.end());
+	fprintf(stderr, "%-28s %10s %12s %12s %12s\n", "zone", "count", "total ms", "mean ms", "max ms");
+	for (size_t i = 0; i < order.size(); i++) {
+		const ZoneSummary &zone = summary[order[i].second];
+		fprintf(stderr, "%-28s %10lld %12.3f %12.4f %12.4f\n", order[i].second.c_str(), zone.count, zone.total / 1e6,
+			zone.total / 1e6 / zone.count, zone.longest / 1e6);
+	}
+}
+
+
+/* Nanoseconds since the first zone, starting the tracer on the first call */
+static long long traceClock () {
+	static std::once_flag started;
+	std::call_once(started, [] () {
+		traceStart = std::chrono::steady_clock::now();
+		atexit(writeTrace);
+	});
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceStart).count();
+}
+
+
+TraceZone::TraceZone (const char *name) : name(name), start(traceClock()) {
+}
+
+
+TraceZone::~TraceZone () {
+	long long end = traceClock();
+	if (!currentTrace) {
+		std::lock_guard<std::mutex> guard(traceLock);
+		threads.push_back(std::unique_ptr<ThreadTrace>(new ThreadTrace()));
+		currentTrace = threads.back().get();
+		currentTrace->id = (int) threads.size() - 1;
+	}
+
+	if (currentTrace->events.size() < TRACE_MAX_EVENTS) {
+		TraceEvent event = { name, start, end - start };
+		currentTrace->events.push_back(event);
+	} else {
+		ZoneSummary &zone = currentTrace->dropped[name];
+		zone.count++;
+		zone.total += end - start;
+		zone.longest = std::max(zone.longest, end - start);
+	}
+}
+
+#endif
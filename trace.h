@@ -0,0 +1,43 @@
+/*
+Nolan Slade
+Terrain Generator - scoped zone tracing
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/* TRACE_ZONE("name") times the rest of the enclosing block. Built with TERRAIN_TRACE defined (make TRACE=1), */
+/* every zone is recorded per thread and at exit the trace is written as Chrome trace-event JSON, which */
+/* chrome://tracing and Perfetto open, with a per-zone summary on stderr. Without it the zones compile to nothing */
+/* The name must be a string literal, or live as long as the program */
+
+#ifdef TERRAIN_TRACE
+
+#define TRACE_FILE		"terrain-trace.json"	// Written at exit, TERRAIN_TRACE_FILE in the environment overrides it
+#define TRACE_MAX_EVENTS	(1 << 20)		// Events kept per thread, later ones only count towards the summary
+
+/* Records one zone from construction to destruction */
+class TraceZone {
+public:
+	explicit TraceZone (const char *name);
+	~TraceZone ();
+
+private:
+	TraceZone (const TraceZone &) = delete;
+	TraceZone &operator= (const TraceZone &) = delete;
+
+	const char *name;
+	long long start;			// Nanoseconds since the first zone of the program
+};
+
+#define TRACE_JOIN(a, b)	a##b
+#define TRACE_NAME(line)	TRACE_JOIN(traceZone, line)
+#define TRACE_ZONE(name)	TraceZone TRACE_NAME(__LINE__)(name)
+
+#else
+
+#define TRACE_ZONE(name)
+
+#endif
+
+#endif